@@ -0,0 +1,107 @@
+//--------------------------------------------------------------------*- C++ -*-
+// CLING - the C++ LLVM-based InterpreterG :)
+//
+// This file is dual-licensed: you can choose to license it under the University
+// of Illinois Open Source License or the GNU Lesser General Public License. See
+// LICENSE.TXT for details.
+//------------------------------------------------------------------------------
+
+#ifndef CLING_DECL_NAME_INDEX_H
+#define CLING_DECL_NAME_INDEX_H
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/ADT/iterator_range.h"
+
+#include <map>
+#include <string>
+
+namespace clang {
+  class Decl;
+  class DeclContext;
+  class NamedDecl;
+}
+
+namespace cling {
+  class Transaction;
+
+  ///\brief Maps the qualified names declared by the committed transactions
+  /// to their declarations.
+  ///
+  /// The index knows the namespaces, classes, enums and enumerators,
+  /// typedefs, templates, free functions and variables, including the
+  /// nested types and static data members of classes. Names are spelled as
+  /// in "N::A::B", without anonymous and inline namespaces; enumerators of
+  /// unscoped enums are named after the enclosing scope. The index is built
+  /// from the committed transactions when it is first needed; from then on
+  /// declarations are added as their transaction is committed and removed as
+  /// they are unloaded. Declarations that come from AST files and were never
+  /// handed to a transaction are not known.
+  ///
+  class DeclNameIndex {
+  public:
+    typedef llvm::SmallVector<const clang::NamedDecl*, 1> Decls;
+    typedef std::map<std::string, Decls> NameMap;
+    typedef NameMap::const_iterator const_iterator;
+
+  private:
+    ///\brief The declarations by name, sorted to find prefixes.
+    NameMap m_Names;
+
+    ///\brief The entry of each indexed declaration, to remove it.
+    llvm::DenseMap<const clang::NamedDecl*, NameMap::iterator> m_Indexed;
+
+    ///\brief Whether the committed transactions were indexed.
+    bool m_Built = false;
+
+    ///\brief Add D and what it declares, with names starting with Prefix.
+    void addDecl(const clang::Decl* D, llvm::StringRef Prefix);
+
+    ///\brief Add the declarations in DC, with names starting with Prefix.
+    void addMembers(const clang::DeclContext& DC, llvm::StringRef Prefix);
+
+    ///\brief Index ND under Prefix followed by its name.
+    void insert(const clang::NamedDecl* ND, llvm::StringRef Prefix);
+
+    ///\brief Add T and its nested transactions, if T was committed.
+    void addCommitted(const Transaction& T);
+
+  public:
+    ///\brief Spell names as users do: "N::A", "::N::A" and " N::A " are the
+    /// same.
+    static llvm::StringRef normalizeName(llvm::StringRef Name);
+
+    ///\brief Whether build() was called; until then nothing is indexed.
+    bool isBuilt() const { return m_Built; }
+
+    ///\brief Index the committed transactions, starting at First and
+    /// including their nested transactions.
+    void build(const Transaction* First);
+
+    ///\brief Add the declarations of T, which was just committed. Those of
+    /// its nested transactions were added as they were committed.
+    void add(const Transaction& T);
+
+    ///\brief Forget D, which is being unloaded.
+    void remove(const clang::Decl* D);
+
+    ///\brief The declarations with the qualified name Name, e.g. the
+    /// redeclarations of a class or the overloads of a function.
+    llvm::ArrayRef<const clang::NamedDecl*> find(llvm::StringRef Name) const;
+
+    ///\brief The names starting with Prefix, in lexicographic order.
+    llvm::iterator_range<const_iterator> findPrefix(llvm::StringRef Prefix)
+      const;
+
+    ///\brief The indexed names, in lexicographic order.
+    const_iterator begin() const { return m_Names.begin(); }
+    const_iterator end() const { return m_Names.end(); }
+
+    ///\brief The number of indexed names.
+    size_t size() const { return m_Names.size(); }
+  };
+} // end namespace cling
+
+#endif // CLING_DECL_NAME_INDEX_H
@@ -19,6 +19,7 @@
 #include "cling/Utils/FileEntry.h"
 
 namespace cling {
+  class IncrementalExecutor;
   class InterpreterCallbacks;
   class InvocationOptions;
 
@@ -54,12 +55,17 @@ namespace cling {
 
     InterpreterCallbacks* m_Callbacks;
 
+    ///\brief Notified whenever the set of loaded libraries changes.
+    ///
+    IncrementalExecutor* m_Executor;
+
   public:
     DynamicLibraryManager(const InvocationOptions& Opts);
     ~DynamicLibraryManager();
     InterpreterCallbacks* getCallbacks() { return m_Callbacks; }
     const InterpreterCallbacks* getCallbacks() const { return m_Callbacks; }
     void setCallbacks(InterpreterCallbacks* C) { m_Callbacks = C; }
+    void setExecutor(IncrementalExecutor* E) { m_Executor = E; }
 
     ///\brief Looks up a library taking into account the current include paths
     /// and the system include paths.
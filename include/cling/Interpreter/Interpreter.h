@@ -19,6 +19,8 @@
 #include <memory>
 #include <string>
 #include <unordered_map>
+#include <utility>
+#include <vector>
 
 namespace llvm {
   class raw_ostream;
@@ -65,11 +67,13 @@ namespace cling {
   }
   class ClangInternalState;
   class CompilationOptions;
+  class DeclNameIndex;
   class DynamicLibraryManager;
   class IncrementalExecutor;
   class IncrementalParser;
   class InterpreterCallbacks;
   class LookupHelper;
+  class ReflectionIndex;
   class Value;
   class Transaction;
 
@@ -178,6 +182,10 @@ namespace cling {
     ///
     std::unique_ptr<LookupHelper> m_LookupHelper;
 
+    ///\brief Thread-safe reflection queries, once requested.
+    ///
+    std::unique_ptr<ReflectionIndex> m_ReflectionIndex;
+
     ///\brief Cache of compiled destructors wrappers.
     std::unordered_map<const clang::RecordDecl*, void*> m_DtorWrappers;
 
@@ -205,6 +213,17 @@ namespace cling {
     ///
     int m_OptLevel;
 
+    ///\brief The input that set up the current state, with the unique ID
+    /// of the transaction it created (0 if none), see saveInputs().
+    /// Transactions are pooled, their address identifies no input.
+    ///
+    std::vector<std::pair<unsigned, std::string>> m_RecordedInputs;
+
+    ///\brief Nesting depth of the calls recording their input in
+    /// m_RecordedInputs; only the outermost one is recorded.
+    ///
+    unsigned m_RecordedInputDepth;
+
     ///\brief Interpreter callbacks.
     ///
     std::unique_ptr<InterpreterCallbacks> m_Callbacks;
@@ -225,6 +244,7 @@ namespace cling {
     mutable const Transaction* m_CachedTrns[kNumTransactions];
 
     struct RuntimeIntercept;
+    class RecordInputRAII;
 
 #ifdef LLVM_ON_WIN32
     // Platform specific data that needs to be retained.
@@ -302,6 +322,16 @@ namespace cling {
     ExecutionResult RunFunction(const clang::FunctionDecl* FD,
                                 Value* res = 0);
 
+    ///\brief With --retire-wrappers, unload T once its wrapper ran if
+    /// nothing can refer to T's declarations, code or data any longer.
+    ///
+    ///\param [in] T - The last transaction, whose wrapper ran.
+    ///\param [in] V - The value the wrapper returned.
+    ///
+    ///\returns Whether T was unloaded.
+    ///
+    bool retireWrapper(Transaction& T, const Value& V);
+
     ///\brief Forwards to cling::IncrementalExecutor::addSymbol.
     ///
     bool addSymbol(const char* symbolName,  void* symbolAddress);
@@ -392,6 +422,28 @@ namespace cling {
 
     LookupHelper& getLookupHelper() const { return *m_LookupHelper; }
 
+    ///\brief Make the LookupHelper forget its cached results, as
+    /// declarations were added or removed.
+    ///
+    void invalidateLookupCache();
+
+    ///\brief The index of the qualified names declared by the committed
+    /// transactions, built when first asked for.
+    ///
+    const DeclNameIndex& getDeclNameIndex() const;
+
+    ///\brief Get the index answering reflection queries from several threads,
+    /// creating it for the committed transactions upon the first call. That
+    /// call must not run concurrently with other uses of the interpreter.
+    ///
+    ReflectionIndex& getReflectionIndex();
+
+    ///\brief The reflection index, if getReflectionIndex() created it.
+    ///
+    ReflectionIndex* getReflectionIndexOrNull() const {
+      return m_ReflectionIndex.get();
+    }
+
     const clang::Parser& getParser() const;
     clang::Parser& getParser();
 
@@ -468,11 +520,20 @@ namespace cling {
 
     ///\brief Dump various internal data.
     ///
-    ///\param[in] what - which data to dump. 'undo', 'ast', 'asttree'
-    ///\param[in] filter - optional argument to filter data with.
+    ///\param[in] what - which data to dump. 'undo', 'ast', 'asttree',
+    /// 'decl', 'sloc', 'memory' or 'jit'.
+    ///\param[in] filter - optional argument to filter data with; for
+    /// 'memory' the number of entries of the top lists, for 'jit' part of
+    /// the names of the functions to list.
     ///
     void dump(llvm::StringRef what, llvm::StringRef filter);
 
+    ///\brief Print the memory used by the AST, the source manager, retained
+    /// IR, the JIT, Values and cached wrappers, followed by the TopN
+    /// transactions, headers and macro-defining files using the most of it.
+    ///
+    void printMemoryUsage(llvm::raw_ostream& Out, unsigned TopN = 10) const;
+
     ///\brief Store the interpreter state in files
     /// Store the AST, the included files and the lookup tables
     ///
@@ -494,6 +555,28 @@ namespace cling {
     ///
     void printIncludedFiles (llvm::raw_ostream& out) const;
 
+    ///\brief Save the input that set up the current state to a file, to be
+    /// replayed by replayInputs().
+    ///
+    /// Records the input of the successful calls to process(), declare(),
+    /// echo(), loadFile() and AddIncludePath() whose transactions were not
+    /// unloaded since, in order. Libraries and include paths are recorded as
+    /// the equivalent \#pragma cling. Neither the AST nor the JIT state is
+    /// saved.
+    ///
+    ///\param[in] file - The file to write the inputs to.
+    ///
+    CompilationResult saveInputs(llvm::StringRef file) const;
+
+    ///\brief Parse, compile and run again the inputs saved by saveInputs(),
+    /// without printing values. Their side effects happen again, e.g. a
+    /// statement that incremented a global increments it once more. Stops at
+    /// the first input that fails.
+    ///
+    ///\param[in] file - The file the inputs were saved to.
+    ///
+    CompilationResult replayInputs(llvm::StringRef file);
+
     ///\brief Compiles the given input.
     ///
     /// This interface helps to run everything that cling can run. From
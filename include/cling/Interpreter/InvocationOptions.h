@@ -25,6 +25,12 @@ namespace cling {
       kLanguageObjC    = 2,  ///< Input file is '.m'
       kLanguageObjCXX  = 3,  ///< Input file is '.mm'
     };
+
+    enum {
+      kIncludePathCacheUse     = 0, ///< Reuse cached C++ header paths
+      kIncludePathCacheOff     = 1, ///< Ask the compiler, don't cache
+      kIncludePathCacheRefresh = 2, ///< Ask the compiler, update the cache
+    };
     
     /// \brief Construct CompilerOptions from given arguments. When argc & argv
     /// are 0, all arguments are saved into Remaining to pass to clang. If argc
@@ -52,6 +58,9 @@ namespace cling {
     unsigned HasOutput : 1;
     unsigned Verbose : 1;
     unsigned JITFormat : 2;
+    unsigned TargetCPU : 1;
+    unsigned PrecompiledInput : 1; ///< A PCH, PCM or modules are used
+    unsigned IncludePathCache : 2;
 
     ///\brief The remaining arguments to pass to clang.
     ///
@@ -66,6 +75,14 @@ namespace cling {
     ///        directive for the MetaProcessor. Defaults to "."
     std::string MetaString;
 
+    /// \brief Directory in which JIT-compiled objects are cached across
+    ///        sessions. Empty (the default) disables the cache.
+    std::string ObjectCacheDir;
+
+    /// \brief Number of threads generating code for the JIT. Zero or one
+    ///        (the default) compile on the calling thread.
+    unsigned JITThreads;
+
     std::vector<std::string> LibsToLoad;
     std::vector<std::string> LibSearchPath;
     std::vector<std::string> Inputs;
@@ -76,6 +93,16 @@ namespace cling {
     unsigned ShowVersion : 1;
     unsigned Help : 1;
     unsigned NoRuntime : 1;
+    unsigned JITTiered : 1;
+    unsigned JITLazy : 1;
+    unsigned JITHugePages : 1;
+    unsigned JITPerf : 1;
+    unsigned JITCoalesce : 1;
+    unsigned JITDiscardIR : 1;
+    unsigned WarmStart : 1;
+    unsigned PreambleCache : 1;
+    unsigned InstantiationCache : 1;
+    unsigned RetireWrappers : 1;
     bool Verbose() const { return CompilerOpts.Verbose; }
 
     static void PrintHelp();
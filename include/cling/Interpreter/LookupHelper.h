@@ -10,6 +10,8 @@
 #ifndef CLING_LOOKUP_HELPER_H
 #define CLING_LOOKUP_HELPER_H
 
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/StringMap.h"
 #include "llvm/ADT/StringRef.h"
 #include "llvm/ADT/SmallVector.h"
 
@@ -17,6 +19,7 @@
 
 namespace clang {
   class ClassTemplateDecl;
+  class CXXScopeSpec;
   class Decl;
   class Expr;
   class FunctionDecl;
@@ -59,10 +62,70 @@ namespace cling {
     Interpreter* m_Interpreter; // we do not own.
     const clang::Type* m_StringTy[kNumCachedStrings];
 
+    ///\brief The result of an earlier findType(), findScope(),
+    /// findClassTemplate(), findFunctionProto(), findFunctionArgs() or
+    /// matchFunctionProto(); null for a failed lookup.
+    struct CachedLookup {
+      const void* m_Result; // QualType::getAsOpaquePtr() or the Decl.
+      const clang::Type* m_ResultType; // findScope()'s resultType.
+    };
+
+    ///\brief Results of earlier lookups, by query (see CacheKey()). They are
+    /// valid for m_CacheGeneration.
+    mutable llvm::StringMap<CachedLookup> m_Cache;
+    mutable unsigned m_CacheGeneration;
+
+    ///\brief Bumped whenever names might resolve differently than before.
+    mutable unsigned m_Generation;
+
+    ///\brief Find the result of an earlier lookup of Key, if still valid.
+    const CachedLookup* findCached(llvm::StringRef Key) const;
+
+    ///\brief Remember the result of the lookup of Key.
+    void addToCache(llvm::StringRef Key, const void* Result,
+                    const clang::Type* ResultType,
+                    DiagSetting diagOnOff) const;
+
+    ///\brief Return the function cached for Key, or find it through
+    /// Lookup() and cache it.
+    template <class LookupFn>
+    const clang::FunctionDecl* findCachedFunction(llvm::StringRef Key,
+                                                  DiagSetting diagOnOff,
+                                                  LookupFn Lookup) const;
+
+    clang::QualType findTypeImpl(llvm::StringRef typeName,
+                                 DiagSetting diagOnOff) const;
+    const clang::Decl* findScopeImpl(llvm::StringRef className,
+                                     DiagSetting diagOnOff,
+                                     const clang::Type** resultType,
+                                     bool instantiateTemplate) const;
+
+    ///\brief The scope found for className without parsing it, in Result.
+    ///
+    ///\returns false if className needs to be parsed.
+    bool quickFindScope(llvm::StringRef className, DiagSetting diagOnOff,
+                        const clang::Type** resultType,
+                        bool instantiateTemplate,
+                        const clang::Decl*& Result) const;
+
+    ///\brief The class or namespace named by the nested-name-specifier SS,
+    /// completing it if instantiateTemplate; see findScope().
+    const clang::Decl* findScopeFromSpec(clang::CXXScopeSpec& SS,
+                                         const clang::Type** setResultType,
+                                         bool instantiateTemplate) const;
+    const clang::ClassTemplateDecl*
+    findClassTemplateImpl(llvm::StringRef Name, DiagSetting diagOnOff) const;
+
   public:
     LookupHelper(clang::Parser* P, Interpreter* interp);
     ~LookupHelper();
 
+    ///\brief Forget the results of earlier lookups of types, scopes, class
+    /// templates and overloads. Needed whenever declarations are added or
+    /// removed, i.e. when transactions are committed or unloaded.
+    ///
+    void invalidateCache() { ++m_Generation; }
+
     ///\brief Lookup a type by name, starting from the global
     /// namespace.
     ///
@@ -73,6 +136,18 @@ namespace cling {
     clang::QualType findType(llvm::StringRef typeName,
                              DiagSetting diagOnOff) const;
 
+    ///\brief Lookup several types by name, like findType() but at once:
+    /// the names are parsed from a single buffer and what they cause to be
+    /// deserialized or instantiated ends up in a single transaction.
+    ///
+    ///\param [in] typeNames - The types to lookup.
+    ///\param [in] diagOnOff - Whether to diagnose lookup failures.
+    ///\param [out] types - The type of each name, null where not found.
+    ///
+    void findTypes(llvm::ArrayRef<llvm::StringRef> typeNames,
+                   DiagSetting diagOnOff,
+                   llvm::SmallVectorImpl<clang::QualType>& types) const;
+
     ///\brief Lookup a class declaration by name, starting from the global
     /// namespace, also handles struct, union, namespace, and enum.
     ///
@@ -90,6 +165,22 @@ namespace cling {
                                  const clang::Type** resultType = 0,
                                  bool instantiateTemplate = true) const;
 
+    ///\brief Lookup several class declarations by name, like findScope()
+    /// but within a single transaction, parsing the names from one buffer.
+    ///
+    ///\param [in] classNames - The names to lookup.
+    ///\param [in] diagOnOff - Whether to diagnose lookup failures.
+    ///\param [out] scopes - The declaration of each name or null.
+    ///\param [out] resultTypes - If given, the type of each name, see
+    ///                          findScope().
+    ///\param [in] instantiateTemplate - See findScope().
+    ///
+    void findScopes(llvm::ArrayRef<llvm::StringRef> classNames,
+                    DiagSetting diagOnOff,
+                    llvm::SmallVectorImpl<const clang::Decl*>& scopes,
+                    llvm::SmallVectorImpl<const clang::Type*>* resultTypes = 0,
+                    bool instantiateTemplate = true) const;
+
 
     ///\brief Lookup a class template declaration by name, starting from
     /// the global namespace, also handles struct, union, namespace, and enum.
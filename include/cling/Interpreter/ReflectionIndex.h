@@ -0,0 +1,129 @@
+//--------------------------------------------------------------------*- C++ -*-
+// CLING - the C++ LLVM-based InterpreterG :)
+//
+// This file is dual-licensed: you can choose to license it under the University
+// of Illinois Open Source License or the GNU Lesser General Public License. See
+// LICENSE.TXT for details.
+//------------------------------------------------------------------------------
+
+#ifndef CLING_REFLECTION_INDEX_H
+#define CLING_REFLECTION_INDEX_H
+
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/StringRef.h"
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+
+namespace clang {
+  class Decl;
+  class FunctionDecl;
+  class QualType;
+}
+
+namespace cling {
+  class Interpreter;
+  class Transaction;
+
+  ///\brief Answers common reflection queries from several threads at once.
+  ///
+  /// The index remembers what the DeclNameIndex and the LookupHelper found
+  /// for the qualified names of namespaces, classes, typedefs, functions and
+  /// data members (types possibly with less sugar). Queries first read an
+  /// immutable snapshot of these answers and never touch the Parser or Sema.
+  /// Only on a miss, or while the interpreter parses or unloads, do they
+  /// take getLock() and look the name up, remembering the answer for the
+  /// next query.
+  ///
+  /// Whoever else uses the interpreter while queries might run, e.g. to
+  /// process input, must hold getLock(); this includes calling any
+  /// non-const member of the index.
+  ///
+  class ReflectionIndex {
+  public:
+    ///\brief What is known about a name.
+    struct Entry {
+      const clang::Decl* m_Scope = nullptr; // As findScope() finds it.
+      void* m_Type = nullptr; // QualType::getAsOpaquePtr(), as findType().
+      const clang::FunctionDecl* m_Function = nullptr; // Any of that name.
+      int64_t m_Offset = -1; // In bytes, for non-static data members.
+
+      ///\brief Take the information Other has that this entry lacks.
+      void merge(const Entry& Other);
+    };
+
+    ///\brief Marks the interpreter parsing or unloading: meanwhile,
+    /// queries wait for getLock(). Index might be null.
+    class UpdateRAII {
+      ReflectionIndex* m_Index;
+    public:
+      UpdateRAII(ReflectionIndex* Index, bool Unloading);
+      ~UpdateRAII();
+    };
+
+  private:
+    ///\brief The names added since the snapshot m_Prev was published.
+    /// Names in newer snapshots take precedence.
+    struct Snapshot {
+      llvm::StringMap<Entry> m_Names;
+      std::shared_ptr<const Snapshot> m_Prev;
+    };
+
+    Interpreter& m_Interpreter;
+
+    ///\brief The current snapshot; accessed with std::atomic_load/store.
+    std::shared_ptr<const Snapshot> m_Current;
+
+    ///\brief Incremented as an update starts and as it ends: odd while
+    /// the interpreter parses or unloads.
+    std::atomic<unsigned> m_Generation;
+
+    ///\brief The number of nested UpdateRAIIs.
+    unsigned m_UpdateDepth;
+
+    ///\brief Serializes the uses of the Sema.
+    std::mutex m_Lock;
+
+    ///\brief Make Names the newest snapshot.
+    void publish(llvm::StringMap<Entry>&& Names);
+
+    ///\brief Find Name in the current snapshot into Result.
+    ///\returns false if an update ran meanwhile; Result cannot be trusted.
+    bool find(llvm::StringRef Name, Entry& Result) const;
+
+    ///\brief What the DeclNameIndex knows about Name. Needs getLock().
+    Entry lookup(llvm::StringRef Name) const;
+
+  public:
+    ReflectionIndex(Interpreter& Interp);
+    ~ReflectionIndex();
+
+    ///\brief The lock the uses of the interpreter must hold while queries
+    /// might run.
+    std::mutex& getLock() { return m_Lock; }
+
+    ///\brief Forget all names, e.g. as some are about to be unloaded.
+    void clear();
+
+    ///\brief Lookup a type by its qualified name, like
+    /// LookupHelper::findType(). Thread-safe.
+    clang::QualType findType(llvm::StringRef Name);
+
+    ///\brief Lookup a namespace, class or enum by its qualified name, like
+    /// LookupHelper::findScope(). Thread-safe.
+    const clang::Decl* findScope(llvm::StringRef Name);
+
+    ///\brief Lookup any function of the given qualified name, like
+    /// LookupHelper::findAnyFunction(). Thread-safe.
+    const clang::FunctionDecl* findAnyFunction(llvm::StringRef Name);
+
+    ///\brief Get the offset in bytes of the non-static data member Member
+    /// of the class Scope, both qualified names; -1 if not found. The
+    /// class's layout is computed upon the first such query. Thread-safe.
+    int64_t getDataMemberOffset(llvm::StringRef Scope, llvm::StringRef Member);
+  };
+} // end namespace cling
+
+#endif // CLING_REFLECTION_INDEX_H
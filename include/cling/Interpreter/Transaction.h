@@ -185,6 +185,12 @@ namespace cling {
     ///
     clang::FileID m_BufferFID;
 
+    ///\brief The ASTContext's allocated bytes when the transaction began;
+    /// once committed, the bytes it allocated from then on, including
+    /// those of its nested transactions.
+    ///
+    size_t m_ASTBytes;
+
     /// TransactionPool needs direct access to m_State as setState asserts
     friend class TransactionPool;
 
@@ -501,6 +507,9 @@ namespace cling {
 
     void setBufferFID(clang::FileID FID) { m_BufferFID = FID; }
     clang::FileID getBufferFID() const { return m_BufferFID; }
+
+    size_t getASTBytes() const { return m_ASTBytes; }
+    void setASTBytes(size_t Bytes) { m_ASTBytes = Bytes; }
     clang::SourceLocation getSourceStart(const clang::SourceManager& SM) const;
 
     ///\brief The transactions could be reused and the pointer couldn't serve
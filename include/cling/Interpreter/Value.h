@@ -210,6 +210,13 @@ namespace cling {
       return getStorageType() == kManagedAllocation;
     }
 
+    /// \brief The number of managed heap allocations of all Values that are
+    /// still referenced.
+    static size_t getNumManagedAllocations();
+
+    /// \brief The bytes of these allocations, including their bookkeeping.
+    static size_t getManagedAllocationBytes();
+
     /// \brief Determine whether the Value has been set.
     //
     /// Determine whether the Value has been set by checking
@@ -9,9 +9,11 @@
 
 #include "BackendPasses.h"
 
+#include "llvm/ADT/SmallPtrSet.h"
 #include "llvm/Analysis/InlineCost.h"
 #include "llvm/Analysis/TargetLibraryInfo.h"
 #include "llvm/Analysis/TargetTransformInfo.h"
+#include "llvm/IR/Constants.h"
 #include "llvm/IR/LegacyPassManager.h"
 #include "llvm/IR/Module.h"
 #include "llvm/IR/Verifier.h"
@@ -26,16 +28,81 @@
 //#include "clang/Basic/TargetOptions.h"
 #include "clang/Frontend/CodeGenOptions.h"
 
+#include "cling/Utils/AST.h"
+
 using namespace cling;
 using namespace clang;
 using namespace llvm;
 using namespace llvm::legacy;
 
 namespace {
+  ///\brief Give external linkage to the local definitions that later modules
+  /// or cling itself refer to by name.
+  ///
+  /// Every transaction ends up in a module of its own; a later transaction
+  /// refers to e.g. a static variable or function defined in an earlier one
+  /// through a declaration of the same mangled name. Only such definitions
+  /// are promoted, keeping their names:
+  /// - entities declared at namespace scope, and in the wrapper functions
+  ///   whose declarations cling moves there (see DeclExtractor);
+  /// - their vtables, type infos etc;
+  /// - unmangled ones, e.g. C statics or those with an asm label.
+  /// Everything else stays local, so that the optimizer is free to inline,
+  /// propagate and drop it:
+  /// - private globals (string literals, constant pools etc);
+  /// - the locals of a function and their guard variables, only reachable
+  ///   through the function;
+  /// - the initialization helpers clang synthesizes per module.
+  /// The static initialization functions listed in llvm.global_ctors and
+  /// llvm.global_dtors are run by name (see
+  /// IncrementalExecutor::runStaticInitializersOnce()). clang names them
+  /// after the main file, the same for every module: they are promoted with
+  /// the module's identifier appended.
   class KeepLocalGVPass: public ModulePass {
     static char ID;
 
-    bool runOnGlobal(GlobalValue& GV) {
+    ///\brief Collect the functions run by name as static initializers.
+    static void collectInitFunctions(Module& M,
+                                     SmallPtrSetImpl<GlobalValue*>& S) {
+      for (const char* Name: {"llvm.global_ctors", "llvm.global_dtors"}) {
+        const GlobalVariable* GV = M.getNamedGlobal(Name);
+        if (!GV || !GV->hasInitializer())
+          continue;
+        const ConstantArray* InitList
+          = dyn_cast<ConstantArray>(GV->getInitializer());
+        if (!InitList)
+          continue;
+        for (const Use& U: InitList->operands()) {
+          const ConstantStruct* CS = dyn_cast<ConstantStruct>(U.get());
+          if (!CS || CS->getNumOperands() < 2)
+            continue;
+          if (GlobalValue* F = dyn_cast<GlobalValue>(
+                                   CS->getOperand(1)->stripPointerCasts()))
+            S.insert(F);
+        }
+      }
+    }
+
+    ///\brief Whether GV was emitted for a declaration that later modules
+    /// can refer to through its (mangled) name.
+    static bool isReferencedByName(const GlobalValue& GV) {
+      const StringRef Name = GV.getName();
+      // The helpers clang synthesizes have reserved names or contain a '.',
+      // which an unmangled user declaration cannot.
+      if (!Name.startswith("_Z"))
+        return !Name.startswith("__") && !Name.startswith("_GLOBAL__")
+          && Name.find('.') == StringRef::npos;
+      if (Name.startswith("_ZGV"))
+        return false; // guard variables.
+      // The locals of a function (_ZZ <function> E <entity>) are only used
+      // by it, unless cling moved them out of a wrapper function.
+      if (Name.startswith("_ZZ"))
+        return Name.find(utils::Synthesize::UniquePrefix) != StringRef::npos;
+      return true;
+    }
+
+    bool runOnGlobal(GlobalValue& GV,
+                     const SmallPtrSetImpl<GlobalValue*>& Inits) {
       if (GV.isDeclaration())
         return false; // no change.
 
@@ -45,23 +112,32 @@ namespace {
       if (!GV.isDiscardableIfUnused(LT))
         return false;
 
-      if (LT == llvm::GlobalValue::InternalLinkage
-          || LT == llvm::GlobalValue::PrivateLinkage) {
-        GV.setLinkage(llvm::GlobalValue::ExternalLinkage);
-        return true; // a change!
-      }
-      return false;
+      if (LT != llvm::GlobalValue::InternalLinkage
+          && LT != llvm::GlobalValue::PrivateLinkage)
+        return false;
+
+      if (Inits.count(&GV)) {
+        GV.setName(GV.getName() + "." + GV.getParent()->getModuleIdentifier());
+      } else if (LT == llvm::GlobalValue::PrivateLinkage
+                 || !isReferencedByName(GV))
+        return false;
+
+      GV.setLinkage(llvm::GlobalValue::ExternalLinkage);
+      return true; // a change!
     }
 
   public:
     KeepLocalGVPass() : ModulePass(ID) {}
 
     bool runOnModule(Module &M) override {
+      SmallPtrSet<GlobalValue*, 4> Inits;
+      collectInitFunctions(M, Inits);
+
       bool ret = false;
       for (auto &&F: M)
-        ret |= runOnGlobal(F);
+        ret |= runOnGlobal(F, Inits);
       for (auto &&G: M.globals())
-        ret |= runOnGlobal(G);
+        ret |= runOnGlobal(G, Inits);
       return ret;
     }
   };
@@ -40,9 +40,12 @@
 #include "llvm/Option/ArgList.h"
 #include "llvm/Support/FileSystem.h"
 #include "llvm/Support/Host.h"
+#include "llvm/Support/MD5.h"
 #include "llvm/Support/MemoryBuffer.h"
 #include "llvm/Support/Path.h"
 #include "llvm/Support/Process.h"
+#include "llvm/Support/Program.h"
+#include "llvm/Support/raw_ostream.h"
 #include "llvm/Support/TargetSelect.h"
 #include "llvm/Target/TargetOptions.h"
 
@@ -103,10 +106,131 @@ namespace {
 
 #ifndef _MSC_VER
 
+  ///\brief Describe everything the C++ header paths reported by Compiler
+  /// depend on: the command, the identity of the executable and the
+  /// environment variables the compiler looks at.
+  ///\returns false if the executable cannot be found.
+  static bool GetIncludePathCacheKey(llvm::StringRef Compiler,
+                                     std::string& Key) {
+    std::string Exe = Compiler.split(' ').first;
+    if (Exe.find('/') == std::string::npos) {
+      llvm::ErrorOr<std::string> InPath = llvm::sys::findProgramByName(Exe);
+      if (!InPath)
+        return false;
+      Exe = std::move(*InPath);
+    }
+    llvm::sys::fs::file_status Status;
+    if (llvm::sys::fs::status(Exe, Status))
+      return false;
+
+    llvm::raw_string_ostream Out(Key);
+    Out << Compiler << '\n' << Exe << '\n'
+        << Status.getUniqueID().getDevice() << ':'
+        << Status.getUniqueID().getFile() << ':' << Status.getSize() << ':'
+        << Status.getLastModificationTime().time_since_epoch().count() << '\n';
+    for (const char* Var: {"CPATH", "CPLUS_INCLUDE_PATH", "COMPILER_PATH",
+                           "GCC_EXEC_PREFIX", "SDKROOT"}) {
+      if (const char* Val = ::getenv(Var))
+        Out << Var << '=' << Val << '\n';
+    }
+    Out.flush();
+    return true;
+  }
+
+  ///\brief Get the file caching the include paths for Key.
+  static bool GetIncludePathCacheFile(const std::string& Key,
+                                      llvm::SmallVectorImpl<char>& File) {
+    if (!llvm::sys::path::user_cache_directory(File, "cling"))
+      return false;
+    llvm::MD5 Hash;
+    Hash.update(Key);
+    llvm::MD5::MD5Result Result;
+    Hash.final(Result);
+    llvm::SmallString<32> Digest;
+    llvm::MD5::stringifyResult(Result, Digest);
+    llvm::sys::path::append(File, "include-paths-" + Digest.str());
+    return true;
+  }
+
+  ///\brief Add the -I arguments stored in File, if it was written for Key
+  /// and all its directories still exist.
+  static bool ReadIncludePathCache(llvm::StringRef File,
+                                   const std::string& Key,
+                                   AdditionalArgList& Args, bool Verbose) {
+    llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> Buf
+      = llvm::MemoryBuffer::getFile(File);
+    if (!Buf)
+      return false;
+    llvm::StringRef Content = (*Buf)->getBuffer();
+    if (!Content.startswith(Key))
+      return false;
+
+    llvm::SmallVector<llvm::StringRef, 8> Paths;
+    Content.drop_front(Key.size()).split(Paths, '\n', -1, false);
+    if (Paths.empty())
+      return false;
+    for (llvm::StringRef Path: Paths)
+      if (!llvm::sys::fs::is_directory(Path))
+        return false;
+
+    if (Verbose)
+      cling::log() << "Using C++ headers cached in '" << File << "':\n";
+    for (llvm::StringRef Path: Paths) {
+      if (Verbose)
+        cling::log() << "  " << Path << "\n";
+      Args.addArgument("-I", Path.str());
+    }
+    return true;
+  }
+
+  ///\brief Store the -I arguments in Args to File, tagged by Key.
+  static void WriteIncludePathCache(llvm::StringRef File,
+                                    const std::string& Key,
+                                    const AdditionalArgList& Args) {
+    if (llvm::sys::fs::create_directories(llvm::sys::path::parent_path(File)))
+      return;
+
+    // Write to a unique temporary and rename it into place: other processes
+    // might be reading the cache right now.
+    llvm::SmallString<256> Model(File);
+    Model += ".%%%%%%.tmp";
+    llvm::SmallString<256> TmpPath;
+    int FD;
+    if (llvm::sys::fs::createUniqueFile(Model, FD, TmpPath))
+      return;
+    {
+      llvm::raw_fd_ostream Out(FD, true /*shouldClose*/);
+      Out << Key;
+      for (const auto& Arg : Args)
+        Out << Arg.second << '\n';
+      Out.close();
+      if (Out.has_error()) {
+        Out.clear_error();
+        llvm::sys::fs::remove(TmpPath);
+        return;
+      }
+    }
+    if (llvm::sys::fs::rename(TmpPath, File))
+      llvm::sys::fs::remove(TmpPath);
+  }
+
   static void ReadCompilerIncludePaths(const char* Compiler,
                                        llvm::SmallVectorImpl<char>& Buf,
                                        AdditionalArgList& Args,
-                                       bool Verbose) {
+                                       bool Verbose, unsigned CacheMode) {
+    // Asking the compiler forks a shell pipeline; reuse what an earlier
+    // process found for the very same compiler.
+    std::string CacheKey;
+    llvm::SmallString<256> CacheFile;
+    if (CacheMode != CompilerOptions::kIncludePathCacheOff
+        && GetIncludePathCacheKey(Compiler, CacheKey)
+        && GetIncludePathCacheFile(CacheKey, CacheFile)) {
+      if (CacheMode == CompilerOptions::kIncludePathCacheUse
+          && ReadIncludePathCache(CacheFile, CacheKey, Args, Verbose))
+        return;
+    } else
+      CacheFile.clear();
+
     std::string CppInclQuery("LC_ALL=C ");
     CppInclQuery.append(Compiler);
     CppInclQuery.append(" -xc++ -E -v /dev/null 2>&1 >/dev/null "
@@ -144,10 +268,14 @@ namespace {
     if (Args.empty()) {
       Buf.resize(0);
       Buf.insert(Buf.begin(), CppInclQuery.begin(), CppInclQuery.end());
-    } else if (Verbose) {
-      cling::log() << "Found:\n";
-      for (const auto& Arg : Args)
-        cling::log() << "  " << Arg.second << "\n";
+    } else {
+      if (Verbose) {
+        cling::log() << "Found:\n";
+        for (const auto& Arg : Args)
+          cling::log() << "  " << Arg.second << "\n";
+      }
+      if (!CacheFile.empty())
+        WriteIncludePathCache(CacheFile, CacheKey, Args);
     }
   }
 
@@ -261,7 +389,8 @@ namespace {
             clang.append(" -stdlib=libstdc++");
   #endif
           }
-          ReadCompilerIncludePaths(clang.c_str(), buffer, sArguments, Verbose);
+          ReadCompilerIncludePaths(clang.c_str(), buffer, sArguments, Verbose,
+                                   opts.IncludePathCache);
         }
   #endif // _LIBCPP_VERSION
 
@@ -273,12 +402,14 @@ namespace {
   // Then try the absolute path i.e.: '/usr/bin/g++'
   #ifdef CLING_CXX_PATH
         if (sArguments.empty())
-          ReadCompilerIncludePaths(CLING_CXX_PATH, buffer, sArguments, Verbose);
+          ReadCompilerIncludePaths(CLING_CXX_PATH, buffer, sArguments, Verbose,
+                                   opts.IncludePathCache);
   #endif
   // Finally try the relative path 'g++'
   #ifdef CLING_CXX_RLTV
         if (sArguments.empty())
-          ReadCompilerIncludePaths(CLING_CXX_RLTV, buffer, sArguments, Verbose);
+          ReadCompilerIncludePaths(CLING_CXX_RLTV, buffer, sArguments, Verbose,
+                                   opts.IncludePathCache);
   #endif
 
         if (sArguments.empty()) {
@@ -747,6 +878,23 @@ static void stringifyPreprocSetting(PreprocessorOptions& PPOpts,
         break;
     }
 
+    // The code is JIT-compiled for and run on this very machine: make use of
+    // all of its CPU's features, unless told otherwise through -march or
+    // -mcpu, or writing output (e.g. a PCH) that might be used elsewhere.
+    // A PCH, PCM or module given by the user was most likely built without
+    // it, and clang refuses to load one built for different target features.
+    // cling's own images (WarmStartImage) are keyed on the target CPU and its
+    // features, so they always match.
+    // Passed before the user's arguments, which thus take precedence.
+    if (!COpts.TargetCPU && !COpts.HasOutput && !COpts.PrecompiledInput) {
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) \
+    || defined(_M_IX86)
+      argvCompile.push_back("-march=native");
+#elif defined(__aarch64__) || defined(__arm__) || defined(__powerpc__)
+      argvCompile.push_back("-mcpu=native");
+#endif
+    }
+
     // argv[0] already inserted, get the rest
     argvCompile.insert(argvCompile.end(), argv+1, argv + argc);
 
@@ -14,6 +14,8 @@
 
 #include "ASTTransformer.h"
 
+#include "cling/Interpreter/DeclNameIndex.h"
+
 #include <vector>
 #include <memory>
 
@@ -59,6 +61,10 @@ namespace cling {
     /// Whether Transform() is active; prevents recursion.
     bool m_Transforming = false;
 
+    ///\brief The names declared by the committed transactions.
+    ///
+    DeclNameIndex m_NameIndex;
+
     ///\brief Test whether the first decl of the DeclGroupRef comes from an AST
     /// file.
     ///
@@ -116,8 +122,22 @@ namespace cling {
     Transaction* getTransaction() { return m_CurTransaction; }
     const Transaction* getTransaction() const { return m_CurTransaction; }
     void setTransaction(Transaction* curT) { m_CurTransaction = curT; }
+
+    ///\brief Add the names declared by T, which is being committed, once the
+    /// name index was built.
+    ///
+    void TransactionCommitted(const Transaction& T) {
+      if (m_NameIndex.isBuilt())
+        m_NameIndex.add(T);
+    }
     /// \}
 
+    ///\brief The names declared by the committed transactions, once built;
+    /// the DeclUnloader removes the unloaded ones.
+    ///
+    DeclNameIndex& getNameIndex() { return m_NameIndex; }
+    const DeclNameIndex& getNameIndex() const { return m_NameIndex; }
+
     // dyn_cast/isa support
     static bool classof(const clang::ASTConsumer*) { return true; }
   };
@@ -0,0 +1,204 @@
+//------------------------------------------------------------------------------
+// CLING - the C++ LLVM-based InterpreterG :)
+//
+// This file is dual-licensed: you can choose to license it under the University
+// of Illinois Open Source License or the GNU Lesser General Public License. See
+// LICENSE.TXT for details.
+//------------------------------------------------------------------------------
+
+#include "cling/Interpreter/DeclNameIndex.h"
+
+#include "cling/Interpreter/Transaction.h"
+#include "cling/Utils/AST.h"
+
+#include "clang/AST/Decl.h"
+#include "clang/AST/DeclCXX.h"
+#include "clang/AST/DeclTemplate.h"
+
+#include <algorithm>
+
+using namespace clang;
+
+namespace {
+  ///\brief Append the qualified name of the scope DC to Prefix, followed by
+  /// "::" unless it is the global scope.
+  ///
+  ///\returns false if the names declared in DC cannot be spelled with a
+  /// qualified name, e.g. in functions or class template specializations.
+  ///
+  static bool AppendScope(const DeclContext* DC, std::string& Prefix) {
+    if (DC->isTranslationUnit())
+      return true;
+    if (DC->isFunctionOrMethod() || DC->isDependentContext())
+      return false;
+    if (!AppendScope(DC->getParent(), Prefix))
+      return false;
+    // Linkage specifications and unscoped enums.
+    if (DC->isTransparentContext())
+      return true;
+
+    if (const NamespaceDecl* NSD = dyn_cast<NamespaceDecl>(DC)) {
+      if (NSD->isAnonymousNamespace() || NSD->isInline())
+        return true;
+      Prefix += NSD->getName();
+    } else if (const TagDecl* TD = dyn_cast<TagDecl>(DC)) {
+      if (isa<ClassTemplateSpecializationDecl>(TD))
+        return false;
+      if (!TD->getDeclName()) {
+        const RecordDecl* RD = dyn_cast<RecordDecl>(TD);
+        return RD && RD->isAnonymousStructOrUnion();
+      }
+      Prefix += TD->getName();
+    } else
+      return false;
+    Prefix += "::";
+    return true;
+  }
+} // unnamed namespace
+
+namespace cling {
+
+  llvm::StringRef DeclNameIndex::normalizeName(llvm::StringRef Name) {
+    Name = Name.trim();
+    if (Name.startswith("::"))
+      Name = Name.drop_front(2);
+    return Name;
+  }
+
+  void DeclNameIndex::insert(const NamedDecl* ND, llvm::StringRef Prefix) {
+    if (m_Indexed.count(ND))
+      return;
+    NameMap::iterator I
+      = m_Names.insert(std::make_pair(Prefix.str() + ND->getNameAsString(),
+                                      Decls())).first;
+    I->second.push_back(ND);
+    m_Indexed[ND] = I;
+  }
+
+  void DeclNameIndex::addMembers(const DeclContext& DC,
+                                 llvm::StringRef Prefix) {
+    // Do not deserialize what was not needed so far.
+    for (const Decl* D: DC.noload_decls())
+      addDecl(D, Prefix);
+  }
+
+  void DeclNameIndex::addDecl(const Decl* D, llvm::StringRef Prefix) {
+    // Implicit decls include the injected class names.
+    if (D->isInvalidDecl() || D->isImplicit())
+      return;
+    if (const LinkageSpecDecl* LSD = dyn_cast<LinkageSpecDecl>(D)) {
+      addMembers(*LSD, Prefix);
+      return;
+    }
+    const NamedDecl* ND = dyn_cast<NamedDecl>(D);
+    // Also, a decl group or a namespace might be seen twice.
+    if (!ND || m_Indexed.count(ND))
+      return;
+
+    if (const NamespaceDecl* NSD = dyn_cast<NamespaceDecl>(ND)) {
+      if (NSD->isAnonymousNamespace() || NSD->isInline()) {
+        addMembers(*NSD, Prefix);
+        return;
+      }
+      insert(NSD, Prefix);
+      addMembers(*NSD, Prefix.str() + NSD->getName().str() + "::");
+    } else if (const TagDecl* TD = dyn_cast<TagDecl>(ND)) {
+      // Specializations are spelled with their arguments; the class
+      // template itself is indexed as such.
+      if (isa<ClassTemplateSpecializationDecl>(TD))
+        return;
+      if (const CXXRecordDecl* RD = dyn_cast<CXXRecordDecl>(TD))
+        if (RD->getDescribedClassTemplate())
+          return;
+      if (TD->getDeclName())
+        insert(TD, Prefix);
+      if (!TD->isCompleteDefinition())
+        return;
+      if (const EnumDecl* ED = dyn_cast<EnumDecl>(TD)) {
+        std::string Scope = Prefix.str();
+        if (ED->isScoped())
+          Scope += ED->getName().str() + "::";
+        for (const EnumConstantDecl* ECD: ED->enumerators())
+          insert(ECD, Scope);
+      } else if (TD->getDeclName())
+        addMembers(*TD, Prefix.str() + TD->getName().str() + "::");
+    } else if (const FunctionDecl* FD = dyn_cast<FunctionDecl>(ND)) {
+      if (isa<CXXMethodDecl>(FD) || FD->getDescribedFunctionTemplate()
+          || FD->isFunctionTemplateSpecialization()
+          || utils::Analyze::IsWrapper(FD))
+        return;
+      insert(FD, Prefix);
+    } else if (const VarDecl* VD = dyn_cast<VarDecl>(ND)) {
+      if (isa<VarTemplateSpecializationDecl>(VD)
+          || VD->getDescribedVarTemplate())
+        return;
+      insert(VD, Prefix);
+    } else if (isa<TypedefNameDecl>(ND) || isa<RedeclarableTemplateDecl>(ND)
+               || isa<NamespaceAliasDecl>(ND)) {
+      insert(ND, Prefix);
+    }
+  }
+
+  void DeclNameIndex::add(const Transaction& T) {
+    for (const Transaction::DelayCallInfo& DCI: T.decls()) {
+      // The others are instantiations, spelled with template arguments.
+      if (DCI.m_Call != Transaction::kCCIHandleTopLevelDecl
+          && DCI.m_Call != Transaction::kCCIHandleInterestingDecl)
+        continue;
+      for (const Decl* D: DCI.m_DGR) {
+        // E.g. the out-of-line definition of N::A::f.
+        std::string Prefix;
+        if (AppendScope(D->getDeclContext(), Prefix))
+          addDecl(D, Prefix);
+      }
+    }
+  }
+
+  void DeclNameIndex::addCommitted(const Transaction& T) {
+    if (T.getState() != Transaction::kCommitted)
+      return;
+    // Nested transactions were committed before their parent.
+    for (auto I = T.nested_begin(), E = T.nested_end(); I != E; ++I)
+      addCommitted(**I);
+    add(T);
+  }
+
+  void DeclNameIndex::build(const Transaction* First) {
+    m_Built = true;
+    for (const Transaction* T = First; T; T = T->getNext())
+      addCommitted(*T);
+  }
+
+  void DeclNameIndex::remove(const Decl* D) {
+    const NamedDecl* ND = dyn_cast<NamedDecl>(D);
+    if (!ND)
+      return;
+    auto Pos = m_Indexed.find(ND);
+    if (Pos == m_Indexed.end())
+      return;
+    Decls& Entry = Pos->second->second;
+    Entry.erase(std::find(Entry.begin(), Entry.end(), ND));
+    if (Entry.empty())
+      m_Names.erase(Pos->second);
+    m_Indexed.erase(Pos);
+  }
+
+  llvm::ArrayRef<const NamedDecl*>
+  DeclNameIndex::find(llvm::StringRef Name) const {
+    const_iterator I = m_Names.find(normalizeName(Name).str());
+    if (I == m_Names.end())
+      return llvm::ArrayRef<const NamedDecl*>();
+    return I->second;
+  }
+
+  llvm::iterator_range<DeclNameIndex::const_iterator>
+  DeclNameIndex::findPrefix(llvm::StringRef Prefix) const {
+    Prefix = normalizeName(Prefix);
+    const_iterator Begin = m_Names.lower_bound(Prefix.str());
+    const_iterator End = Begin;
+    while (End != m_Names.end() && llvm::StringRef(End->first)
+           .startswith(Prefix))
+      ++End;
+    return llvm::make_range(Begin, End);
+  }
+} // end namespace cling
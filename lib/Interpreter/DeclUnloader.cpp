@@ -9,6 +9,7 @@
 
 #include "DeclUnloader.h"
 
+#include "DeclCollector.h"
 #include "cling/Utils/AST.h"
 #ifdef LLVM_ON_WIN32
 #include "cling/Utils/Diagnostics.h"
@@ -375,6 +376,11 @@ bool DeclUnloader::VisitRedeclarable(clang::Redeclarable<T>* R, DeclContext* DC)
 
     DeclContext* DC = D->getLexicalDeclContext();
 
+    // Every unloaded decl ends up here, including the nested ones.
+    if (DeclCollector* Collector
+        = dyn_cast<DeclCollector>(&m_Sema->getASTConsumer()))
+      Collector->getNameIndex().remove(D);
+
     bool Successful = true;
     if (DC->containsDecl(D))
       DC->removeDecl(D);
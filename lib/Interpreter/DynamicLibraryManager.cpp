@@ -8,6 +8,7 @@
 //------------------------------------------------------------------------------
 
 #include "cling/Interpreter/DynamicLibraryManager.h"
+#include "IncrementalExecutor.h"
 #include "cling/Interpreter/InterpreterCallbacks.h"
 #include "cling/Interpreter/InvocationOptions.h"
 #include "cling/Utils/Paths.h"
@@ -205,7 +206,7 @@ namespace {
   }
 
   DynamicLibraryManager::DynamicLibraryManager(const InvocationOptions& Opts)
-    : m_Opts(Opts), m_Callbacks(0) {
+    : m_Opts(Opts), m_Callbacks(0), m_Executor(0) {
     const llvm::SmallVector<const char*, 10> kSysLibraryEnv = {
       "LD_LIBRARY_PATH",
   #if __APPLE__
@@ -341,6 +342,9 @@ namespace {
       return kLoadLibAlreadyLoaded;
     }
 
+    if (m_Executor)
+      m_Executor->librariesChanged();
+
     if (InterpreterCallbacks* C = getCallbacks())
       C->LibraryLoaded(dyLibHandle, canonicalLib);
 
@@ -371,6 +375,9 @@ namespace {
                     << errMsg << '\n';
     }
 
+    if (m_Executor)
+      m_Executor->librariesChanged();
+
     if (InterpreterCallbacks* C = getCallbacks())
       C->LibraryUnloaded(dyLibHandle, canonicalLoadedLib);
 
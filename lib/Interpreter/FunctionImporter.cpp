@@ -0,0 +1,254 @@
+//--------------------------------------------------------------------*- C++ -*-
+// CLING - the C++ LLVM-based InterpreterG :)
+//
+// This file is dual-licensed: you can choose to license it under the University
+// of Illinois Open Source License or the GNU Lesser General Public License. See
+// LICENSE.TXT for details.
+//------------------------------------------------------------------------------
+
+#include "FunctionImporter.h"
+
+#include "cling/Utils/AST.h"
+
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/DebugInfo.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Transforms/Utils/Cloning.h"
+
+using namespace llvm;
+
+namespace {
+  ///\brief Collect the globals F refers to.
+  ///\returns false if F refers to something that cannot be imported.
+  static bool collectGlobals(const Function& F,
+                             SmallPtrSetImpl<GlobalValue*>& Globals) {
+    SmallPtrSet<const Constant*, 32> Visited;
+    SmallVector<const Constant*, 32> Worklist;
+    if (F.hasPersonalityFn())
+      Worklist.push_back(F.getPersonalityFn());
+    for (const BasicBlock& BB: F)
+      for (const Instruction& I: BB)
+        for (const Value* Op: I.operands())
+          if (auto C = dyn_cast<Constant>(Op))
+            Worklist.push_back(C);
+
+    while (!Worklist.empty()) {
+      const Constant* C = Worklist.pop_back_val();
+      if (!Visited.insert(C).second)
+        continue;
+      if (isa<BlockAddress>(C))
+        return false;
+      if (auto GV = dyn_cast<GlobalValue>(C)) {
+        Globals.insert(const_cast<GlobalValue*>(GV));
+        continue;
+      }
+      for (const Value* Op: C->operands())
+        Worklist.push_back(cast<Constant>(Op));
+    }
+    return true;
+  }
+
+  ///\brief Find or declare a global named as GV in Dst.
+  ///\returns nullptr if Dst has a global of that name that GV cannot be
+  /// bound to.
+  static GlobalValue* getOrDeclare(Module& Dst, const GlobalValue& GV,
+                                   SmallVectorImpl<Function*>* NewDecls) {
+    if (GlobalValue* Existing = Dst.getNamedValue(GV.getName())) {
+      if (Existing->hasLocalLinkage() || Existing->getType() != GV.getType())
+        return nullptr;
+      return Existing;
+    }
+
+    Type* ValueTy = GV.getValueType();
+    if (isa<GlobalIFunc>(GV))
+      return nullptr;
+    if (auto FT = dyn_cast<FunctionType>(ValueTy)) {
+      Function* Decl = Function::Create(FT, GlobalValue::ExternalLinkage,
+                                        GV.getName(), &Dst);
+      if (auto F = dyn_cast<Function>(&GV))
+        Decl->setAttributes(F->getAttributes());
+      if (NewDecls)
+        NewDecls->push_back(Decl);
+      return Decl;
+    }
+    const GlobalVariable* Var = dyn_cast<GlobalVariable>(&GV);
+    return new GlobalVariable(Dst, ValueTy, Var && Var->isConstant(),
+                              GlobalValue::ExternalLinkage, nullptr,
+                              GV.getName(), nullptr, GV.getThreadLocalMode(),
+                              GV.getType()->getAddressSpace());
+  }
+} // unnamed namespace
+
+namespace cling {
+
+FunctionImporter::FunctionImporter() {}
+
+FunctionImporter::~FunctionImporter() {}
+
+bool FunctionImporter::cloneBody(const Function& Src, Function& Dst,
+                                 SmallVectorImpl<Function*>* NewDecls) {
+  assert(Dst.isDeclaration() && "Dst already has a body!");
+  if (Src.getFunctionType() != Dst.getFunctionType())
+    return false;
+
+  SmallPtrSet<GlobalValue*, 16> Globals;
+  if (!collectGlobals(Src, Globals))
+    return false;
+
+  Module& DstM = *Dst.getParent();
+  ValueToValueMapTy VMap;
+  for (GlobalValue* GV: Globals) {
+    if (GV == &Src) {
+      VMap[GV] = &Dst;
+      continue;
+    }
+    GlobalValue* DstGV = getOrDeclare(DstM, *GV, NewDecls);
+    if (!DstGV)
+      return false;
+    VMap[GV] = DstGV;
+  }
+
+  auto DstArg = Dst.arg_begin();
+  for (const Argument& A: Src.args()) {
+    DstArg->setName(A.getName());
+    VMap[&A] = &*DstArg++;
+  }
+
+  SmallVector<ReturnInst*, 4> Returns;
+  CloneFunctionInto(&Dst, &Src, VMap, true /*ModuleLevelChanges*/, Returns);
+  // The debug info would refer to the other module's compile unit.
+  stripDebugInfo(Dst);
+  return true;
+}
+
+bool FunctionImporter::isImportable(const Function& F) const {
+  if (F.isDeclaration() || !F.hasName() || F.hasLocalLinkage()
+      || F.isInterposable() || F.hasAvailableExternallyLinkage()
+      || F.isVarArg() || F.hasFnAttribute(Attribute::NoInline)
+      || F.hasFnAttribute(Attribute::Naked)
+      || F.hasPrefixData() || F.hasPrologueData()
+      || m_Locals.count(F.getName())
+      // Wrappers are run once.
+      || F.getName().startswith(utils::Synthesize::UniquePrefix))
+    return false;
+
+  size_t NumInstructions = 0;
+  for (const BasicBlock& BB: F) {
+    NumInstructions += BB.size();
+    if (NumInstructions > kMaxInstructions)
+      return false;
+  }
+
+  SmallPtrSet<GlobalValue*, 16> Globals;
+  if (!collectGlobals(F, Globals))
+    return false;
+  for (const GlobalValue* GV: Globals)
+    if (!GV->hasName() || m_Locals.count(GV->getName()))
+      return false;
+  return true;
+}
+
+void FunctionImporter::beginModule(Module& M) {
+  m_Locals.clear();
+  for (const GlobalValue& GV: M.global_values())
+    if (GV.hasLocalLinkage() && GV.hasName())
+      m_Locals.insert(GV.getName());
+
+  if (!m_Library)
+    return;
+
+  SmallVector<Function*, 32> Worklist;
+  for (Function& F: M)
+    if (F.isDeclaration() && !F.use_empty() && !F.isIntrinsic())
+      Worklist.push_back(&F);
+
+  unsigned Budget = kMaxImportsPerModule;
+  while (!Worklist.empty() && Budget) {
+    Function* Decl = Worklist.pop_back_val();
+    if (!Decl->isDeclaration())
+      continue;
+    const Function* Src = m_Library->getFunction(Decl->getName());
+    if (!Src || Src->isDeclaration())
+      continue;
+    // Functions the imported body calls might be importable, too.
+    if (!cloneBody(*Src, *Decl, &Worklist))
+      continue;
+    Decl->setLinkage(GlobalValue::AvailableExternallyLinkage);
+    Decl->setComdat(nullptr);
+    m_Imported.push_back(Decl->getName());
+    --Budget;
+  }
+}
+
+void FunctionImporter::endModule(Module& M) {
+  // The optimizer removes the unused available_externally bodies.
+  for (const std::string& Name: m_Imported) {
+    ImportStats& Stats = m_Stats[Name];
+    ++Stats.Imported;
+    const Function* F = M.getFunction(Name);
+    if (!F || F->use_empty())
+      ++Stats.Inlined;
+  }
+  m_Imported.clear();
+
+  std::vector<Function*> Recorded;
+  for (const Function& F: M) {
+    if (!isImportable(F))
+      continue;
+    if (!m_Library)
+      m_Library.reset(new Module("cling-function-imports", M.getContext()));
+
+    Function* Copy = nullptr;
+    if (GlobalValue* Existing = m_Library->getNamedValue(F.getName())) {
+      Copy = dyn_cast<Function>(Existing);
+      if (!Copy || !Copy->isDeclaration())
+        continue; // e.g. a linkonce_odr function emitted again.
+    } else
+      Copy = Function::Create(F.getFunctionType(),
+                              GlobalValue::ExternalLinkage, F.getName(),
+                              m_Library.get());
+    if (!cloneBody(F, *Copy))
+      continue;
+    Copy->setLinkage(GlobalValue::ExternalLinkage);
+    Copy->setComdat(nullptr);
+    Recorded.push_back(Copy);
+  }
+  if (!Recorded.empty())
+    m_BySource[&M] = std::move(Recorded);
+  m_Locals.clear();
+}
+
+void FunctionImporter::forget(const Module* M) {
+  auto I = m_BySource.find(M);
+  if (I == m_BySource.end())
+    return;
+  for (Function* F: I->second)
+    F->deleteBody();
+  // Other copies might still call them; drop those that are unused.
+  for (Function* F: I->second)
+    if (F->use_empty())
+      F->eraseFromParent();
+  m_BySource.erase(I);
+}
+
+void FunctionImporter::printStats(raw_ostream& Out, StringRef Filter) const {
+  unsigned Imported = 0, Inlined = 0;
+  for (const auto& NameStats: m_Stats) {
+    Imported += NameStats.second.Imported;
+    Inlined += NameStats.second.Inlined;
+  }
+  Out << "Cross-transaction inlining: " << Inlined << " of " << Imported
+      << " imported functions inlined\n";
+  if (Filter.empty())
+    return;
+  for (const auto& NameStats: m_Stats)
+    if (NameStats.first().find(Filter) != StringRef::npos)
+      Out << "  " << NameStats.first() << ": inlined "
+          << NameStats.second.Inlined << " of "
+          << NameStats.second.Imported << " times\n";
+}
+
+} // end namespace cling
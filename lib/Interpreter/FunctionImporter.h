@@ -0,0 +1,101 @@
+//--------------------------------------------------------------------*- C++ -*-
+// CLING - the C++ LLVM-based InterpreterG :)
+//
+// This file is dual-licensed: you can choose to license it under the University
+// of Illinois Open Source License or the GNU Lesser General Public License. See
+// LICENSE.TXT for details.
+//------------------------------------------------------------------------------
+
+#ifndef CLING_FUNCTION_IMPORTER_H
+#define CLING_FUNCTION_IMPORTER_H
+
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/ADT/StringSet.h"
+
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace llvm {
+  class Function;
+  class Module;
+  class raw_ostream;
+}
+
+namespace cling {
+
+  ///\brief Makes small functions of earlier transactions inlinable into
+  /// later ones.
+  ///
+  /// Every transaction is optimized as a module of its own, where functions
+  /// of earlier transactions are mere declarations. After a module was
+  /// optimized, copies of its small functions are kept in a library module
+  /// (in the same LLVMContext). Before a later module is optimized, the
+  /// bodies of the functions it calls are imported from that library as
+  /// available_externally definitions, which the inliner can use and the
+  /// optimizer then drops; what is not inlined is still called in the
+  /// earlier transaction's code.
+  ///
+  class FunctionImporter {
+    ///\brief Copies of the functions that can be imported.
+    std::unique_ptr<llvm::Module> m_Library;
+
+    ///\brief Library functions by the module they were copied from.
+    std::map<const llvm::Module*, std::vector<llvm::Function*>> m_BySource;
+
+    ///\brief Names of the globals that had local linkage before the module
+    /// currently processed was optimized; other modules cannot refer to
+    /// them, even if BackendPasses made them external.
+    llvm::StringSet<> m_Locals;
+
+    ///\brief The functions imported into the module currently processed.
+    std::vector<std::string> m_Imported;
+
+    ///\brief How often each function was imported, and how often no call
+    /// to it was left after optimizing the importing module.
+    struct ImportStats {
+      unsigned Imported = 0;
+      unsigned Inlined = 0;
+    };
+    llvm::StringMap<ImportStats> m_Stats;
+
+    bool isImportable(const llvm::Function& F) const;
+
+    ///\brief Give Dst (a declaration in its module) the body of Src.
+    ///\param [out] NewDecls - functions Dst now refers to that had to be
+    /// declared.
+    ///\returns false if that's not possible, e.g. due to name clashes.
+    static bool cloneBody(const llvm::Function& Src, llvm::Function& Dst,
+                   llvm::SmallVectorImpl<llvm::Function*>* NewDecls = nullptr);
+
+  public:
+    ///\brief Maximum number of instructions of an importable function.
+    enum {
+      kMaxInstructions = 100,
+      kMaxImportsPerModule = 256
+    };
+
+    FunctionImporter();
+    ~FunctionImporter();
+
+    ///\brief Call before optimizing M: import the bodies of the functions
+    /// it calls.
+    void beginModule(llvm::Module& M);
+
+    ///\brief Call after optimizing M: remember its small functions.
+    void endModule(llvm::Module& M);
+
+    ///\brief Forget the functions of M, which is being unloaded.
+    void forget(const llvm::Module* M);
+
+    ///\brief Print how many imported functions were inlined and, for the
+    /// functions whose name contains Filter, how often.
+    void printStats(llvm::raw_ostream& Out, llvm::StringRef Filter) const;
+  };
+
+} // end namespace cling
+
+#endif // CLING_FUNCTION_IMPORTER_H
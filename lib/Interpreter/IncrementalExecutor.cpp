@@ -11,6 +11,7 @@
 #include "IncrementalJIT.h"
 #include "Threading.h"
 
+#include "cling/Interpreter/InvocationOptions.h"
 #include "cling/Interpreter/Value.h"
 #include "cling/Interpreter/Transaction.h"
 #include "cling/Utils/AST.h"
@@ -23,11 +24,14 @@
 #include "clang/Frontend/CompilerInstance.h"
 
 #include "llvm/IR/Constants.h"
+#include "llvm/IR/DebugInfo.h"
 #include "llvm/IR/Instructions.h"
 #include "llvm/IR/LLVMContext.h"
 #include "llvm/IR/Module.h"
 #include "llvm/IR/LegacyPassManager.h"
+#include "llvm/ADT/SetVector.h"
 #include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/ADT/StringExtras.h"
 #include "llvm/ADT/Triple.h"
 #include "llvm/Support/Host.h"
 #include "llvm/Support/TargetRegistry.h"
@@ -69,8 +73,11 @@ CreateHostTargetMachine(const clang::CompilerInstance& CI) {
     default: OptLevel = CodeGenOpt::Default;
   }
 
-  std::string MCPU;
-  std::string FeaturesStr;
+  // Generate code for what clang compiled for; unless told otherwise by
+  // -march or -mcpu that is the host CPU (see CIFactory).
+  const std::string& MCPU = TargetOpts.CPU;
+  const std::string FeaturesStr = llvm::join(TargetOpts.Features.begin(),
+                                             TargetOpts.Features.end(), ",");
 
   return std::unique_ptr<TargetMachine>(TheTarget->createTargetMachine(Triple,
                                         MCPU, FeaturesStr,
@@ -79,11 +86,35 @@ CreateHostTargetMachine(const clang::CompilerInstance& CI) {
                                         OptLevel));
 }
 
+///\brief Destroy the constant C if nothing uses it anymore, then those of
+/// its operands that were only used by it. Uniqued constants live as long
+/// as the LLVMContext otherwise.
+static void DestroyUnusedConstant(llvm::Constant* C) {
+  llvm::SmallSetVector<llvm::Constant*, 16> Worklist;
+  Worklist.insert(C);
+  while (!Worklist.empty()) {
+    C = Worklist.pop_back_val();
+    C->removeDeadConstantUsers();
+    // Simple constants and globals cannot be destroyed.
+    if (!C->use_empty() || !(isa<llvm::ConstantAggregate>(C)
+                             || isa<llvm::ConstantExpr>(C)
+                             || isa<llvm::ConstantDataSequential>(C)))
+      continue;
+    for (llvm::Use& Op: C->operands())
+      Worklist.insert(cast<llvm::Constant>(Op.get()));
+    C->destroyConstant();
+  }
+}
+
 } // anonymous namespace
 
 IncrementalExecutor::IncrementalExecutor(clang::DiagnosticsEngine& diags,
-                                         const clang::CompilerInstance& CI):
-  m_externalIncrementalExecutor(nullptr)
+                                         const clang::CompilerInstance& CI,
+                                         const InvocationOptions& Opts):
+  m_externalIncrementalExecutor(nullptr), m_Coalesce(Opts.JITCoalesce),
+  m_NumDeferred(0),
+  // Lazy and tiered compilation compile functions from the IR on demand.
+  m_DiscardIR(Opts.JITDiscardIR && !Opts.JITLazy && !Opts.JITTiered)
 #if 0
   : m_Diags(diags)
 #endif
@@ -105,12 +136,154 @@ IncrementalExecutor::IncrementalExecutor(clang::DiagnosticsEngine& diags,
                                           CI.getTargetOpts(),
                                           CI.getLangOpts(),
                                           *TM));
+  m_Importer.reset(new FunctionImporter());
   m_JIT.reset(new IncrementalJIT(*this, std::move(TM)));
+  if (Opts.JITHugePages)
+    m_JIT->useHugePages();
+  if (Opts.JITPerf)
+    m_JIT->enablePerfListener();
+  if (!Opts.ObjectCacheDir.empty())
+    m_JIT->enableObjectCache(Opts.ObjectCacheDir, Opts.Verbose());
+  if (Opts.JITThreads > 1)
+    m_JIT->enableParallelCompilation(Opts.JITThreads);
+  if (Opts.JITTiered) {
+    const int OptLevel = CI.getCodeGenOpts().OptimizationLevel;
+    m_JIT->enableTieredCompilation(OptLevel > 2 ? OptLevel : 2);
+  } else if (Opts.JITLazy)
+    m_JIT->enableLazyCompilation();
 }
 
 // Keep in source: ~unique_ptr<ClingJIT> needs ClingJIT
 IncrementalExecutor::~IncrementalExecutor() {}
 
+void IncrementalExecutor::addModule(llvm::Module* module, int optLevel) {
+  if (m_BackendPasses) {
+    if (m_JIT->isTiered())
+      optLevel = 0;
+    // Only the inliner makes use of imported functions, and only optimized
+    // functions are worth importing.
+    const bool Import = m_Importer && optLevel > 1;
+    if (Import)
+      m_Importer->beginModule(*module);
+    m_BackendPasses->runOnModule(*module, optLevel);
+    if (Import)
+      m_Importer->endModule(*module);
+  }
+  m_ModulesToJIT.push_back(module);
+}
+
+void IncrementalExecutor::printJITStats(llvm::raw_ostream& Out,
+                                        llvm::StringRef Filter) const {
+  m_JIT->printStats(Out, Filter);
+  if (m_Importer)
+    m_Importer->printStats(Out, Filter);
+}
+
+Transaction::ExeUnloadHandle IncrementalExecutor::emitToJIT() {
+  if (!m_Coalesce) {
+    size_t handle = m_JIT->addModules(std::move(m_ModulesToJIT));
+    m_ModulesToJIT.clear();
+    //m_JIT->finalizeMemory();
+    return Transaction::ExeUnloadHandle{(void*)handle};
+  }
+
+  // Modules are unloaded through m_ModuleHandles; an empty set would never
+  // be removed.
+  if (m_ModulesToJIT.empty())
+    return Transaction::ExeUnloadHandle{(void*)(size_t)-1};
+
+  std::vector<const llvm::Module*> Emitted(m_ModulesToJIT.begin(),
+                                           m_ModulesToJIT.end());
+  size_t handle = m_JIT->addModules(std::move(m_ModulesToJIT));
+  m_ModulesToJIT.clear();
+  m_NumDeferred = 0;
+  for (const llvm::Module* M: Emitted)
+    m_ModuleHandles[M] = handle;
+  m_ModuleSets[handle] = std::move(Emitted);
+  return Transaction::ExeUnloadHandle{(void*)handle};
+}
+
+void IncrementalExecutor::discardIR(llvm::Module& M,
+                                    Transaction::ExeUnloadHandle H) {
+  const size_t handle = (size_t)H.m_Opaque;
+  if (!m_DiscardIR || handle == (size_t)-1)
+    return;
+  m_JIT->emitModules(handle);
+
+  llvm::StripDebugInfo(M);
+  for (llvm::Function& F: M) {
+    if (F.isDeclaration())
+      continue;
+    // deleteBody() leaves an external declaration.
+    const llvm::GlobalValue::LinkageTypes Linkage = F.getLinkage();
+    F.deleteBody();
+    llvm::BasicBlock* BB = llvm::BasicBlock::Create(M.getContext(), "", &F);
+    new llvm::UnreachableInst(M.getContext(), BB);
+    F.setLinkage(Linkage);
+  }
+  for (llvm::GlobalVariable& GV: M.globals()) {
+    if (GV.hasInitializer() && !GV.getName().startswith("llvm.")) {
+      llvm::Constant* Init = GV.getInitializer();
+      GV.setInitializer(llvm::Constant::getNullValue(GV.getValueType()));
+      DestroyUnusedConstant(Init);
+    }
+  }
+}
+
+bool IncrementalExecutor::deferEmission(const llvm::Module& M) {
+  // Bounds the work done when the set is eventually needed.
+  enum { kMaxDeferred = 128 };
+
+  // Keep the deferred modules in front of m_ModulesToJIT.
+  if (!m_Coalesce || m_ModulesToJIT.size() != m_NumDeferred + 1
+      || m_ModulesToJIT.back() != &M || m_NumDeferred >= kMaxDeferred)
+    return false;
+
+  // Static initializers must run now.
+  if (const llvm::GlobalVariable* Ctors = M.getNamedGlobal("llvm.global_ctors"))
+    if (Ctors->hasInitializer() && !Ctors->getInitializer()->isNullValue())
+      return false;
+
+  ++m_NumDeferred;
+  return true;
+}
+
+bool IncrementalExecutor::unloadFromJIT(llvm::Module* M,
+                                        Transaction::ExeUnloadHandle H) {
+  if (m_Importer)
+    m_Importer->forget(M);
+  auto iMod = std::find(m_ModulesToJIT.begin(), m_ModulesToJIT.end(), M);
+  if (iMod != m_ModulesToJIT.end()) {
+    if (iMod - m_ModulesToJIT.begin() < m_NumDeferred)
+      --m_NumDeferred;
+    m_ModulesToJIT.erase(iMod);
+    return true;
+  }
+
+  if (!m_Coalesce) {
+    m_JIT->removeModules((size_t)H.m_Opaque);
+    return true;
+  }
+
+  auto IHandle = m_ModuleHandles.find(M);
+  if (IHandle == m_ModuleHandles.end())
+    return true;
+  const size_t handle = IHandle->second;
+  m_ModuleHandles.erase(IHandle);
+
+  std::vector<const llvm::Module*>& Set = m_ModuleSets[handle];
+  Set.erase(std::find(Set.begin(), Set.end(), M));
+  if (Set.empty()) {
+    m_ModuleSets.erase(handle);
+    m_JIT->removeModules(handle);
+  } else {
+    // Other transactions' code and data live in the same memory; keep it
+    // until they are unloaded, too.
+    m_JIT->hideSymbols(handle, *M);
+  }
+  return true;
+}
+
 void IncrementalExecutor::shuttingDown() {
   // No need to protect this access, since hopefully there is no concurrent
   // shutdown request.
@@ -159,8 +332,12 @@ void* IncrementalExecutor::NotifyLazyFunctionCreators(const std::string& mangled
          = m_lazyFuncCreator.begin(), et = m_lazyFuncCreator.end();
        it != et; ++it) {
     void* ret = (void*)((LazyFunctionCreatorFunc_t)*it)(mangled_name);
-    if (ret)
+    if (ret) {
+      // The creator might have opened a library, e.g. to autoload it,
+      // without the DynamicLibraryManager knowing.
+      librariesChanged();
       return ret;
+    }
   }
   void *address = nullptr;
   if (m_externalIncrementalExecutor)
@@ -332,6 +509,8 @@ IncrementalExecutor::addSymbol(llvm::StringRef Name,  void* Addr,
 
 void* IncrementalExecutor::getAddressOfGlobal(llvm::StringRef symbolName,
                                               bool* fromJIT /*=0*/) {
+  emitDeferred();
+
   // Return a symbol's address, and whether it was jitted.
   void* address = m_JIT->lookupSymbol(symbolName).first;
 
@@ -348,6 +527,7 @@ void* IncrementalExecutor::getAddressOfGlobal(llvm::StringRef symbolName,
 void*
 IncrementalExecutor::getPointerToGlobalFromJIT(const llvm::GlobalValue& GV) {
   // Get the function / variable pointer referenced by GV.
+  emitDeferred();
 
   // We don't care whether something was unresolved before.
   m_unresolvedSymbols.clear();
@@ -412,6 +592,7 @@ bool IncrementalExecutor::diagnoseUnresolvedSymbols(llvm::StringRef trigger,
 template <class T>
 IncrementalExecutor::ExecutionResult
 IncrementalExecutor::executeInitOrWrapper(llvm::StringRef Function, T& Func) {
+  emitDeferred();
   Func = utils::UIntToFunctionPtr<T>(
       m_JIT->getSymbolAddress(Function, false /*dlsym*/));
 
@@ -12,11 +12,13 @@
 
 #include "IncrementalJIT.h"
 #include "BackendPasses.h"
+#include "FunctionImporter.h"
 
 #include "cling/Interpreter/Transaction.h"
 #include "cling/Interpreter/Value.h"
 #include "cling/Utils/Casting.h"
 
+#include "llvm/ADT/DenseMap.h"
 #include "llvm/ADT/SmallVector.h"
 #include "llvm/ADT/StringRef.h"
 #include "llvm/ADT/StringRef.h"
@@ -41,6 +43,7 @@ namespace llvm {
 
 namespace cling {
   class IncrementalJIT;
+  class InvocationOptions;
   class Value;
 
   class IncrementalExecutor {
@@ -55,6 +58,9 @@ namespace cling {
     // optimizer etc passes
     std::unique_ptr<BackendPasses> m_BackendPasses;
 
+    ///\brief Makes functions of earlier modules inlinable into later ones.
+    std::unique_ptr<FunctionImporter> m_Importer;
+
     ///\brier A pointer to the IncrementalExecutor of the parent Interpreter.
     ///
     IncrementalExecutor* m_externalIncrementalExecutor;
@@ -119,6 +125,23 @@ namespace cling {
     ///
     std::vector<llvm::Module*> m_ModulesToJIT;
 
+    ///\brief Whether modules of transactions with nothing to run are
+    /// collected, to be sent to the JIT together with later ones.
+    bool m_Coalesce;
+
+    ///\brief The number of modules in m_ModulesToJIT whose transaction was
+    /// already executed.
+    unsigned m_NumDeferred;
+
+    ///\brief Whether modules are compiled as soon as they are emitted, and
+    /// their definitions discarded; see discardIR().
+    bool m_DiscardIR;
+
+    ///\brief If m_Coalesce: the unload handle of each module sent to the
+    /// JIT, and the modules of each handle that were not unloaded yet.
+    llvm::DenseMap<const llvm::Module*, size_t> m_ModuleHandles;
+    std::map<size_t, std::vector<const llvm::Module*>> m_ModuleSets;
+
     ///\brief Lazy function creator, which is a final callback which the
     /// JIT fires if there is unresolved symbol.
     ///
@@ -144,7 +167,8 @@ namespace cling {
     };
 
     IncrementalExecutor(clang::DiagnosticsEngine& diags,
-                        const clang::CompilerInstance& CI);
+                        const clang::CompilerInstance& CI,
+                        const InvocationOptions& Opts);
 
     ~IncrementalExecutor();
 
@@ -156,22 +180,34 @@ namespace cling {
 
     ///\brief Send all collected modules to the JIT, making their symbols
     /// available to jitting (but not necessarily jitting them all).
-    Transaction::ExeUnloadHandle emitToJIT() {
-      size_t handle = m_JIT->addModules(std::move(m_ModulesToJIT));
-      m_ModulesToJIT.clear();
-      //m_JIT->finalizeMemory();
-      return Transaction::ExeUnloadHandle{(void*)handle};
+    Transaction::ExeUnloadHandle emitToJIT();
+
+    ///\brief With --jit-discard-ir, compile the module set H now and
+    /// replace the definitions of M, one of its modules, by placeholders.
+    /// What stays are the names, types and linkage of M's globals, by which
+    /// unloading finds them.
+    void discardIR(llvm::Module& M, Transaction::ExeUnloadHandle H);
+
+    ///\brief The bytes of code and data the JIT allocated for the module set
+    /// H.
+    size_t getJITSectionBytes(Transaction::ExeUnloadHandle H) const {
+      return m_JIT->getSectionBytes((size_t)H.m_Opaque);
     }
 
+    ///\brief The bytes of code and data the JIT allocated in total.
+    size_t getJITSectionBytes() const { return m_JIT->getSectionBytes(); }
+
+    ///\brief Print what the JIT's lazy and tiered compilers and the
+    /// function importer did, see IncrementalJIT::printStats().
+    void printJITStats(llvm::raw_ostream& Out, llvm::StringRef Filter) const;
+
+    ///\brief If modules are coalesced and M (the last collected one) has
+    /// nothing to run, keep it for the next call to emitToJIT().
+    ///\returns true if M's emission was deferred.
+    bool deferEmission(const llvm::Module& M);
+
     ///\brief Unload a set of JIT symbols.
-    bool unloadFromJIT(llvm::Module* M, Transaction::ExeUnloadHandle H) {
-      auto iMod = std::find(m_ModulesToJIT.begin(), m_ModulesToJIT.end(), M);
-      if (iMod != m_ModulesToJIT.end())
-        m_ModulesToJIT.erase(iMod);
-      else
-        m_JIT->removeModules((size_t)H.m_Opaque);
-      return true;
-    }
+    bool unloadFromJIT(llvm::Module* M, Transaction::ExeUnloadHandle H);
 
     ///\brief Run the static initializers of all modules collected to far.
     ExecutionResult runStaticInitializersOnce(const Transaction& T);
@@ -199,15 +235,26 @@ namespace cling {
     ///
     bool addSymbol(llvm::StringRef Name, void* Address, bool JIT = false);
 
+    ///\brief Tells the execution context that libraries were loaded or
+    /// unloaded, i.e. that symbol lookups in the process must be redone.
+    ///
+    void librariesChanged() { m_JIT->invalidateProcessSymbols(); }
+
+    ///\brief Reuse the objects cached in Dir; unless ReadOnly, also store
+    /// the objects compiled from now on there.
+    void enableObjectCache(const std::string& Dir, bool ReadOnly) {
+      m_JIT->enableObjectCache(Dir);
+      m_JIT->setObjectCacheReadOnly(ReadOnly);
+    }
+
+    ///\brief Stop storing compiled objects in the object cache.
+    void freezeObjectCache() { m_JIT->setObjectCacheReadOnly(true); }
+
     ///\brief Add a llvm::Module to the JIT.
     ///
     /// @param[in] module - The module to pass to the execution engine.
     /// @param[in] optLevel - The optimization level to be used.
-    void addModule(llvm::Module* module, int optLevel) {
-      if (m_BackendPasses)
-        m_BackendPasses->runOnModule(*module, optLevel);
-      m_ModulesToJIT.push_back(module);
-    }
+    void addModule(llvm::Module* module, int optLevel);
 
     ///\brief Tells the execution context that we are shutting down the system.
     ///
@@ -246,6 +293,13 @@ namespace cling {
     static void* getUnresolvedSymbol();
 
   private:
+    ///\brief Send the modules whose emission was deferred to the JIT, as
+    /// their symbols are needed.
+    void emitDeferred() {
+      if (m_NumDeferred)
+        emitToJIT();
+    }
+
     ///\brief Report and empty m_unresolvedSymbols.
     ///\return true if m_unresolvedSymbols was non-empty.
     bool diagnoseUnresolvedSymbols(llvm::StringRef trigger,
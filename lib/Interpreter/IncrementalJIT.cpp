@@ -10,6 +10,12 @@
 #include "IncrementalJIT.h"
 
 #include "IncrementalExecutor.h"
+#include "IncrementalObjectCache.h"
+#include "LazyFunctionCompiler.h"
+#include "ParallelCompiler.h"
+#include "PerfJITEventListener.h"
+#include "SlabMemoryManager.h"
+#include "TieredCompiler.h"
 #include "cling/Utils/Platform.h"
 
 #include "llvm/ExecutionEngine/Orc/LambdaResolver.h"
@@ -24,25 +30,12 @@ using namespace llvm;
 
 namespace {
 
-///\brief Memory manager providing the lop-level link to the
-/// IncrementalExecutor, handles missing or special / replaced symbols.
-class ClingMemoryManager: public SectionMemoryManager {
-public:
-  ClingMemoryManager(cling::IncrementalExecutor& Exe) {}
-
-  ///\brief Simply wraps the base class's function setting AbortOnFailure
-  /// to false and instead using the error handling mechanism to report it.
-  void* getPointerToNamedFunction(const std::string &Name,
-                                  bool /*AbortOnFailure*/ =true) override {
-    return SectionMemoryManager::getPointerToNamedFunction(Name, false);
-  }
-};
-
   class NotifyFinalizedT {
   public:
     NotifyFinalizedT(cling::IncrementalJIT &jit) : m_JIT(jit) {}
     void operator()(llvm::orc::RTDyldObjectLinkingLayerBase::ObjSetHandleT H) {
       m_JIT.RemoveUnfinalizedSection(H);
+      m_JIT.NotifyObjectsFinalized(H);
     }
 
   private:
@@ -68,6 +61,10 @@ class Azog: public RTDyldMemoryManager {
                   uintptr_t Size, uint32_t Align,
                   bool code, bool isReadOnly) {
 
+      // Nothing to reserve; don't waste a page on it.
+      if (!Size)
+        return;
+
       uintptr_t RequiredSize = Size;
       if (code)
         m_Start = exeMM->allocateCodeSection(RequiredSize, Align,
@@ -125,6 +122,27 @@ class Azog: public RTDyldMemoryManager {
   AllocInfo m_ROData;
   AllocInfo m_RWData;
 
+  ///\brief Sections that did not fit the reserved space, with their size.
+  std::vector<std::pair<uint8_t*, uintptr_t>> m_Fallback;
+
+  ///\brief The unload handle of the module set we allocate for.
+  size_t m_Handle;
+
+  ///\brief The bytes of code and data we allocated, see
+  /// IncrementalJIT::getSectionBytes().
+  size_t m_Bytes = 0;
+
+  void account(uintptr_t Size) {
+    m_Bytes += Size;
+    std::lock_guard<std::mutex> Lock(m_jit.m_SectionBytesLock);
+    m_jit.m_SectionBytes[m_Handle] += Size;
+  }
+
+#ifndef LLVM_ON_WIN32
+  ///\brief Our EH frames; the exeMM's are shared with all other Azogs.
+  std::vector<std::pair<uint8_t*, size_t>> m_EHFrames;
+#endif
+
 #ifdef LLVM_ON_WIN32
   uintptr_t getBaseAddr() const {
     if (LLVM_LIKELY(m_Code.m_Start && m_ROData.m_Start && m_RWData.m_Start)) {
@@ -143,9 +161,32 @@ class Azog: public RTDyldMemoryManager {
 #endif
 
 public:
-  Azog(cling::IncrementalJIT& Jit): m_jit(Jit) {}
+  Azog(cling::IncrementalJIT& Jit, size_t Handle):
+    m_jit(Jit), m_Handle(Handle) {}
+
+  ~Azog() {
+    {
+      std::lock_guard<std::mutex> Lock(m_jit.m_SectionBytesLock);
+      auto I = m_jit.m_SectionBytes.find(m_Handle);
+      if (I != m_jit.m_SectionBytes.end() && !(I->second -= m_Bytes))
+        m_jit.m_SectionBytes.erase(I);
+    }
+
+    // Our object set is gone, return its memory for reuse.
+    for (const AllocInfo* Info: {&m_Code, &m_ROData, &m_RWData}) {
+      if (Info->m_Start) {
+        m_jit.forgetInjectedProcessSymbols(Info->m_Start, Info->m_End);
+        getExeMM()->deallocate(Info->m_Start);
+      }
+    }
+    for (const auto& Fallback: m_Fallback) {
+      m_jit.forgetInjectedProcessSymbols(Fallback.first,
+                                         Fallback.first + Fallback.second);
+      getExeMM()->deallocate(Fallback.first);
+    }
+  }
 
-  RTDyldMemoryManager* getExeMM() const { return m_jit.m_ExeMM.get(); }
+  SlabMemoryManager* getExeMM() const { return m_jit.m_ExeMM.get(); }
 
   uint8_t *allocateCodeSection(uintptr_t Size, unsigned Alignment,
                                unsigned SectionID,
@@ -157,6 +198,8 @@ public:
     if (!Addr) {
       Addr = getExeMM()->allocateCodeSection(Size, Alignment, SectionID, SectionName);
       m_jit.m_SectionsAllocatedSinceLastLoad.insert(Addr);
+      m_Fallback.emplace_back(Addr, Size);
+      account(Size);
     }
 
     return Addr;
@@ -176,6 +219,8 @@ public:
       Addr = getExeMM()->allocateDataSection(Size, Alignment, SectionID,
                                                    SectionName, IsReadOnly);
       m_jit.m_SectionsAllocatedSinceLastLoad.insert(Addr);
+      m_Fallback.emplace_back(Addr, Size);
+      account(Size);
     }
     return Addr;
   }
@@ -183,9 +228,12 @@ public:
   void reserveAllocationSpace(uintptr_t CodeSize, uint32_t CodeAlign,
                               uintptr_t RODataSize, uint32_t RODataAlign,
                               uintptr_t RWDataSize, uint32_t RWDataAlign) override {
+    // Called as each object is loaded, before NotifyObjectLoadedT.
+    m_jit.m_LoadingHandle = m_Handle;
     m_Code.allocate(getExeMM(),CodeSize, CodeAlign, true, false);
     m_ROData.allocate(getExeMM(),RODataSize, RODataAlign, false, true);
     m_RWData.allocate(getExeMM(),RWDataSize, RWDataAlign, false, false);
+    account(CodeSize + RODataSize + RWDataSize);
 
     m_jit.m_SectionsAllocatedSinceLastLoad.insert(m_Code.m_Start);
     m_jit.m_SectionsAllocatedSinceLastLoad.insert(m_ROData.m_Start);
@@ -201,7 +249,8 @@ public:
 #ifdef LLVM_ON_WIN32
     platform::RegisterEHFrames(Addr, Size, getBaseAddr(), true);
 #else
-    return getExeMM()->registerEHFrames(Addr, LoadAddr, Size);
+    RTDyldMemoryManager::registerEHFramesInProcess(Addr, Size);
+    m_EHFrames.emplace_back(Addr, Size);
 #endif
   }
 
@@ -209,7 +258,10 @@ public:
 #ifdef LLVM_ON_WIN32
     platform::DeRegisterEHFrames(Addr, Size);
 #else
-    return getExeMM()->deregisterEHFrames();
+    for (auto& Frame: m_EHFrames)
+      RTDyldMemoryManager::deregisterEHFramesInProcess(Frame.first,
+                                                       Frame.second);
+    m_EHFrames.clear();
 #endif
   }
 
@@ -257,10 +309,12 @@ IncrementalJIT::IncrementalJIT(IncrementalExecutor& exe,
   m_Parent(exe),
   m_TM(std::move(TM)),
   m_TMDataLayout(m_TM->createDataLayout()),
-  m_ExeMM(llvm::make_unique<ClingMemoryManager>(m_Parent)),
+  m_ExeMM(llvm::make_unique<SlabMemoryManager>()),
   m_NotifyObjectLoaded(*this),
-  m_ObjectLayer(m_SymbolMap, m_NotifyObjectLoaded, NotifyFinalizedT(*this)),
-  m_CompileLayer(m_ObjectLayer, llvm::orc::SimpleCompiler(*m_TM)),
+  m_ObjectLayer(m_SymbolMap, m_SymbolOwners, m_NotifyObjectLoaded,
+                NotifyFinalizedT(*this)),
+  m_CompileLayer(m_ObjectLayer,
+                 [this](llvm::Module& M) { return compileModule(M); }),
   m_LazyEmitLayer(m_CompileLayer) {
 
   // Enable JIT symbol resolution from the binary.
@@ -292,6 +346,87 @@ IncrementalJIT::IncrementalJIT(IncrementalExecutor& exe,
 // #endif
 }
 
+// Keep in source: ~unique_ptr<IncrementalObjectCache> needs the definition.
+IncrementalJIT::~IncrementalJIT() {}
+
+void IncrementalJIT::enableObjectCache(const std::string& Dir, bool Verbose) {
+  m_ObjectCache.reset(new IncrementalObjectCache(Dir, *m_TM, Verbose));
+  m_CompileLayer.setObjectCache(m_ObjectCache.get());
+  // The compile layer does not call the compile functor for cached objects;
+  // drop the background compilation of such a module, e.g. when another
+  // session stored its object after the module was enqueued.
+  m_ObjectCache->setHitHandler([this](const llvm::Module& M) {
+      if (m_ParallelCompiler)
+        m_ParallelCompiler->forget(&M);
+    });
+}
+
+void IncrementalJIT::setObjectCacheReadOnly(bool ReadOnly) {
+  if (m_ObjectCache)
+    m_ObjectCache->setReadOnly(ReadOnly);
+}
+
+void IncrementalJIT::enableParallelCompilation(unsigned NumThreads) {
+  m_ParallelCompiler.reset(new ParallelCompiler(*m_TM, NumThreads));
+}
+
+void IncrementalJIT::enableTieredCompilation(int OptLevel) {
+  m_TieredCompiler.reset(new TieredCompiler(*this, *m_TM, OptLevel));
+}
+
+void IncrementalJIT::enableLazyCompilation() {
+  m_LazyCompiler.reset(new LazyFunctionCompiler(*this, *m_TM));
+  if (!m_LazyCompiler->isValid())
+    m_LazyCompiler.reset();
+}
+
+void IncrementalJIT::enablePerfListener() {
+  m_PerfListener = createPerfJITEventListener();
+}
+
+void IncrementalJIT::useHugePages() {
+  m_ExeMM->setUseHugePages(true);
+}
+
+void IncrementalJIT::printStats(llvm::raw_ostream& Out,
+                                llvm::StringRef Filter) {
+  std::lock_guard<std::recursive_mutex> Lock(m_ModuleLock);
+  if (m_TieredCompiler)
+    m_TieredCompiler->printStats(Out, Filter);
+  if (m_LazyCompiler)
+    m_LazyCompiler->printStats(Out, Filter);
+}
+
+uint64_t IncrementalJIT::addFunctionObject(
+    std::unique_ptr<llvm::object::OwningBinary<llvm::object::ObjectFile>> Obj,
+    size_t Handle, const std::string& Name) {
+  std::lock_guard<std::recursive_mutex> Lock(m_ModuleLock);
+  auto Resolver = llvm::orc::createLambdaResolver(
+    [this](const std::string &S) {
+      return getSymbolAddressWithoutMangling(S, true);
+    },
+    [this](const std::string &S) {
+      return getSymbolAddressWithoutMangling(S, true);
+    });
+
+  std::vector<std::unique_ptr<
+    llvm::object::OwningBinary<llvm::object::ObjectFile>>> Objects;
+  Objects.push_back(std::move(Obj));
+  ObjectLayerT::ObjSetHandleT H
+    = m_ObjectLayer.addObjectSet(std::move(Objects),
+                                 llvm::make_unique<Azog>(*this, Handle),
+                                 std::move(Resolver));
+  m_FunctionObjects[Handle].push_back(H);
+  return m_ObjectLayer.findSymbolIn(H, Mangle(Name), false).getAddress();
+}
+
+llvm::object::OwningBinary<llvm::object::ObjectFile>
+IncrementalJIT::compileModule(llvm::Module& M) {
+  if (m_ParallelCompiler)
+    return (*m_ParallelCompiler)(M);
+  return llvm::orc::SimpleCompiler(*m_TM)(M);
+}
+
 void IncrementalJIT::NotifyObjectLoadedT::operator() (
     llvm::orc::RTDyldObjectLinkingLayerBase::ObjSetHandleT Handle,
     const ObjListT& Objects, const LoadedObjInfoListT& Infos) const {
@@ -305,12 +440,31 @@ void IncrementalJIT::NotifyObjectLoadedT::operator() (
       GDBListener->NotifyObjectEmitted(*Objects[I]->getBinary(),
                                        *Infos[I]);
   }
-
+  // Relocations are applied after this; perf gets to see the final code.
+  if (m_JIT.m_PerfListener)
+    m_JIT.m_UnreportedObjSets[Handle] = LoadedObjSet{&Objects, &Infos};
+
+  // Symbols of modules unloaded from this module set before it was emitted
+  // must not be registered.
+  const size_t UnloadHandle = m_JIT.m_LoadingHandle;
+  const std::vector<std::string>* Hidden = nullptr;
+  auto IHidden = m_JIT.m_HiddenSymbols.find(UnloadHandle);
+  if (IHidden != m_JIT.m_HiddenSymbols.end())
+    Hidden = &IHidden->second;
+
+  // Symbols the relocations refer to; resolve them in one go before
+  // RuntimeDyld asks for them one by one.
+  std::vector<llvm::StringRef> Undefined;
   for (const auto &Object: Objects) {
     for (const auto &Symbol: Object->getBinary()->symbols()) {
       auto Flags = Symbol.getFlags();
-      if (Flags & llvm::object::BasicSymbolRef::SF_Undefined)
+      if (Flags & llvm::object::BasicSymbolRef::SF_Undefined) {
+        auto NameOrError = Symbol.getName();
+        if (NameOrError && !NameOrError->empty()
+            && m_JIT.m_SymbolMap.find(*NameOrError) == m_JIT.m_SymbolMap.end())
+          Undefined.push_back(*NameOrError);
         continue;
+      }
       // FIXME: this should be uncommented once we serve incremental
       // modules from a TU module.
       //if (!(Flags & llvm::object::BasicSymbolRef::SF_Exported))
@@ -320,13 +474,35 @@ void IncrementalJIT::NotifyObjectLoadedT::operator() (
         continue;
       auto Name = NameOrError.get();
       if (m_JIT.m_SymbolMap.find(Name) == m_JIT.m_SymbolMap.end()) {
+        if (Hidden && std::find(Hidden->begin(), Hidden->end(), Name)
+                      != Hidden->end())
+          continue;
         llvm::JITSymbol Sym
           = m_JIT.m_CompileLayer.findSymbolIn(Handle, Name, true);
-        if (llvm::JITTargetAddress Addr = Sym.getAddress())
+        if (llvm::JITTargetAddress Addr = Sym.getAddress()) {
           m_JIT.m_SymbolMap[Name] = Addr;
+          m_JIT.m_SymbolOwners[Name] = std::make_pair(UnloadHandle, Addr);
+        }
       }
     }
   }
+
+  if (!Undefined.empty()) {
+    std::vector<llvm::JITTargetAddress> Addrs(Undefined.size());
+    m_JIT.findInProcess(Undefined, Addrs);
+  }
+}
+
+void IncrementalJIT::NotifyObjectsFinalized(
+    llvm::orc::RTDyldObjectLinkingLayerBase::ObjSetHandleT H) {
+  auto ISet = m_UnreportedObjSets.find(H);
+  if (ISet == m_UnreportedObjSets.end())
+    return;
+  const LoadedObjSet& Set = ISet->second;
+  for (size_t I = 0, N = Set.Objects->size(); I < N; ++I)
+    m_PerfListener->NotifyObjectEmitted(*(*Set.Objects)[I]->getBinary(),
+                                        *(*Set.Infos)[I]);
+  m_UnreportedObjSets.erase(ISet);
 }
 
 void IncrementalJIT::RemovableObjectLinkingLayer::removeObjectSet(
@@ -342,8 +518,10 @@ void IncrementalJIT::RemovableObjectLinkingLayer::removeObjectSet(
     if (iterSymMap == m_SymbolMap.end())
       continue;
     // Is this this symbol (address)?
-    if (iterSymMap->second == NameSym.second.getAddress())
+    if (iterSymMap->second == NameSym.second.getAddress()) {
       m_SymbolMap.erase(iterSymMap);
+      m_SymbolOwners.erase(NameSym.first());
+    }
   }
   llvm::orc::RTDyldObjectLinkingLayer<NotifyObjectLoadedT>::removeObjectSet(H);
 }
@@ -358,14 +536,69 @@ IncrementalJIT::getInjectedSymbols(const std::string& Name) const {
   return JITSymbol(nullptr);
 }
 
+llvm::JITTargetAddress
+IncrementalJIT::searchInProcess(const std::string& Name) {
+  auto IInjected = m_InjectedProcessSymbols.find(Name);
+  if (IInjected != m_InjectedProcessSymbols.end())
+    return IInjected->second;
+  if (llvm::JITSymbol SymInfo = m_ExeMM->findSymbol(Name))
+    return SymInfo.getAddress();
+#ifdef LLVM_ON_WIN32
+  // FIXME: DLSym symbol lookup can overlap m_ExeMM->findSymbol wasting time
+  // looking for a symbol in libs where it is already known not to exist.
+  // Perhaps a better solution would be to have IncrementalJIT own the
+  // DynamicLibraryManger instance (or at least have a reference) that will
+  // look only through user loaded libraries.
+  // An upside to doing it this way is RTLD_GLOBAL won't need to be used
+  // allowing libs with competing symbols to co-exists.
+  return llvm::JITTargetAddress(platform::DLSym(Name));
+#else
+  return 0;
+#endif
+}
+
+llvm::JITTargetAddress IncrementalJIT::findInProcess(llvm::StringRef Name) {
+  ProcessSymbolCache::KeyT Key(Name);
+  llvm::JITTargetAddress Addr = 0;
+  if (!m_ProcessSymbols.lookup(Key, Addr)) {
+    Addr = searchInProcess(Name);
+    m_ProcessSymbols.insert(Key, Addr);
+  }
+  return Addr;
+}
+
+void IncrementalJIT::findInProcess(
+    llvm::ArrayRef<llvm::StringRef> Names,
+    llvm::MutableArrayRef<llvm::JITTargetAddress> Addrs) {
+  llvm::SmallVector<ProcessSymbolCache::KeyT, 64> Keys;
+  Keys.reserve(Names.size());
+  for (llvm::StringRef Name: Names)
+    Keys.emplace_back(Name);
+
+  llvm::SmallVector<unsigned, 64> Misses;
+  m_ProcessSymbols.lookup(Keys, Addrs, Misses);
+  if (Misses.empty())
+    return;
+
+  llvm::SmallVector<ProcessSymbolCache::KeyT, 64> MissKeys;
+  llvm::SmallVector<llvm::JITTargetAddress, 64> MissAddrs;
+  for (unsigned I: Misses) {
+    Addrs[I] = searchInProcess(Names[I]);
+    MissKeys.push_back(Keys[I]);
+    MissAddrs.push_back(Addrs[I]);
+  }
+  m_ProcessSymbols.insert(MissKeys, MissAddrs);
+}
+
 std::pair<void*, bool>
 IncrementalJIT::lookupSymbol(llvm::StringRef Name, void *InAddr, bool Jit) {
-  // FIXME: See comments on DLSym below.
-#if !defined(LLVM_ON_WIN32)
-  void* Addr = llvm::sys::DynamicLibrary::SearchForAddressOfSymbol(Name);
-#else
-  void* Addr = const_cast<void*>(platform::DLSym(Name));
+  std::lock_guard<std::recursive_mutex> Lock(m_ModuleLock);
+  // The process symbols are cached under the names the linker sees.
+  std::string ProcKey(Name);
+#ifdef MANGLE_PREFIX
+  ProcKey.insert(0, MANGLE_PREFIX);
 #endif
+  void* Addr = (void*)findInProcess(ProcKey);
 
   if (InAddr && (!Addr || Jit)) {
     if (Jit) {
@@ -377,7 +610,9 @@ IncrementalJIT::lookupSymbol(llvm::StringRef Name, void *InAddr, bool Jit) {
 #endif
       m_SymbolMap[Key] = llvm::JITTargetAddress(InAddr);
     }
-    llvm::sys::DynamicLibrary::AddSymbol(Name, InAddr);
+    m_InjectedProcessSymbols[ProcKey] = llvm::JITTargetAddress(InAddr);
+    m_ProcessSymbols.insert(ProcessSymbolCache::KeyT(ProcKey),
+                            llvm::JITTargetAddress(InAddr));
     return std::make_pair(InAddr, true);
   }
   return std::make_pair(Addr, false);
@@ -386,33 +621,41 @@ IncrementalJIT::lookupSymbol(llvm::StringRef Name, void *InAddr, bool Jit) {
 llvm::JITSymbol
 IncrementalJIT::getSymbolAddressWithoutMangling(const std::string& Name,
                                                 bool AlsoInProcess) {
+  std::lock_guard<std::recursive_mutex> Lock(m_ModuleLock);
   if (auto Sym = getInjectedSymbols(Name))
     return Sym;
 
   if (AlsoInProcess) {
-    if (llvm::JITSymbol SymInfo = m_ExeMM->findSymbol(Name))
-      return llvm::JITSymbol(SymInfo.getAddress(),
-                             llvm::JITSymbolFlags::Exported);
-#ifdef LLVM_ON_WIN32
-    // FIXME: DLSym symbol lookup can overlap m_ExeMM->findSymbol wasting time
-    // looking for a symbol in libs where it is already known not to exist.
-    // Perhaps a better solution would be to have IncrementalJIT own the
-    // DynamicLibraryManger instance (or at least have a reference) that will
-    // look only through user loaded libraries.
-    // An upside to doing it this way is RTLD_GLOBAL won't need to be used
-    // allowing libs with competing symbols to co-exists.
-    if (const void* Sym = platform::DLSym(Name))
-      return llvm::JITSymbol(llvm::JITTargetAddress(Sym),
-                             llvm::JITSymbolFlags::Exported);
-#endif
+    if (llvm::JITTargetAddress Addr = findInProcess(Name))
+      return llvm::JITSymbol(Addr, llvm::JITSymbolFlags::Exported);
   }
 
+  if (m_HiddenNames.count(Name))
+    return findUnhiddenSymbol(Name);
+
   if (auto Sym = m_LazyEmitLayer.findSymbol(Name, false))
     return Sym;
 
   return llvm::JITSymbol(nullptr);
 }
 
+llvm::JITSymbol IncrementalJIT::findUnhiddenSymbol(const std::string& Name) {
+  // Same order as LazyEmittingLayer::findSymbol().
+  for (size_t H = 0, N = m_UnloadPoints.size(); H < N; ++H) {
+    if (m_RemovedSets[H])
+      continue;
+    auto IHidden = m_HiddenSymbols.find(H);
+    if (IHidden != m_HiddenSymbols.end()
+        && std::find(IHidden->second.begin(), IHidden->second.end(), Name)
+           != IHidden->second.end())
+      continue;
+    if (auto Sym = m_LazyEmitLayer.findSymbolIn(m_UnloadPoints[H], Name,
+                                                false))
+      return Sym;
+  }
+  return llvm::JITSymbol(nullptr);
+}
+
 std::string IncrementalJIT::Mangle(llvm::StringRef Name) {
   stdstrstream MangledName;
   llvm::Mangler::getNameWithPrefix(MangledName, Name, m_TMDataLayout);
@@ -425,6 +668,7 @@ IncrementalJIT::getSymbolAddress(const std::string& Name, bool InProcess) {
 }
 
 size_t IncrementalJIT::addModules(std::vector<llvm::Module*>&& modules) {
+  std::lock_guard<std::recursive_mutex> Lock(m_ModuleLock);
 
 #ifndef NDEBUG
   // Make sure layouts are same/compatible.
@@ -443,10 +687,11 @@ size_t IncrementalJIT::addModules(std::vector<llvm::Module*>&& modules) {
       const size_t PrfxLen = strlen(MANGLE_PREFIX);
       const bool HasPrefix = !S.compare(0, PrfxLen, MANGLE_PREFIX);
       if (!m_TMDataLayout.hasLinkerPrivateGlobalPrefix() && HasPrefix) {
-        return m_ExeMM->findSymbol(std::string(MANGLE_PREFIX, PrfxLen) + S);
+        return JITSymbol(findInProcess(std::string(MANGLE_PREFIX, PrfxLen) + S),
+                         llvm::JITSymbolFlags::Exported);
       }
 #endif
-      return m_ExeMM->findSymbol(S);
+      return JITSymbol(findInProcess(S), llvm::JITSymbolFlags::Exported);
     },
     [&](const std::string &Name) {
       if (auto Sym = getSymbolAddressWithoutMangling(Name, true))
@@ -471,14 +716,98 @@ size_t IncrementalJIT::addModules(std::vector<llvm::Module*>&& modules) {
       return JITSymbol(addr, llvm::JITSymbolFlags::Weak);
     });
 
+  if (m_TieredCompiler) {
+    for (llvm::Module* M: modules)
+      m_TieredCompiler->instrument(*M, m_UnloadPoints.size());
+  } else if (m_LazyCompiler) {
+    for (llvm::Module* M: modules)
+      m_LazyCompiler->instrument(*M, m_UnloadPoints.size());
+  }
+
+  if (m_ParallelCompiler) {
+    ParallelSet PSet;
+    std::vector<llvm::Module*> ToJIT;
+    for (llvm::Module* M: modules) {
+      auto Parts = m_ParallelCompiler->partition(*M);
+      if (Parts.empty()) {
+        ToJIT.push_back(M);
+        continue;
+      }
+      for (auto& Part: Parts) {
+        ToJIT.push_back(Part.get());
+        PSet.Partitions.push_back(std::move(Part));
+      }
+    }
+    // A single module gains nothing from a round-trip through the pool.
+    if (ToJIT.size() > 1) {
+      for (llvm::Module* M: ToJIT) {
+        // Cached objects are not compiled at all.
+        if (m_ObjectCache && m_ObjectCache->hasObject(*M))
+          continue;
+        m_ParallelCompiler->enqueue(*M);
+        PSet.Enqueued.push_back(M);
+      }
+      m_ParallelSets[m_UnloadPoints.size()] = std::move(PSet);
+    }
+    // The module set's order is the link order, independent of which
+    // worker finishes first.
+    modules.swap(ToJIT);
+  }
+
   ModuleSetHandleT MSHandle
     = m_LazyEmitLayer.addModuleSet(std::move(modules),
-                                   llvm::make_unique<Azog>(*this),
+                                   llvm::make_unique<Azog>(*this,
+                                                     m_UnloadPoints.size()),
                                    std::move(Resolver));
   m_UnloadPoints.push_back(MSHandle);
+  m_RemovedSets.push_back(false);
   return m_UnloadPoints.size() - 1;
 }
 
+void IncrementalJIT::hideSymbols(size_t handle, const llvm::Module& M) {
+  std::lock_guard<std::recursive_mutex> Lock(m_ModuleLock);
+  std::vector<std::string>& Hidden = m_HiddenSymbols[handle];
+  for (const llvm::GlobalValue& GV: M.global_values()) {
+    if (GV.isDeclaration() || GV.hasLocalLinkage() || !GV.hasName())
+      continue;
+    Hidden.push_back(Mangle(GV.getName()));
+    ++m_HiddenNames[Hidden.back()];
+
+    // The name resolves to this module set's code through m_SymbolMap, which
+    // is consulted before m_HiddenNames; let redefinitions take it over.
+    auto IOwner = m_SymbolOwners.find(Hidden.back());
+    if (IOwner == m_SymbolOwners.end() || IOwner->second.first != handle)
+      continue;
+    auto ISym = m_SymbolMap.find(IOwner->first());
+    if (ISym != m_SymbolMap.end() && ISym->second == IOwner->second.second)
+      m_SymbolMap.erase(ISym);
+    m_SymbolOwners.erase(IOwner);
+  }
+}
+
+void IncrementalJIT::forgetInjectedProcessSymbols(const uint8_t* Begin,
+                                                  const uint8_t* End) {
+  std::lock_guard<std::recursive_mutex> Lock(m_ModuleLock);
+  for (auto I = m_InjectedProcessSymbols.begin(),
+         E = m_InjectedProcessSymbols.end(); I != E;) {
+    auto Cur = I++;
+    const uint8_t* Addr = (const uint8_t*)Cur->second;
+    if (Addr < Begin || Addr >= End)
+      continue;
+    // lookupSymbol() might have made it known to the linked code, too.
+    std::string Key = Cur->first();
+#ifdef MANGLE_PREFIX
+    if (m_TMDataLayout.hasLinkerPrivateGlobalPrefix())
+      Key.insert(0, MANGLE_PREFIX);
+#endif
+    auto ISym = m_SymbolMap.find(Key);
+    if (ISym != m_SymbolMap.end() && ISym->second == Cur->second)
+      m_SymbolMap.erase(ISym);
+    m_ProcessSymbols.erase(ProcessSymbolCache::KeyT(Cur->first()));
+    m_InjectedProcessSymbols.erase(Cur);
+  }
+}
+
 // void* IncrementalJIT::finalizeMemory() {
 //   for (auto &P : UnfinalizedSections)
 //     if (P.second.count(LocalAddress))
@@ -486,11 +815,52 @@ size_t IncrementalJIT::addModules(std::vector<llvm::Module*>&& modules) {
 // }
 
 
+void IncrementalJIT::emitModules(size_t handle) {
+  std::lock_guard<std::recursive_mutex> Lock(m_ModuleLock);
+  if (handle == (size_t)-1 || m_RemovedSets[handle])
+    return;
+  m_LazyEmitLayer.emitAndFinalize(m_UnloadPoints[handle]);
+}
+
 void IncrementalJIT::removeModules(size_t handle) {
+  std::lock_guard<std::recursive_mutex> Lock(m_ModuleLock);
   if (handle == (size_t)-1)
     return;
+  if (m_TieredCompiler)
+    m_TieredCompiler->forget(handle);
+  if (m_LazyCompiler)
+    m_LazyCompiler->forget(handle);
+  auto IFuncObjs = m_FunctionObjects.find(handle);
+  if (IFuncObjs != m_FunctionObjects.end()) {
+    for (auto H: IFuncObjs->second)
+      m_ObjectLayer.removeObjectSet(H);
+    m_FunctionObjects.erase(IFuncObjs);
+  }
+
   auto objSetHandle = m_UnloadPoints[handle];
   m_LazyEmitLayer.removeModuleSet(objSetHandle);
+  m_RemovedSets[handle] = true;
+
+  auto IHidden = m_HiddenSymbols.find(handle);
+  if (IHidden != m_HiddenSymbols.end()) {
+    for (const std::string& Name: IHidden->second) {
+      auto IName = m_HiddenNames.find(Name);
+      if (--IName->second == 0)
+        m_HiddenNames.erase(IName);
+    }
+    m_HiddenSymbols.erase(IHidden);
+  }
+
+  auto IPSet = m_ParallelSets.find(handle);
+  if (IPSet != m_ParallelSets.end()) {
+    for (llvm::Module* M: IPSet->second.Enqueued)
+      m_ParallelCompiler->forget(M);
+    // Partitions that were never emitted leave their cache key behind.
+    if (m_ObjectCache)
+      for (auto& Part: IPSet->second.Partitions)
+        m_ObjectCache->forget(Part.get());
+    m_ParallelSets.erase(IPSet);
+  }
 }
 
 }// end namespace cling
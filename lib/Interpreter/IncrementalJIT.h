@@ -10,14 +10,18 @@
 #ifndef CLING_INCREMENTAL_JIT_H
 #define CLING_INCREMENTAL_JIT_H
 
+#include "ProcessSymbolCache.h"
+
 #include "cling/Utils/Output.h"
 
 #include <map>
 #include <memory>
+#include <mutex>
 #include <set>
 #include <string>
 #include <vector>
 
+#include "llvm/ADT/StringMap.h"
 #include "llvm/IR/Mangler.h"
 #include "llvm/IR/GlobalValue.h"
 #include "llvm/ExecutionEngine/JITEventListener.h"
@@ -37,6 +41,11 @@ class RTDyldMemoryManager;
 namespace cling {
 class Azog;
 class IncrementalExecutor;
+class IncrementalObjectCache;
+class LazyFunctionCompiler;
+class ParallelCompiler;
+class SlabMemoryManager;
+class TieredCompiler;
 
 class IncrementalJIT {
 public:
@@ -48,9 +57,39 @@ private:
   ///\brief The IncrementalExecutor who owns us.
   IncrementalExecutor& m_Parent;
   llvm::JITEventListener* m_GDBListener; // owned by llvm::ManagedStaticBase
+  ///\brief Tells perf about emitted code, if enabled.
+  std::unique_ptr<llvm::JITEventListener> m_PerfListener;
 
   SymbolMapT m_SymbolMap;
 
+  ///\brief The unload handle and address each symbol of m_SymbolMap was
+  /// registered with by m_NotifyObjectLoaded.
+  using SymbolOwnersT
+    = llvm::StringMap<std::pair<size_t, llvm::JITTargetAddress>>;
+  SymbolOwnersT m_SymbolOwners;
+
+  ///\brief The unload handle of the module set whose objects are being
+  /// loaded, as told by its Azog.
+  size_t m_LoadingHandle = (size_t)-1;
+
+  ///\brief Serializes adding, removing and looking up code: functions
+  /// compiled on demand are linked from the threads calling them. Lookups
+  /// during linking re-enter.
+  std::recursive_mutex m_ModuleLock;
+
+  ///\brief Outcome of symbol lookups in the process, including misses.
+  ProcessSymbolCache m_ProcessSymbols;
+
+  ///\brief Symbols lookupSymbol() made known to the process, by the names
+  /// the linker sees. Kept here rather than in llvm::sys::DynamicLibrary,
+  /// which cannot forget them: their addresses might point into code that
+  /// gets removed.
+  llvm::StringMap<llvm::JITTargetAddress> m_InjectedProcessSymbols;
+
+  ///\brief Forget the m_InjectedProcessSymbols pointing into [Begin, End),
+  /// memory that is being freed.
+  void forgetInjectedProcessSymbols(const uint8_t* Begin, const uint8_t* End);
+
   class NotifyObjectLoadedT {
   public:
     typedef std::vector<std::unique_ptr<llvm::object::OwningBinary<llvm::object::ObjectFile>>> ObjListT;
@@ -72,10 +111,11 @@ private:
     using Base_t = llvm::orc::RTDyldObjectLinkingLayer<NotifyObjectLoadedT>;
     using NotifyLoadedFtor = NotifyObjectLoadedT;
     using NotifyFinalizedFtor = Base_t::NotifyFinalizedFtor;
-    RemovableObjectLinkingLayer(SymbolMapT &SymMap,
+    RemovableObjectLinkingLayer(SymbolMapT &SymMap, SymbolOwnersT &Owners,
                                 NotifyObjectLoadedT NotifyLoaded,
                    NotifyFinalizedFtor NotifyFinalized = NotifyFinalizedFtor()):
-      Base_t(NotifyLoaded, NotifyFinalized), m_SymbolMap(SymMap)
+      Base_t(NotifyLoaded, NotifyFinalized), m_SymbolMap(SymMap),
+      m_SymbolOwners(Owners)
     {}
 
     void
@@ -83,6 +123,7 @@ private:
 
   private:
     SymbolMapT& m_SymbolMap;
+    SymbolOwnersT& m_SymbolOwners;
   };
 
   typedef RemovableObjectLinkingLayer ObjectLayerT;
@@ -93,9 +134,18 @@ private:
   std::unique_ptr<llvm::TargetMachine> m_TM;
   llvm::DataLayout m_TMDataLayout;
 
-  ///\brief The RTDyldMemoryManager used to communicate with the
-  /// IncrementalExecutor to handle missing or special symbols.
-  std::unique_ptr<llvm::RTDyldMemoryManager> m_ExeMM;
+  ///\brief The memory manager all Azogs allocate from; they give their
+  /// memory back when their object set is removed.
+  std::unique_ptr<SlabMemoryManager> m_ExeMM;
+
+  ///\brief Bytes of code and data sections allocated by the Azogs of each
+  /// unload handle that are still alive; declared before the layers owning
+  /// the Azogs, which outlive it otherwise.
+  std::map<size_t, size_t> m_SectionBytes;
+
+  ///\brief Guards m_SectionBytes: objects are allocated for also on the
+  /// threads compiling lazily or tiering up.
+  mutable std::mutex m_SectionBytesLock;
 
   NotifyObjectLoadedT m_NotifyObjectLoaded;
 
@@ -117,18 +167,89 @@ private:
   std::map<ObjectLayerT::ObjSetHandleT, SectionAddrSet, ObjSetHandleCompare>
     m_UnfinalizedSections;
 
+  ///\brief Object sets loaded but not relocated yet, to be described to
+  /// m_PerfListener once they are. The lists are owned by the object layer
+  /// until the object set is finalized.
+  struct LoadedObjSet {
+    const NotifyObjectLoadedT::ObjListT* Objects;
+    const NotifyObjectLoadedT::LoadedObjInfoListT* Infos;
+  };
+  std::map<ObjectLayerT::ObjSetHandleT, LoadedObjSet, ObjSetHandleCompare>
+    m_UnreportedObjSets;
+
   ///\brief Vector of ModuleSetHandleT. UnloadHandles index into that
   /// vector.
   std::vector<ModuleSetHandleT> m_UnloadPoints;
 
+  ///\brief Whether the module set of each unload handle was removed.
+  std::vector<bool> m_RemovedSets;
+
+  ///\brief Symbols (as seen by the linker) of unloaded modules whose module
+  /// set is still in use by other modules, by unload handle.
+  std::map<size_t, std::vector<std::string>> m_HiddenSymbols;
+
+  ///\brief The number of module sets hiding each symbol.
+  llvm::StringMap<unsigned> m_HiddenNames;
+
+  ///\brief Persistent cache of compiled objects, if enabled.
+  std::unique_ptr<IncrementalObjectCache> m_ObjectCache;
+
+  ///\brief Background code generation, if enabled.
+  std::unique_ptr<ParallelCompiler> m_ParallelCompiler;
+
+  ///\brief Module sets (by unload handle) compiled by m_ParallelCompiler.
+  struct ParallelSet {
+    ///\brief Modules whose objects were requested from m_ParallelCompiler.
+    std::vector<llvm::Module*> Enqueued;
+    ///\brief Partitions split off the transactions' modules; owned here.
+    std::vector<std::unique_ptr<llvm::Module>> Partitions;
+  };
+  std::map<size_t, ParallelSet> m_ParallelSets;
+
+  ///\brief Tiered compilation, if enabled.
+  std::unique_ptr<TieredCompiler> m_TieredCompiler;
+
+  ///\brief Lazy per-function compilation, if enabled.
+  std::unique_ptr<LazyFunctionCompiler> m_LazyCompiler;
+
+  ///\brief Objects holding single functions compiled by m_TieredCompiler or
+  /// m_LazyCompiler, by the unload handle of the module set they came from.
+  std::map<size_t, std::vector<ObjectLayerT::ObjSetHandleT>> m_FunctionObjects;
+
+  ///\brief The compile functor of m_CompileLayer.
+  llvm::object::OwningBinary<llvm::object::ObjectFile>
+  compileModule(llvm::Module& M);
 
   std::string Mangle(llvm::StringRef Name);
 
   llvm::JITSymbol getInjectedSymbols(const std::string& Name) const;
 
+  ///\brief Look Name up in the process, bypassing m_ProcessSymbols.
+  llvm::JITTargetAddress searchInProcess(const std::string& Name);
+
+  ///\brief Look Name up in the process, through m_ProcessSymbols.
+  llvm::JITTargetAddress findInProcess(llvm::StringRef Name);
+
+  ///\brief Look Name up in the module sets, skipping those hiding it.
+  llvm::JITSymbol findUnhiddenSymbol(const std::string& Name);
+
 public:
   IncrementalJIT(IncrementalExecutor& exe,
                  std::unique_ptr<llvm::TargetMachine> TM);
+  ~IncrementalJIT();
+
+  ///\brief Reuse objects compiled in earlier sessions, stored in (and
+  /// written to) the directory Dir. If Verbose, the number of objects
+  /// found and missed is reported when the JIT goes away.
+  void enableObjectCache(const std::string& Dir, bool Verbose = false);
+
+  ///\brief Whether compiled objects are only read from the object cache,
+  /// as opposed to also being stored there.
+  void setObjectCacheReadOnly(bool ReadOnly);
+
+  ///\brief Compile the modules of each transaction on NumThreads worker
+  /// threads, splitting large modules into partitions.
+  void enableParallelCompilation(unsigned NumThreads);
 
   ///\brief Get the address of a symbol from the JIT or the memory manager,
   /// mangling the name as needed. Use this to resolve symbols as coming
@@ -144,9 +265,87 @@ public:
   llvm::JITSymbol getSymbolAddressWithoutMangling(const std::string& Name,
                                                        bool AlsoInProcess);
 
+  ///\brief Look up the addresses of several symbols in the process at once,
+  /// e.g. all undefined symbols of an object about to be linked.
+  /// \param Names - names as seen by the linker.
+  /// \param [out] Addrs - the address of each symbol; 0 if not found.
+  void findInProcess(llvm::ArrayRef<llvm::StringRef> Names,
+                     llvm::MutableArrayRef<llvm::JITTargetAddress> Addrs);
+
+  ///\brief Forget the results of earlier lookups in the process, as the
+  /// set of loaded libraries has changed.
+  void invalidateProcessSymbols() { m_ProcessSymbols.clear(); }
+
   size_t addModules(std::vector<llvm::Module*>&& modules);
   void removeModules(size_t handle);
 
+  ///\brief Compile the module set handle now, instead of upon the first
+  /// lookup of one of its symbols. Its modules are not needed anymore then.
+  void emitModules(size_t handle);
+
+  ///\brief Make the symbols defined by M, one of the modules of the module
+  /// set handle, invisible to lookups. The module set stays in the JIT; later
+  /// definitions of these symbols take over their names.
+  void hideSymbols(size_t handle, const llvm::Module& M);
+
+  ///\brief The bytes of code and data sections the JIT allocated for the
+  /// module set handle, including functions compiled later from it.
+  size_t getSectionBytes(size_t handle) const {
+    std::lock_guard<std::mutex> Lock(m_SectionBytesLock);
+    auto I = m_SectionBytes.find(handle);
+    return I == m_SectionBytes.end() ? 0 : I->second;
+  }
+
+  ///\brief The bytes of code and data sections of all module sets.
+  size_t getSectionBytes() const {
+    std::lock_guard<std::mutex> Lock(m_SectionBytesLock);
+    size_t Bytes = 0;
+    for (auto& HB: m_SectionBytes)
+      Bytes += HB.second;
+    return Bytes;
+  }
+
+  ///\brief Compile at O0 behind stubs; recompile hot functions at OptLevel.
+  void enableTieredCompilation(int OptLevel);
+  bool isTiered() const { return (bool)m_TieredCompiler; }
+
+  ///\brief Compile function bodies only when they are first called.
+  void enableLazyCompilation();
+
+  ///\brief Describe emitted functions to the Linux perf tool.
+  void enablePerfListener();
+
+  ///\brief Back the JIT's memory by transparent huge pages, where supported.
+  void useHugePages();
+
+  ///\brief Print what the lazy and tiered compilers did, listing the
+  /// functions whose name contains Filter, if not empty.
+  void printStats(llvm::raw_ostream& Out, llvm::StringRef Filter);
+
+  ///\brief Link an object holding code of a function from the module set
+  /// Handle, returning the address of its symbol Name.
+  uint64_t addFunctionObject(
+    std::unique_ptr<llvm::object::OwningBinary<llvm::object::ObjectFile>> Obj,
+    size_t Handle, const std::string& Name);
+
+  ///\brief Resolve references to the IR name Name in the code linked by
+  /// this JIT to Addr. Unlike lookupSymbol(), this does not make the symbol
+  /// known to the process.
+  void addInjectedSymbol(llvm::StringRef Name, llvm::JITTargetAddress Addr) {
+    std::lock_guard<std::recursive_mutex> Lock(m_ModuleLock);
+    m_SymbolMap[Mangle(Name)] = Addr;
+  }
+
+  ///\brief Undo addInjectedSymbol().
+  void removeInjectedSymbol(llvm::StringRef Name) {
+    std::lock_guard<std::recursive_mutex> Lock(m_ModuleLock);
+    m_SymbolMap.erase(Mangle(Name));
+  }
+
+  ///\brief The lock held while code is added, removed or looked up. Take it
+  /// before any lock that is also taken while the JIT holds it.
+  std::recursive_mutex& getModuleLock() { return m_ModuleLock; }
+
   IncrementalExecutor& getParent() const { return m_Parent; }
 
   void RemoveUnfinalizedSection(
@@ -154,6 +353,10 @@ public:
     m_UnfinalizedSections.erase(H);
   }
 
+  ///\brief Describe the object set H to perf, now that its code is final.
+  void NotifyObjectsFinalized(
+                     llvm::orc::RTDyldObjectLinkingLayerBase::ObjSetHandleT H);
+
   ///\brief Get the address of a symbol from the process' loaded libraries.
   /// \param Name - symbol to look for
   /// \param Addr - known address of the symbol that can be cached later use
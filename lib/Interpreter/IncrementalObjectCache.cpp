@@ -0,0 +1,182 @@
+//--------------------------------------------------------------------*- C++ -*-
+// CLING - the C++ LLVM-based InterpreterG :)
+//
+// This file is dual-licensed: you can choose to license it under the University
+// of Illinois Open Source License or the GNU Lesser General Public License. See
+// LICENSE.TXT for details.
+//------------------------------------------------------------------------------
+
+#include "IncrementalObjectCache.h"
+
+#include "cling/Utils/Output.h"
+
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/Bitcode/BitcodeWriter.h"
+#include "llvm/Config/llvm-config.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MD5.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Target/TargetMachine.h"
+#include "llvm/Transforms/Utils/Cloning.h"
+
+using namespace llvm;
+
+namespace cling {
+
+IncrementalObjectCache::IncrementalObjectCache(const std::string& Dir,
+                                               const TargetMachine& TM,
+                                               bool Verbose):
+  m_Dir(Dir), m_TM(TM), m_Valid(false), m_ReadOnly(false), m_Verbose(Verbose),
+  m_Hits(0), m_Misses(0) {
+  if (std::error_code EC = sys::fs::create_directories(m_Dir)) {
+    cling::errs() << "cling::IncrementalObjectCache: cannot create '" << m_Dir
+                  << "': " << EC.message() << "; object cache disabled.\n";
+    return;
+  }
+  m_Valid = true;
+}
+
+IncrementalObjectCache::~IncrementalObjectCache() {
+  if (m_Verbose && m_Valid)
+    cling::log() << "cling::IncrementalObjectCache: " << m_Hits << " hits, "
+                 << m_Misses << " misses in '" << m_Dir << "'\n";
+}
+
+std::string IncrementalObjectCache::computeKey(const Module& M) const {
+  // The module identifier and source file name encode cling's transaction
+  // counter; they do not influence the generated code but would defeat any
+  // reuse across sessions. So do the names that cling makes unique by
+  // appending the module identifier: the static initializers, the locals
+  // and the stubs' implementation pointers and trampolines. Hash a clone
+  // with these spelled independently of the transaction.
+  const std::string& ModuleID = M.getModuleIdentifier();
+  std::unique_ptr<Module> Clone = CloneModule(&M);
+  Clone->setModuleIdentifier("");
+  Clone->setSourceFileName("");
+  if (!ModuleID.empty()) {
+    for (GlobalValue& GV: Clone->global_values()) {
+      std::string Name = GV.getName();
+      bool Renamed = false;
+      for (size_t Pos = Name.find(ModuleID); Pos != std::string::npos;
+           Pos = Name.find(ModuleID, Pos + 1)) {
+        // "cling-module-1" is not part of "cling-module-12".
+        const size_t End = Pos + ModuleID.size();
+        if (End < Name.size() && isDigit(Name[End]))
+          continue;
+        Name.replace(Pos, ModuleID.size(), "<module>");
+        Renamed = true;
+      }
+      if (Renamed)
+        GV.setName(Name);
+    }
+  }
+
+  SmallString<0> Bitcode;
+  {
+    raw_svector_ostream OS(Bitcode);
+    WriteBitcodeToFile(Clone.get(), OS);
+  }
+
+  MD5 Hash;
+  Hash.update(Bitcode);
+  Hash.update(m_TM.getTargetTriple().str());
+  Hash.update(m_TM.getTargetCPU());
+  Hash.update(m_TM.getTargetFeatureString());
+  Hash.update(std::to_string((int)m_TM.getOptLevel()));
+  Hash.update(LLVM_VERSION_STRING);
+
+  MD5::MD5Result Result;
+  Hash.final(Result);
+  SmallString<32> Key;
+  MD5::stringifyResult(Result, Key);
+  return Key.str();
+}
+
+std::string
+IncrementalObjectCache::getPathForKey(const std::string& Key) const {
+  SmallString<256> Path(m_Dir);
+  sys::path::append(Path, Key + ".o");
+  return Path.str();
+}
+
+const std::string& IncrementalObjectCache::getKey(const Module& M) {
+  std::string& Key = m_Keys[&M];
+  if (Key.empty())
+    Key = computeKey(M);
+  return Key;
+}
+
+void IncrementalObjectCache::forget(const Module* M) {
+  m_Keys.erase(M);
+}
+
+bool IncrementalObjectCache::hasObject(const Module& M) {
+  return m_Valid && sys::fs::exists(getPathForKey(getKey(M)));
+}
+
+std::unique_ptr<MemoryBuffer>
+IncrementalObjectCache::getObject(const Module* M) {
+  if (!m_Valid)
+    return nullptr;
+
+  ErrorOr<std::unique_ptr<MemoryBuffer>> Buf
+    = MemoryBuffer::getFile(getPathForKey(getKey(*M)), -1 /*FileSize*/,
+                            false /*RequiresNullTerminator*/);
+  if (Buf) {
+    forget(M);
+    ++m_Hits;
+    if (m_HitHandler)
+      m_HitHandler(*M);
+    return std::move(*Buf);
+  }
+
+  ++m_Misses;
+  // The key is needed again by notifyObjectCompiled().
+  if (m_ReadOnly)
+    forget(M);
+  return nullptr;
+}
+
+void IncrementalObjectCache::notifyObjectCompiled(const Module* M,
+                                                  MemoryBufferRef Obj) {
+  if (!m_Valid)
+    return;
+
+  if (m_ReadOnly) {
+    forget(M);
+    return;
+  }
+
+  const std::string Key = getKey(*M);
+  forget(M);
+
+  // Write to a unique temporary and rename it into place, such that
+  // concurrent sessions sharing the directory never see partial objects.
+  SmallString<256> Model(getPathForKey(Key));
+  Model += ".%%%%%%.tmp";
+  SmallString<256> TmpPath;
+  int FD;
+  if (std::error_code EC = sys::fs::createUniqueFile(Model, FD, TmpPath)) {
+    cling::errs() << "cling::IncrementalObjectCache: cannot write to '"
+                  << m_Dir << "': " << EC.message() << '\n';
+    return;
+  }
+
+  raw_fd_ostream OS(FD, true /*shouldClose*/);
+  OS << Obj.getBuffer();
+  OS.close();
+  if (OS.has_error()) {
+    OS.clear_error();
+    sys::fs::remove(TmpPath);
+    return;
+  }
+
+  if (sys::fs::rename(TmpPath, getPathForKey(Key)))
+    sys::fs::remove(TmpPath);
+}
+
+} // end namespace cling
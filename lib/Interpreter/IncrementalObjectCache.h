@@ -0,0 +1,103 @@
+//--------------------------------------------------------------------*- C++ -*-
+// CLING - the C++ LLVM-based InterpreterG :)
+//
+// This file is dual-licensed: you can choose to license it under the University
+// of Illinois Open Source License or the GNU Lesser General Public License. See
+// LICENSE.TXT for details.
+//------------------------------------------------------------------------------
+
+#ifndef CLING_INCREMENTAL_OBJECT_CACHE_H
+#define CLING_INCREMENTAL_OBJECT_CACHE_H
+
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ExecutionEngine/ObjectCache.h"
+
+#include <functional>
+#include <string>
+
+namespace llvm {
+  class Module;
+  class TargetMachine;
+}
+
+namespace cling {
+
+  ///\brief Persistent, on-disk cache of the objects emitted by the JIT.
+  ///
+  /// Every module handed to the JIT is keyed by a hash of its bitcode, with
+  /// the module identifier stripped from it and from the names derived from
+  /// it, combined with the target triple, CPU, features, codegen
+  /// optimization level and LLVM version. A hit skips instruction selection
+  /// and register allocation altogether; a miss stores the freshly compiled
+  /// object under the key so that the next session can reuse it.
+  ///
+  class IncrementalObjectCache : public llvm::ObjectCache {
+    ///\brief Directory holding the cached objects.
+    std::string m_Dir;
+
+    ///\brief The target machine the objects are compiled for.
+    const llvm::TargetMachine& m_TM;
+
+    ///\brief Keys of the modules looked up by hasObject() or getObject()
+    /// and not yet retrieved or stored, such that each module is hashed
+    /// once: codegen may change the module before the object is stored.
+    llvm::DenseMap<const llvm::Module*, std::string> m_Keys;
+
+    ///\brief Whether the cache directory is usable.
+    bool m_Valid;
+
+    ///\brief Whether objects are only read, not added to the cache.
+    bool m_ReadOnly;
+
+    ///\brief Whether to report the hits and misses when done.
+    bool m_Verbose;
+
+    ///\brief Modules whose object was found in or missing from the cache.
+    unsigned m_Hits, m_Misses;
+
+    ///\brief Called for every module whose object is found in the cache.
+    std::function<void(const llvm::Module&)> m_HitHandler;
+
+    std::string computeKey(const llvm::Module& M) const;
+    const std::string& getKey(const llvm::Module& M);
+    std::string getPathForKey(const std::string& Key) const;
+
+  public:
+    IncrementalObjectCache(const std::string& Dir,
+                           const llvm::TargetMachine& TM,
+                           bool Verbose = false);
+    ~IncrementalObjectCache();
+
+    ///\brief Store the object compiled for M under M's key.
+    void notifyObjectCompiled(const llvm::Module* M,
+                              llvm::MemoryBufferRef Obj) override;
+
+    ///\brief Return the cached object for M, if any.
+    std::unique_ptr<llvm::MemoryBuffer>
+    getObject(const llvm::Module* M) override;
+
+    ///\brief Whether the cache holds an object for M; does not count as a
+    /// hit or miss.
+    bool hasObject(const llvm::Module& M);
+
+    ///\brief Drop the key remembered for M, which is about to be destroyed
+    /// without its object being retrieved.
+    void forget(const llvm::Module* M);
+
+    ///\brief Have Handler called whenever getObject() finds an object.
+    void setHitHandler(std::function<void(const llvm::Module&)> Handler) {
+      m_HitHandler = std::move(Handler);
+    }
+
+    const std::string& getDirectory() const { return m_Dir; }
+
+    unsigned getHits() const { return m_Hits; }
+    unsigned getMisses() const { return m_Misses; }
+
+    ///\brief Only reuse the cached objects, do not store new ones.
+    void setReadOnly(bool ReadOnly) { m_ReadOnly = ReadOnly; }
+  };
+
+} // end namespace cling
+
+#endif // CLING_INCREMENTAL_OBJECT_CACHE_H
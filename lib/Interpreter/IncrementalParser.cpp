@@ -22,11 +22,14 @@
 #include "TransactionPool.h"
 #include "ValueExtractionSynthesizer.h"
 #include "ValuePrinterSynthesizer.h"
+#include "WarmStartImage.h"
 #include "ObjCSupport.h"
 #include "cling/Interpreter/CIFactory.h"
 #include "cling/Interpreter/Interpreter.h"
 #include "cling/Interpreter/InterpreterCallbacks.h"
+#include "cling/Interpreter/ReflectionIndex.h"
 #include "cling/Interpreter/Transaction.h"
+#include "cling/Utils/AST.h"
 #include "cling/Utils/Diagnostics.h"
 #include "cling/Utils/Output.h"
 
@@ -34,6 +37,7 @@
 #include "clang/AST/Attr.h"
 #include "clang/AST/Decl.h"
 #include "clang/AST/DeclGroup.h"
+#include "clang/AST/DeclTemplate.h"
 #include "clang/AST/RecursiveASTVisitor.h"
 #include "clang/Basic/Diagnostic.h"
 #include "clang/Basic/FileManager.h"
@@ -175,13 +179,111 @@ namespace {
       ~RAAI() { m_Client.m_IgnorePromptDiags.pop(); }
     };
   };
+
+  ///\brief The source manager allocates the offsets of the input lines
+  /// upwards from 0 and those of PCHs and modules downwards from 2^31.
+  static const unsigned kSLocSpace = 1U << 31;
+
+  ///\brief Whether D was loaded from a PCH and can be named from a header
+  /// chained to it.
+  static bool IsDeclaredInPCH(const NamedDecl* D) {
+    if (!D->isFromASTFile() || !D->getDeclName())
+      return false;
+    const Decl* Outer = D;
+    while (isa<CXXRecordDecl>(Outer->getDeclContext())) {
+      if (Outer->getAccess() != AS_public)
+        return false;
+      Outer = cast<Decl>(Outer->getDeclContext());
+    }
+    return !Outer->getDeclContext()->isFunctionOrMethod();
+  }
+
+  static bool IsSpellableFromPCH(QualType QT);
+
+  static bool IsSpellableFromPCH(const TemplateArgument& Arg) {
+    switch (Arg.getKind()) {
+      case TemplateArgument::Type:
+        return IsSpellableFromPCH(Arg.getAsType());
+      case TemplateArgument::Integral:
+        return IsSpellableFromPCH(Arg.getIntegralType());
+      case TemplateArgument::Template: {
+        const TemplateDecl* TD = Arg.getAsTemplate().getAsTemplateDecl();
+        return TD && IsDeclaredInPCH(TD);
+      }
+      case TemplateArgument::Pack:
+        for (const TemplateArgument& Elt: Arg.pack_elements()) {
+          if (!IsSpellableFromPCH(Elt))
+            return false;
+        }
+        return true;
+      default:
+        return false;
+    }
+  }
+
+  ///\brief Whether a header chained to the PCH the session loaded can
+  /// name the instantiation Spec.
+  static bool
+  IsSpellableFromPCH(const ClassTemplateSpecializationDecl* Spec) {
+    if (!IsDeclaredInPCH(Spec->getSpecializedTemplate()))
+      return false;
+    for (const TemplateArgument& Arg: Spec->getTemplateArgs().asArray()) {
+      if (!IsSpellableFromPCH(Arg))
+        return false;
+    }
+    return true;
+  }
+
+  static bool IsSpellableFromPCH(QualType QT) {
+    const Type* T = QT.getCanonicalType().getTypePtr();
+    if (isa<BuiltinType>(T))
+      return true;
+    if (const PointerType* PT = dyn_cast<PointerType>(T))
+      return IsSpellableFromPCH(PT->getPointeeType());
+    if (const ReferenceType* RT = dyn_cast<ReferenceType>(T))
+      return IsSpellableFromPCH(RT->getPointeeType());
+    if (const ConstantArrayType* AT = dyn_cast<ConstantArrayType>(T))
+      return IsSpellableFromPCH(AT->getElementType());
+    if (const TagType* TT = dyn_cast<TagType>(T)) {
+      const TagDecl* TD = TT->getDecl();
+      if (const auto* Spec = dyn_cast<ClassTemplateSpecializationDecl>(TD))
+        return IsSpellableFromPCH(Spec);
+      return IsDeclaredInPCH(TD);
+    }
+    return false;
+  }
+
+  ///\brief Collect the fully qualified names of the class template
+  /// instantiations T (and its nested transactions) triggered, which a
+  /// header chained to the PCH the session loaded can name.
+  static void CollectInstantiations(const cling::Transaction& T,
+                                    const ASTContext& Ctx,
+                                    std::vector<std::string>& Types) {
+    for (const cling::Transaction::DelayCallInfo& DCI: T.decls()) {
+      if (DCI.m_Call != cling::Transaction::kCCIHandleTagDeclDefinition)
+        continue;
+      for (const Decl* D: DCI.m_DGR) {
+        const auto* Spec = dyn_cast<ClassTemplateSpecializationDecl>(D);
+        if (!Spec || Spec->isFromASTFile() || Spec->isInvalidDecl()
+            || isa<ClassTemplatePartialSpecializationDecl>(Spec)
+            || Spec->getSpecializationKind() != TSK_ImplicitInstantiation
+            || !IsSpellableFromPCH(Spec))
+          continue;
+        Types.push_back(cling::utils::TypeName::GetFullyQualifiedName(
+                          Ctx.getTypeDeclType(Spec), Ctx));
+      }
+    }
+    for (auto I = T.nested_begin(), E = T.nested_end(); I != E; ++I)
+      CollectInstantiations(**I, Ctx, Types);
+  }
 } // unnamed namespace
 
 namespace cling {
   IncrementalParser::IncrementalParser(Interpreter* interp, const char* llvmdir):
     m_Interpreter(interp),
     m_CI(CIFactory::createCI("", interp->getOptions(), llvmdir)),
-    m_Consumer(nullptr), m_ModuleNo(0), m_LineOffset(1) {
+    m_Consumer(nullptr), m_ModuleNo(0), m_LineOffset(1),
+    m_NumBuffers(0), m_NumReleasedBuffers(0), m_SLocWarnLevel(0) {
 
     if (!m_CI) {
       cling::errs() << "Compiler instance could not be created.\n";
@@ -288,6 +390,26 @@ namespace cling {
     return true;
   }
 
+  void IncrementalParser::usePreambleCache(const WarmStartImage* Runtime) {
+    const InvocationOptions& Opts = m_Interpreter->getOptions();
+    if (Opts.IsInteractive())
+      return;
+    m_Preamble = WarmStartImage::createPreamble(*m_CI, Opts,
+                                                Opts.Inputs.front(), Runtime);
+    if (!m_Preamble)
+      return;
+    if (!m_Preamble->load(*m_CI)) {
+      m_Preamble->buildInBackground(*m_CI);
+      return;
+    }
+    if (!Opts.InstantiationCache)
+      return;
+    m_Instantiations = WarmStartImage::createInstantiations(*m_CI, Opts,
+                                                            *m_Preamble);
+    if (m_Instantiations && !m_Instantiations->load(*m_CI))
+      m_Instantiations->buildInBackground(*m_CI);
+  }
+
   bool IncrementalParser::isValid(bool initialized) const {
     return m_CI && m_CI->hasFileManager() && m_Consumer
            && !m_VirtualFileID.isInvalid()
@@ -299,7 +421,7 @@ namespace cling {
   }
 
   size_t IncrementalParser::getLineNumber() const {
-    return m_MemoryBuffers.size() + m_LineOffset;
+    return m_NumBuffers + m_LineOffset;
   }
 
   size_t IncrementalParser::moveLineOffset(int Offset){
@@ -363,6 +485,19 @@ namespace cling {
   }
 
   IncrementalParser::~IncrementalParser() {
+    // Only instantiations a chained header can name are recorded: those of
+    // templates and arguments loaded from the preamble image.
+    if (m_Preamble && m_Preamble->isValid()
+        && m_Interpreter->getOptions().InstantiationCache) {
+      std::vector<std::string> Types;
+      for (const Transaction* T: m_Transactions) {
+        if (T->getState() == Transaction::kCommitted)
+          CollectInstantiations(*T, m_CI->getASTContext(), Types);
+      }
+      if (!Types.empty())
+        m_Preamble->recordInstantiations(Types);
+    }
+
     Transaction* T = const_cast<Transaction*>(getFirstTransaction());
     while (T) {
       assert((T->getState() == Transaction::kCommitted
@@ -390,6 +525,8 @@ namespace cling {
     Transaction* OldCurT = m_Consumer->getTransaction();
     Transaction* NewCurT = m_TransactionPool->takeTransaction(m_CI->getSema());
     NewCurT->setCompilationOpts(Opts);
+    // Turned into the bytes allocated by the transaction upon commit.
+    NewCurT->setASTBytes(m_CI->getASTContext().getASTAllocatedMemory());
     // If we are in the middle of transaction and we see another begin
     // transaction - it must be nested transaction.
     if (OldCurT && OldCurT != NewCurT
@@ -578,13 +715,27 @@ namespace cling {
       }
       m_Consumer->setTransaction(prevConsumerT);
     }
+    T->setASTBytes(getCI()->getASTContext().getASTAllocatedMemory()
+                   - T->getASTBytes());
     T->setState(Transaction::kCommitted);
 
+    // T's declarations might change what names resolve to.
+    m_Interpreter->invalidateLookupCache();
+    m_Consumer->TransactionCommitted(*T);
     if (InterpreterCallbacks* callbacks = m_Interpreter->getCallbacks())
       callbacks->TransactionCommitted(*T);
 
   }
 
+  const DeclNameIndex& IncrementalParser::getDeclNameIndex() {
+    assert(m_Consumer && "No AST consumer available");
+    DeclNameIndex& Index = m_Consumer->getNameIndex();
+    // Most sessions never ask; do not pay for it on each transaction.
+    if (!Index.isBuilt())
+      Index.build(getFirstTransaction());
+    return Index;
+  }
+
   void IncrementalParser::emitTransaction(Transaction* T) {
     for (auto DI = T->decls_begin(), DE = T->decls_end(); DI != DE; ++DI)
       m_Consumer->HandleTopLevelDecl(DI->m_DGR);
@@ -705,6 +856,9 @@ namespace cling {
   IncrementalParser::ParseResultTransaction
   IncrementalParser::Compile(llvm::StringRef input,
                              const CompilationOptions& Opts) {
+    // Reflection queries must not rely on what they knew while parsing.
+    ReflectionIndex::UpdateRAII Update(
+      m_Interpreter->getReflectionIndexOrNull(), /*Unloading=*/false);
     Transaction* CurT = beginTransaction(Opts);
     EParseResult ParseRes = ParseInternal(input);
 
@@ -763,8 +917,6 @@ namespace cling {
     // candidates for example
     SourceLocation NewLoc = getLastMemoryBufferEndLoc().getLocWithOffset(1);
 
-    llvm::MemoryBuffer* MBNonOwn = MB.get();
-
     // Create FileID for the current buffer.
     FileID FID;
     // Create FileEntry and FileID for the current buffer.
@@ -781,7 +933,8 @@ namespace cling {
                                 CO.CodeCompletionOffset+1/* 1-based column*/);
     }
 
-    m_MemoryBuffers.push_back(std::make_pair(MBNonOwn, FID));
+    ++m_NumBuffers;
+    checkSourceLocationUsage();
 
     // NewLoc only used for diags.
     PP.EnterSourceFile(FID, /*DirLookup*/0, NewLoc);
@@ -858,6 +1011,74 @@ namespace cling {
     }
   }
 
+  bool IncrementalParser::declaresOnlyWrapper(const Transaction& T) const {
+    const FileID FID = T.getBufferFID();
+    if (FID.isInvalid() || T.getState() != Transaction::kCommitted
+        || T.hasNestedTransactions() || T.macros_begin() != T.macros_end())
+      return false;
+
+    const SourceManager& SM = m_CI->getSourceManager();
+    for (const Transaction::DelayCallInfo& DCI: T.decls()) {
+      for (const Decl* D: DCI.m_DGR) {
+        switch (DCI.m_Call) {
+          case Transaction::kCCIHandleTopLevelDecl:
+          case Transaction::kCCIHandleInterestingDecl: {
+            const FunctionDecl* FD = dyn_cast<FunctionDecl>(D);
+            if (!FD || !utils::Analyze::IsWrapper(FD))
+              return false;
+            break;
+          }
+          case Transaction::kCCIHandleVTable:
+          case Transaction::kCCIHandleCXXImplicitFunctionInstantiation:
+          case Transaction::kCCIHandleCXXStaticMemberVarInstantiation:
+            if (SM.getFileID(SM.getSpellingLoc(D->getLocation())) == FID)
+              return false;
+            break;
+          default:
+            return false;
+        }
+      }
+    }
+    return true;
+  }
+
+  void IncrementalParser::releaseInputBuffer(const Transaction& T) {
+    // The verifier reads the buffers once the session ends.
+    if (m_CI->getDiagnosticOpts().VerifyDiagnostics
+        || !declaresOnlyWrapper(T))
+      return;
+
+    // Like for unloaded transactions, see TransactionUnloader. The offsets
+    // of the buffer stay allocated: the source manager never reuses them.
+    m_CI->getSourceManager().invalidateCache(T.getBufferFID());
+    ++m_NumReleasedBuffers;
+  }
+
+  void IncrementalParser::checkSourceLocationUsage() {
+    const unsigned Level
+      = 4 * uint64_t(m_CI->getSourceManager().getNextLocalOffset())
+        / kSLocSpace;
+    if (Level <= m_SLocWarnLevel || Level < 3)
+      return;
+    m_SLocWarnLevel = Level;
+    cling::errs() << "cling: warning: " << (Level * 25)
+                  << "% of the source location space is in use; the session "
+                     "fails once it is exhausted. Restart it, or release "
+                     "input with .undo.\n";
+  }
+
+  void IncrementalParser::printSourceLocationUsage(llvm::raw_ostream& Out)
+    const {
+    const SourceManager& SM = m_CI->getSourceManager();
+    const unsigned Used = SM.getNextLocalOffset();
+    Out << "Source locations: " << Used << " of " << kSLocSpace << " ("
+        << (100 * uint64_t(Used) / kSLocSpace) << "%) in use, "
+        << SM.local_sloc_entry_size() << " local and "
+        << SM.loaded_sloc_entry_size() << " loaded entries\n"
+        << "Input buffers: " << m_NumBuffers << " created, "
+        << m_NumReleasedBuffers << " released\n";
+  }
+
   void IncrementalParser::SetTransformers(bool isChildInterpreter) {
     // Add transformers to the IncrementalParser, which owns them
     Sema* TheSema = &m_CI->getSema();
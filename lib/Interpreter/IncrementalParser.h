@@ -24,6 +24,7 @@ namespace llvm {
   struct GenericValue;
   class MemoryBuffer;
   class Module;
+  class raw_ostream;
 }
 
 namespace clang {
@@ -38,10 +39,12 @@ namespace clang {
 namespace cling {
   class CompilationOptions;
   class DeclCollector;
+  class DeclNameIndex;
   class ExecutionContext;
   class Interpreter;
   class Transaction;
   class TransactionPool;
+  class WarmStartImage;
   class ASTTransformer;
 
   ///\brief Responsible for the incremental parsing and compilation of input.
@@ -62,8 +65,15 @@ namespace cling {
     // parser (incremental)
     std::unique_ptr<clang::Parser> m_Parser;
 
-    // One buffer for each command line, owner by the source file manager
-    std::deque<std::pair<llvm::MemoryBuffer*, clang::FileID>> m_MemoryBuffers;
+    // Number of input lines; each got a buffer owned by the source manager
+    size_t m_NumBuffers;
+
+    // Number of input buffers released by releaseInputBuffer()
+    size_t m_NumReleasedBuffers;
+
+    // The fraction of the source location space, in quarters, in use when
+    // last warned about it
+    unsigned m_SLocWarnLevel;
 
     // file ID of the memory buffer
     clang::FileID m_VirtualFileID;
@@ -97,6 +107,15 @@ namespace cling {
     ///
     std::unique_ptr<clang::DiagnosticConsumer> m_DiagConsumer;
 
+    ///\brief The PCH of the #includes the input file starts with.
+    ///
+    std::unique_ptr<WarmStartImage> m_Preamble;
+
+    ///\brief The PCH of the template instantiations earlier sessions with
+    /// the same preamble triggered, chained to m_Preamble.
+    ///
+    std::unique_ptr<WarmStartImage> m_Instantiations;
+
   public:
     enum EParseResult {
       kSuccess,
@@ -116,10 +135,24 @@ namespace cling {
 
     bool Initialize(llvm::SmallVectorImpl<ParseResultTransaction>& result,
                     bool isChildInterpreter);
+
+    ///\brief Precompile the #includes the input file starts with: load
+    /// their PCH if an earlier session built it, else build it in the
+    /// background for later sessions. With --instantiation-cache, do the same
+    /// for the template instantiations earlier sessions recorded. Must be
+    /// called before Initialize().
+    ///
+    ///\param[in] Runtime - the runtime image to chain the PCH to, if any.
+    ///
+    void usePreambleCache(const WarmStartImage* Runtime);
+
     clang::CompilerInstance* getCI() const { return m_CI.get(); }
     clang::Parser* getParser() const { return m_Parser.get(); }
     clang::CodeGenerator* getCodeGenerator() const { return m_CodeGen.get(); }
     bool hasCodeGenerator() const { return m_CodeGen.get(); }
+    ///\brief The name index, built from the committed transactions on first
+    /// use.
+    const DeclNameIndex& getDeclNameIndex();
     clang::SourceLocation getLastMemoryBufferEndLoc() const;
     size_t getLineNumber() const;
     size_t moveLineOffset(int Offset);
@@ -215,6 +248,22 @@ namespace cling {
 
     void printTransactionStructure() const;
 
+    ///\brief Whether the committed T declares nothing that outlives its
+    /// wrapper: only the wrapper function and instantiations of templates
+    /// declared elsewhere, and no macros.
+    ///
+    bool declaresOnlyWrapper(const Transaction& T) const;
+
+    ///\brief Free the source of T's input line once its wrapper ran and
+    /// its value was printed, if T declaresOnlyWrapper().
+    ///
+    void releaseInputBuffer(const Transaction& T);
+
+    ///\brief Print how much of the source location space is in use and how
+    /// many input buffers were released.
+    ///
+    void printSourceLocationUsage(llvm::raw_ostream& Out) const;
+
     ///\brief Runs the static initializers created by codegening a transaction.
     ///
     ///\param[in] T - the transaction for which to run the initializers.
@@ -251,6 +300,11 @@ namespace cling {
     ///
     EParseResult ParseInternal(llvm::StringRef input);
 
+    ///\brief Warn once per further quarter of the source location space in
+    /// use, from three quarters on.
+    ///
+    void checkSourceLocationUsage();
+
   };
 } // end namespace cling
 #endif // CLING_INCREMENTAL_PARSER_H
@@ -18,6 +18,7 @@
 #include "IncrementalParser.h"
 #include "MultiplexInterpreterCallbacks.h"
 #include "TransactionUnloader.h"
+#include "WarmStartImage.h"
 
 #include "cling/Interpreter/AutoloadCallback.h"
 #include "cling/Interpreter/CIFactory.h"
@@ -28,6 +29,7 @@
 #include "cling/Interpreter/DynamicLibraryManager.h"
 #include "cling/Interpreter/InterceptBuilder.h"
 #include "cling/Interpreter/LookupHelper.h"
+#include "cling/Interpreter/ReflectionIndex.h"
 #include "cling/Interpreter/Transaction.h"
 #include "cling/Interpreter/Value.h"
 #include "cling/Utils/AST.h"
@@ -36,6 +38,7 @@
 #include "cling/Utils/SourceNormalization.h"
 
 #include "clang/AST/ASTContext.h"
+#include "clang/AST/DeclTemplate.h"
 #include "clang/AST/GlobalDecl.h"
 #include "clang/Basic/SourceManager.h"
 #include "clang/Basic/TargetInfo.h"
@@ -46,17 +49,25 @@
 #include "clang/Lex/ExternalPreprocessorSource.h"
 #include "clang/Lex/HeaderSearch.h"
 #include "clang/Lex/LexDiagnostic.h"
+#include "clang/Lex/MacroInfo.h"
 #include "clang/Lex/Preprocessor.h"
 #include "clang/Parse/Parser.h"
 #include "clang/Sema/Sema.h"
 #include "clang/Sema/SemaDiagnostic.h"
 
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/SmallPtrSet.h"
 #include "llvm/IR/IRBuilder.h"
 #include "llvm/IR/LLVMContext.h"
 #include "llvm/IR/Module.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MemoryBuffer.h"
 #include "llvm/Support/Path.h"
+#include "llvm/Support/raw_ostream.h"
 
+#include <algorithm>
 #include <string>
+#include <tuple>
 #include <vector>
 
 #ifdef LLVM_ON_WIN32
@@ -114,6 +125,92 @@ namespace {
   static bool isPracticallyEmptyModule(const llvm::Module* M) {
     return M->empty() && M->global_empty() && M->alias_empty();
   }
+  ///\brief Starts each input saved by saveInputs(), followed by the input's
+  /// size in bytes: inputs may contain any line.
+  static const char kInputSeparator[] = "// --- ";
+
+  ///\brief Spell Str as a string literal.
+  static std::string QuoteString(llvm::StringRef Str) {
+    std::string Quoted("\"");
+    for (char C: Str) {
+      if (C == '\\' || C == '"')
+        Quoted += '\\';
+      Quoted += C;
+    }
+    Quoted += '"';
+    return Quoted;
+  }
+
+  ///\brief Estimate the memory held by the IR of M: its globals, functions,
+  /// blocks and instructions with their operands. Constants are uniqued in
+  /// the LLVMContext, shared between modules, and not counted.
+  static size_t EstimateIRBytes(const llvm::Module& M, size_t& Instructions) {
+    size_t Bytes = sizeof(llvm::Module);
+    for (const llvm::GlobalValue& GV: M.global_values())
+      Bytes += GV.getName().size();
+    Bytes += M.global_size() * sizeof(llvm::GlobalVariable)
+      + M.alias_size() * sizeof(llvm::GlobalAlias);
+    for (const llvm::Function& F: M) {
+      Bytes += sizeof(llvm::Function) + F.arg_size() * sizeof(llvm::Argument);
+      for (const llvm::BasicBlock& BB: F) {
+        Bytes += sizeof(llvm::BasicBlock);
+        for (const llvm::Instruction& I: BB)
+          Bytes += sizeof(llvm::Instruction)
+            + I.getNumOperands() * sizeof(llvm::Use);
+        Instructions += BB.size();
+      }
+    }
+    return Bytes;
+  }
+
+  ///\brief Count D and the declarations it contains by the file they are
+  /// spelled in, without deserializing any.
+  static void CountDeclsByFile(const SourceManager& SM, const Decl* D,
+                        llvm::DenseMap<const clang::FileEntry*, size_t>& Counts,
+                               size_t& Total) {
+    ++Total;
+    const SourceLocation Loc = D->getLocation();
+    if (Loc.isValid())
+      if (const clang::FileEntry* FE
+          = SM.getFileEntryForID(SM.getFileID(SM.getExpansionLoc(Loc))))
+        ++Counts[FE];
+    if (const DeclContext* DC = dyn_cast<DeclContext>(D))
+      for (const Decl* Child: DC->noload_decls())
+        CountDeclsByFile(SM, Child, Counts, Total);
+    else if (const TemplateDecl* TD = dyn_cast<TemplateDecl>(D))
+      if (const NamedDecl* Templated = TD->getTemplatedDecl())
+        CountDeclsByFile(SM, Templated, Counts, Total);
+  }
+
+  ///\brief CountDeclsByFile() for the declarations of T and its nested
+  /// transactions, whose AST memory T accounts for.
+  static void CountDeclsByFile(const SourceManager& SM, const Transaction& T,
+                        llvm::DenseMap<const clang::FileEntry*, size_t>& Counts,
+                               size_t& Total) {
+    for (const Transaction::DelayCallInfo& DCI: T.decls())
+      for (const Decl* D: DCI.m_DGR)
+        CountDeclsByFile(SM, D, Counts, Total);
+    for (auto I = T.nested_begin(), E = T.nested_end(); I != E; ++I)
+      CountDeclsByFile(SM, **I, Counts, Total);
+  }
+
+  ///\brief Sort Entries by their second member, largest first, and print
+  /// the first TopN of them under Title.
+  template <class T>
+  static void PrintTop(llvm::raw_ostream& Out, llvm::StringRef Title,
+                       std::vector<std::pair<std::string, T>>& Entries,
+                       unsigned TopN, llvm::StringRef Unit) {
+    std::stable_sort(Entries.begin(), Entries.end(),
+                     [](const std::pair<std::string, T>& L,
+                        const std::pair<std::string, T>& R) {
+                       return L.second > R.second;
+                     });
+    Out << Title << " (top " << std::min<size_t>(TopN, Entries.size())
+        << " of " << Entries.size() << "):\n";
+    for (size_t I = 0, E = std::min<size_t>(TopN, Entries.size()); I < E; ++I)
+      Out << "  " << Entries[I].first << ": " << Entries[I].second << ' '
+          << Unit << '\n';
+  }
 } // unnamed namespace
 
 namespace cling {
@@ -254,6 +351,29 @@ namespace cling {
     }
   };
 
+  ///\brief Records the input of the outermost successful call in
+  /// m_RecordedInputs, with the transaction it created.
+  class Interpreter::RecordInputRAII {
+    Interpreter& m_Interp;
+    const Transaction* m_PrevT;
+
+  public:
+    RecordInputRAII(Interpreter& Interp):
+      m_Interp(Interp), m_PrevT(Interp.getLastTransaction()) {
+      ++m_Interp.m_RecordedInputDepth;
+    }
+    ~RecordInputRAII() { --m_Interp.m_RecordedInputDepth; }
+
+    CompilationResult record(CompilationResult Res, std::string Input) {
+      if (Res == kSuccess && m_Interp.m_RecordedInputDepth == 1) {
+        const Transaction* T = m_Interp.getLastTransaction();
+        m_Interp.m_RecordedInputs.emplace_back(T != m_PrevT ? T->getUniqueID()
+                                             : 0, std::move(Input));
+      }
+      return Res;
+    }
+  };
+
   Interpreter::Interpreter(int argc, const char* const *argv,
                            const char* llvmdir /*= 0*/, bool noRuntime,
                            const Interpreter* parentInterp) :
@@ -261,7 +381,8 @@ namespace cling {
     m_UniqueCounter(parentInterp ? parentInterp->m_UniqueCounter + 1 : 0),
     m_PrintDebug(false), m_DynamicLookupDeclared(false),
     m_DynamicLookupEnabled(false), m_RawInputEnabled(false),
-    m_OptLevel(parentInterp ? parentInterp->m_OptLevel : -1) {
+    m_OptLevel(parentInterp ? parentInterp->m_OptLevel : -1),
+    m_RecordedInputDepth(0) {
 
     ::memset(m_CachedTrns, 0, sizeof(m_CachedTrns));
     if (parentInterp) {
@@ -298,10 +419,26 @@ namespace cling {
 
     clang::CompilerInstance* CI = getCI();
 
+    // Start from the state saved by an earlier session, or save it for later
+    // ones.
+    std::unique_ptr<WarmStartImage> WarmStart;
+    if (m_Opts.WarmStart && !parentInterp && !noRuntime)
+      WarmStart = WarmStartImage::createRuntime(*CI, m_Opts);
+    bool CacheRuntimeObjects = false;
+
     if (!isInSyntaxOnlyMode()) {
-      m_Executor.reset(new IncrementalExecutor(SemaRef.Diags, *CI));
+      m_Executor.reset(new IncrementalExecutor(SemaRef.Diags, *CI, m_Opts));
       if (!m_Executor)
         return;
+      m_DyLibManager->setExecutor(m_Executor.get());
+
+      // Unless the user has an object cache of their own, the image caches
+      // the objects compiled during initialization.
+      if (WarmStart && m_Opts.ObjectCacheDir.empty()) {
+        m_Executor->enableObjectCache(WarmStart->getObjectDirectory(),
+                                      WarmStart->isValid() /*ReadOnly*/);
+        CacheRuntimeObjects = !WarmStart->isValid();
+      }
 
       // Build the overloads __cxa_exit, atexit, etc.
       // Do this as early as possible so any static variables or other runtime
@@ -399,6 +536,11 @@ namespace cling {
     DiagnosticConsumer& DClient = CI->getDiagnosticClient();
     DClient.BeginSourceFile(CI->getLangOpts(), &PP);
 
+    if (WarmStart)
+      WarmStart->load(*CI);
+    if (m_Opts.PreambleCache && !parentInterp)
+      m_IncrParser->usePreambleCache(WarmStart.get());
+
     llvm::SmallVector<IncrementalParser::ParseResultTransaction, 2>
       IncrParserTransactions;
     if (!m_IncrParser->Initialize(IncrParserTransactions, parentInterp)) {
@@ -417,6 +559,11 @@ namespace cling {
     for (auto&& I: IncrParserTransactions)
       m_IncrParser->commitTransaction(I);
 
+    if (WarmStart && !WarmStart->isValid())
+      WarmStart->build(*CI);
+    if (CacheRuntimeObjects)
+      m_Executor->freezeObjectCache();
+
     // Sync offset so input line numbers match.
     m_IncrParser->moveLineOffset(-(m_IncrParser->getLineNumber() - 1));
 
@@ -483,6 +630,7 @@ namespace cling {
 
     // LookupHelper's ~Parser needs the PP from IncrParser's CI, so do this
     // first:
+    m_ReflectionIndex.reset();
     m_LookupHelper.reset();
 
     // We want to keep the callback alive during the shutdown of Sema, CodeGen
@@ -571,7 +719,10 @@ namespace cling {
   }
 
   void Interpreter::AddIncludePath(llvm::StringRef PathsStr) {
-    return AddIncludePaths(PathsStr, nullptr);
+    RecordInputRAII Record(*this);
+    AddIncludePaths(PathsStr, nullptr);
+    Record.record(kSuccess, "#pragma cling add_include_path("
+                            + QuoteString(PathsStr) + ")");
   }
 
   void Interpreter::DumpIncludePath(llvm::raw_ostream* S) {
@@ -594,6 +745,115 @@ namespace cling {
       ClangInternalState::printLookupTables(where, getSema().getASTContext());
     else if (what.equals("undo"))
       m_IncrParser->printTransactionStructure();
+    else if (what.equals("sloc"))
+      m_IncrParser->printSourceLocationUsage(where);
+    else if (what.equals("memory")) {
+      unsigned TopN = 10;
+      if (!filter.empty() && filter.getAsInteger(10, TopN)) {
+        cling::errs() << "Invalid number of entries '" << filter << "'\n";
+        return;
+      }
+      printMemoryUsage(where, TopN);
+    }
+    else if (what.equals("jit")) {
+      if (m_Executor)
+        m_Executor->printJITStats(where, filter);
+    }
+  }
+
+  void Interpreter::printMemoryUsage(llvm::raw_ostream& Out,
+                                     unsigned TopN) const {
+    const ASTContext& C = getCI()->getASTContext();
+    const SourceManager& SM = getCI()->getSourceManager();
+    const Preprocessor& PP = getCI()->getPreprocessor();
+
+    // Attribute what we can to the transactions. Nested transactions are
+    // accounted for by their parent.
+    std::vector<std::pair<std::string, size_t>> Transactions;
+    llvm::SmallPtrSet<void*, 32> JITSets;
+    // A transaction's AST memory, shared by its headers in proportion to
+    // the number of declarations each contributed.
+    llvm::DenseMap<const clang::FileEntry*, size_t> HeaderASTBytes;
+    size_t NumModules = 0, NumInstructions = 0, NumIRBytes = 0;
+    unsigned Index = 0;
+    for (const Transaction* T = m_IncrParser->getFirstTransaction(); T;
+         T = T->getNext(), ++Index) {
+      size_t SourceBytes = 0, Instructions = 0, IRBytes = 0, JITBytes = 0;
+      const FileID FID = T->getBufferFID();
+      if (FID.isValid()) {
+        bool Invalid = false;
+        const SrcMgr::SLocEntry& Entry = SM.getSLocEntry(FID, &Invalid);
+        if (!Invalid && Entry.isFile())
+          SourceBytes = Entry.getFile().getContentCache()->getSizeBytesMapped();
+      }
+      if (const llvm::Module* M = T->getModule()) {
+        ++NumModules;
+        IRBytes = EstimateIRBytes(*M, Instructions);
+        NumInstructions += Instructions;
+        NumIRBytes += IRBytes;
+      }
+      // Coalesced transactions share their module set.
+      void* Set = T->getExeUnloadHandle().m_Opaque;
+      if (m_Executor && Set != (void*)(size_t)-1 && JITSets.insert(Set).second)
+        JITBytes = m_Executor->getJITSectionBytes(T->getExeUnloadHandle());
+
+      if (const size_t ASTBytes = T->getASTBytes()) {
+        llvm::DenseMap<const clang::FileEntry*, size_t> DeclsByFile;
+        size_t NumDecls = 0;
+        CountDeclsByFile(SM, *T, DeclsByFile, NumDecls);
+        for (const auto& FileDecls: DeclsByFile)
+          HeaderASTBytes[FileDecls.first]
+            += (uint64_t)ASTBytes * FileDecls.second / NumDecls;
+      }
+
+      std::string Name;
+      llvm::raw_string_ostream Desc(Name);
+      Desc << '#' << Index << " (AST " << T->getASTBytes() << ", source "
+           << SourceBytes << ", IR ~" << IRBytes << ", JIT " << JITBytes
+           << " bytes; " << Instructions << " IR instructions)";
+      Transactions.emplace_back(Desc.str(), T->getASTBytes() + SourceBytes
+                                + IRBytes + JITBytes);
+    }
+
+    const SourceManager::MemoryBufferSizes Buffers
+      = SM.getMemoryBufferSizes();
+    Out << "AST: " << C.getASTAllocatedMemory() << " bytes, "
+        << C.getSideTableAllocatedMemory() << " bytes of side tables\n"
+        << "Source manager: " << Buffers.malloc_bytes << " bytes of buffers on"
+        << " the heap, " << Buffers.mmap_bytes << " mapped, "
+        << SM.getContentCacheSize() + SM.getDataStructureSizes()
+        << " bytes of tables\n"
+        << "Retained IR: ~" << NumIRBytes << " bytes, " << NumInstructions
+        << " instructions in " << NumModules << " modules\n"
+        << "JIT: " << (m_Executor ? m_Executor->getJITSectionBytes() : 0)
+        << " bytes of code and data\n"
+        << "Values: " << Value::getNumManagedAllocations()
+        << " managed allocations of " << Value::getManagedAllocationBytes()
+        << " bytes\n"
+        << "Destructor wrappers: " << m_DtorWrappers.size() << '\n';
+
+    PrintTop(Out, "Transactions", Transactions, TopN, "bytes");
+
+    std::vector<std::pair<std::string, size_t>> Files;
+    for (const auto& FileBytes: HeaderASTBytes)
+      if (FileBytes.second)
+        Files.emplace_back(FileBytes.first->getName().str(), FileBytes.second);
+    PrintTop(Out, "Headers", Files, TopN, "bytes of AST");
+
+    // Only count the macros in memory, not those still in a PCH or module.
+    llvm::DenseMap<const clang::FileEntry*, unsigned> MacrosByFile;
+    for (const auto& Macro: PP.macros(/*IncludeExternalMacros=*/false)) {
+      const MacroInfo* MI = PP.getMacroInfo(Macro.first);
+      if (!MI || MI->isBuiltinMacro())
+        continue;
+      SourceLocation Loc = SM.getExpansionLoc(MI->getDefinitionLoc());
+      ++MacrosByFile[SM.getFileEntryForID(SM.getFileID(Loc))];
+    }
+    std::vector<std::pair<std::string, unsigned>> Macros;
+    for (const auto& FM: MacrosByFile)
+      Macros.emplace_back(FM.first ? FM.first->getName().str()
+                                   : std::string("<input>"), FM.second);
+    PrintTop(Out, "Macros", Macros, TopN, "macros");
   }
 
   void Interpreter::storeInterpreterState(const std::string& name) const {
@@ -627,6 +887,71 @@ namespace cling {
     ClangInternalState::printIncludedFiles(Out, getCI()->getSourceManager());
   }
 
+  Interpreter::CompilationResult
+  Interpreter::saveInputs(llvm::StringRef File) const {
+    std::error_code EC;
+    // Binary: the sizes count the bytes as written.
+    llvm::raw_fd_ostream Out(File, EC, llvm::sys::fs::F_None);
+    if (EC) {
+      cling::errs() << "cling::Interpreter::saveInputs(): cannot write '"
+                    << File << "': " << EC.message() << '\n';
+      return kFailure;
+    }
+    Out << "// cling inputs; replay with .replayInputs\n";
+    for (const auto& Input: m_RecordedInputs) {
+      Out << kInputSeparator << Input.second.size() << '\n'
+          << Input.second << '\n';
+    }
+    Out.close();
+    if (Out.has_error()) {
+      Out.clear_error();
+      cling::errs() << "cling::Interpreter::saveInputs(): cannot write '"
+                    << File << "'\n";
+      return kFailure;
+    }
+    return kSuccess;
+  }
+
+  Interpreter::CompilationResult
+  Interpreter::replayInputs(llvm::StringRef File) {
+    llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> Buf
+      = llvm::MemoryBuffer::getFile(File);
+    if (!Buf) {
+      cling::errs() << "cling::Interpreter::replayInputs(): cannot read '"
+                    << File << "': " << Buf.getError().message() << '\n';
+      return kFailure;
+    }
+
+    // The first line is the header.
+    llvm::StringRef Content = (*Buf)->getBuffer().split('\n').second;
+    std::vector<std::string> Inputs;
+    while (!Content.empty()) {
+      llvm::StringRef Separator;
+      std::tie(Separator, Content) = Content.split('\n');
+      size_t Size;
+      if (!Separator.startswith(kInputSeparator)
+          || Separator.drop_front(sizeof(kInputSeparator) - 1)
+               .getAsInteger(10, Size)
+          || Content.size() <= Size || Content[Size] != '\n') {
+        cling::errs() << "cling::Interpreter::replayInputs(): '" << File
+                      << "' is corrupt after input " << Inputs.size() << '\n';
+        return kFailure;
+      }
+      Inputs.push_back(Content.substr(0, Size));
+      Content = Content.drop_front(Size + 1);
+    }
+
+    for (size_t I = 0, N = Inputs.size(); I < N; ++I) {
+      if (process(Inputs[I], nullptr /*Value*/, nullptr /*Transaction*/,
+                  true /*disableValuePrinting*/) != kSuccess) {
+        cling::errs() << "cling::Interpreter::replayInputs(): input " << I + 1
+                      << " of '" << File << "' failed:\n" << Inputs[I];
+        return kFailure;
+      }
+    }
+    return kSuccess;
+  }
+
 
   void Interpreter::GetIncludePaths(llvm::SmallVectorImpl<std::string>& incpaths,
                                    bool withSystem, bool withFlags) {
@@ -688,6 +1013,7 @@ namespace cling {
   Interpreter::process(const std::string& input, Value* V /* = 0 */,
                        Transaction** T /* = 0 */,
                        bool disableValuePrinting /* = false*/) {
+    RecordInputRAII Record(*this);
     std::string wrapReadySource = input;
     size_t wrapPoint = std::string::npos;
     if (!isRawInputEnabled())
@@ -698,7 +1024,7 @@ namespace cling {
       CO.DeclarationExtraction = 0;
       CO.ValuePrinting = 0;
       CO.ResultEvaluation = 0;
-      return DeclareInternal(input, CO, T);
+      return Record.record(DeclareInternal(input, CO, T), input);
     }
 
     CompilationOptions CO(this);
@@ -713,7 +1039,7 @@ namespace cling {
       return Interpreter::kFailure;
     }
 
-    return Interpreter::kSuccess;
+    return Record.record(Interpreter::kSuccess, input);
   }
 
   Interpreter::CompilationResult
@@ -821,13 +1147,14 @@ namespace cling {
 
   Interpreter::CompilationResult
   Interpreter::declare(const std::string& input, Transaction** T/*=0 */) {
+    RecordInputRAII Record(*this);
     CompilationOptions CO(this);
     CO.DeclarationExtraction = 0;
     CO.ValuePrinting = 0;
     CO.ResultEvaluation = 0;
     CO.CheckPointerValidity = 0;
 
-    return DeclareInternal(input, CO, T);
+    return Record.record(DeclareInternal(input, CO, T), input);
   }
 
   Interpreter::CompilationResult
@@ -901,12 +1228,13 @@ namespace cling {
 
   Interpreter::CompilationResult
   Interpreter::echo(const std::string& input, Value* V /* = 0 */) {
+    RecordInputRAII Record(*this);
     CompilationOptions CO(this);
     CO.DeclarationExtraction = 0;
     CO.ValuePrinting = CompilationOptions::VPEnabled;
     CO.ResultEvaluation = (bool)V;
 
-    return EvaluateInternal(input, CO, V);
+    return Record.record(EvaluateInternal(input, CO, V), input);
   }
 
   Interpreter::CompilationResult
@@ -1329,12 +1657,55 @@ namespace cling {
             // dumpIfNoStorage.
             && V->needsManagedAllocation())
           V->dump();
-        return Interpreter::kSuccess;
       }
+
+      // The wrapper ran and its value is printed; unless it declared
+      // something, its source is done.
+      if (!retireWrapper(*lastT, *V))
+        m_IncrParser->releaseInputBuffer(*lastT);
     }
     return Interpreter::kSuccess;
   }
 
+  bool Interpreter::retireWrapper(Transaction& T, const Value& V) {
+    // unload() can only revert the last transaction, and does not with
+    // --errorout.
+    if (!m_Opts.RetireWrappers || m_Opts.ErrorOut || !m_Executor
+        || &T != getLastTransaction() || !T.getModule()
+        || !m_IncrParser->declaresOnlyWrapper(T))
+      return false;
+
+    // Aggregates and pointers might refer to the wrapper's data.
+    if (V.isValid()) {
+      const clang::QualType QT = V.getType();
+      if (!QT->isVoidType() && !QT->isArithmeticType()
+          && !QT->isEnumeralType())
+        return false;
+    }
+
+    // The module must define nothing but the wrapper: code generation does
+    // not emit the copies of inline functions or the string literals again
+    // for later modules, which keep referring to this one's.
+    unsigned NumFunctions = 0;
+    for (const llvm::Function& F: *T.getModule()) {
+      if (!F.isDeclaration() && ++NumFunctions > 1)
+        return false;
+    }
+    for (const llvm::GlobalVariable& GV: T.getModule()->globals()) {
+      if (!GV.isDeclaration() && !GV.getName().startswith("llvm."))
+        return false;
+    }
+    if (!T.getModule()->alias_empty())
+      return false;
+    if (const llvm::GlobalVariable* Ctors
+          = T.getModule()->getNamedGlobal("llvm.global_ctors"))
+      if (Ctors->hasInitializer() && !Ctors->getInitializer()->isNullValue())
+        return false;
+
+    unload(T);
+    return true;
+  }
+
   FileEntry Interpreter::lookupFileOrLibrary(FileEntry file) {
     if (file.resolved())
       return file;
@@ -1381,16 +1752,19 @@ namespace cling {
 
   Interpreter::CompilationResult
   Interpreter::loadLibrary( FileEntry fileObj, bool permant) {
+    RecordInputRAII Record(*this);
     FileEntry file = lookupFileOrLibrary(std::move(fileObj));
     if (!file.exists())
       return kMoreInputExpected;
     if (!file.isLibrary())
       return kFailure;
 
+    const std::string Pragma = "#pragma cling load("
+                               + QuoteString(file.filePath()) + ")";
     switch (getDynamicLibraryManager()->loadLibrary(std::move(file), permant)) {
       case DynamicLibraryManager::kLoadLibSuccess: // Intentional fall through
       case DynamicLibraryManager::kLoadLibAlreadyLoaded:
-        return kSuccess;
+        return Record.record(kSuccess, Pragma);
       case DynamicLibraryManager::kLoadLibNotFound:
         assert(0 && "Cannot find library with existing canonical name!");
       default:
@@ -1401,6 +1775,7 @@ namespace cling {
 
   Interpreter::CompilationResult
   Interpreter::loadHeader( FileEntry fileObj, Transaction** T /*= 0*/) {
+    RecordInputRAII Record(*this);
     FileEntry file = lookupFileOrLibrary(std::move(fileObj));
     if (!file.exists()) {
       getSema().Diag(getSourceLocation(), clang::diag::err_pp_file_not_found)
@@ -1417,7 +1792,7 @@ namespace cling {
     CO.ValuePrinting = 0;
     CO.ResultEvaluation = 0;
     CO.CheckPointerValidity = 1;
-    return DeclareInternal(code, CO, T);
+    return Record.record(DeclareInternal(code, CO, T), code);
   }
 
   Interpreter::CompilationResult
@@ -1433,6 +1808,22 @@ namespace cling {
     return loadHeader(std::move(file), T);
   }
 
+  void Interpreter::invalidateLookupCache() {
+    // Transactions are committed before the LookupHelper exists.
+    if (m_LookupHelper)
+      m_LookupHelper->invalidateCache();
+  }
+
+  const DeclNameIndex& Interpreter::getDeclNameIndex() const {
+    return m_IncrParser->getDeclNameIndex();
+  }
+
+  ReflectionIndex& Interpreter::getReflectionIndex() {
+    if (!m_ReflectionIndex)
+      m_ReflectionIndex.reset(new ReflectionIndex(*this));
+    return *m_ReflectionIndex;
+  }
+
   void Interpreter::unload(Transaction& T) {
     // Clear any stored states that reference the llvm::Module.
     // Do it first in case
@@ -1455,6 +1846,14 @@ namespace cling {
       }
     }
 
+    // Forget the input that created T.
+    m_RecordedInputs.erase(
+        std::remove_if(m_RecordedInputs.begin(), m_RecordedInputs.end(),
+                       [&T](const std::pair<unsigned, std::string>& Input) {
+                         return Input.first && Input.first == T.getUniqueID();
+                       }),
+        m_RecordedInputs.end());
+
     // Clear any cached transaction states.
     for (unsigned i = 0; i < kNumTransactions; ++i) {
       if (m_CachedTrns[i] == &T) {
@@ -1463,6 +1862,8 @@ namespace cling {
       }
     }
 
+    // Lookups might have found T's declarations.
+    invalidateLookupCache();
     if (InterpreterCallbacks* callbacks = getCallbacks())
       callbacks->TransactionUnloaded(T);
     if (m_Executor) { // we also might be in fsyntax-only mode.
@@ -1488,6 +1889,10 @@ namespace cling {
     if (InterpreterCallbacks* callbacks = getCallbacks())
       callbacks->TransactionRollback(T);
 
+    // Stop answering queries with T's declarations before they are gone.
+    ReflectionIndex::UpdateRAII Update(m_ReflectionIndex.get(),
+                                       /*Unloading=*/true);
+
     TransactionUnloader U(this, &getCI()->getSema(),
                           m_IncrParser->getCodeGenerator(),
                           m_Executor.get());
@@ -1633,11 +2038,19 @@ namespace cling {
     IncrementalExecutor::ExecutionResult ExeRes
        = IncrementalExecutor::kExeSuccess;
     if (!isPracticallyEmptyModule(M)) {
+      // Nothing to run: the module is emitted along with a later one.
+      if (m_Executor->deferEmission(*M))
+        return ConvertExecutionResult(ExeRes);
+
       T.setExeUnloadHandle(m_Executor.get(), m_Executor->emitToJIT());
 
       // Forward to IncrementalExecutor; should not be called by
       // anyone except for IncrementalParser.
       ExeRes = m_Executor->runStaticInitializersOnce(T);
+
+      // Static initialization done, the IR is only needed for unloading.
+      if (ExeRes == IncrementalExecutor::kExeSuccess)
+        m_Executor->discardIR(*M, T.getExeUnloadHandle());
     }
 
     return ConvertExecutionResult(ExeRes);
@@ -13,11 +13,13 @@
 
 #include "clang/Driver/Options.h"
 
+#include "llvm/ADT/StringSwitch.h"
 #include "llvm/ADT/Triple.h"
 #include "llvm/Option/Arg.h"
 #include "llvm/Option/ArgList.h"
 #include "llvm/Option/Option.h"
 #include "llvm/Option/OptTable.h"
+#include "llvm/Support/FileSystem.h"
 #include "llvm/Support/Path.h"
 
 #include <memory>
@@ -83,6 +85,17 @@ static const char kNoStdInc[] = "-nostdinc";
     Opts.ShowVersion = Args.hasArg(OPT_version);
     Opts.Help = Args.hasArg(OPT_help);
     Opts.NoRuntime = Args.hasArg(OPT_noruntime);
+    Opts.JITTiered = Args.hasArg(OPT__jit_tiered);
+    Opts.JITLazy = Args.hasArg(OPT__jit_lazy);
+    Opts.JITHugePages = Args.hasArg(OPT__jit_huge_pages);
+    Opts.JITPerf = Args.hasArg(OPT__jit_perf);
+    Opts.JITCoalesce = Args.hasArg(OPT__jit_coalesce);
+    Opts.JITDiscardIR = Args.hasArg(OPT__jit_discard_ir);
+    Opts.WarmStart = Args.hasArg(OPT__warm_start);
+    Opts.InstantiationCache = Args.hasArg(OPT__instantiation_cache);
+    Opts.PreambleCache = Args.hasArg(OPT__preamble_cache)
+                         || Opts.InstantiationCache;
+    Opts.RetireWrappers = Args.hasArg(OPT__retire_wrappers);
     if (Arg* MetaStringArg = Args.getLastArg(OPT__metastr, OPT__metastr_EQ)) {
       Opts.MetaString = MetaStringArg->getValue();
       if (Opts.MetaString.empty()) {
@@ -91,6 +104,31 @@ static const char kNoStdInc[] = "-nostdinc";
       }
     }
 
+    if (Arg* CacheArg = Args.getLastArg(OPT__jit_object_cache_EQ))
+      Opts.ObjectCacheDir = CacheArg->getValue();
+
+    if (Arg* CacheArg = Args.getLastArg(OPT__include_path_cache_EQ)) {
+      const unsigned Mode = StringSwitch<unsigned>(CacheArg->getValue())
+        .Case("use", CompilerOptions::kIncludePathCacheUse)
+        .Case("off", CompilerOptions::kIncludePathCacheOff)
+        .Case("refresh", CompilerOptions::kIncludePathCacheRefresh)
+        .Default(~0U);
+      if (Mode != ~0U)
+        Opts.CompilerOpts.IncludePathCache = Mode;
+      else
+        cling::errs() << "ERROR: unknown include path cache mode '"
+                      << CacheArg->getValue()
+                      << "'; expected use, off or refresh.\n";
+    }
+
+    if (Arg* ThreadsArg = Args.getLastArg(OPT__jit_threads_EQ)) {
+      if (StringRef(ThreadsArg->getValue()).getAsInteger(10, Opts.JITThreads)) {
+        cling::errs() << "ERROR: invalid number of JIT threads '"
+                      << ThreadsArg->getValue() << "'; compiling serially.\n";
+        Opts.JITThreads = 0;
+      }
+    }
+
     if (Arg* JitArg = Args.getLastArg(OPT__jit, OPT__jit_EQ)) {
       const char* JitFmt = JitArg->getValue();
       const char Elf[] = "elf";
@@ -142,7 +180,8 @@ static const char kNoStdInc[] = "-nostdinc";
 CompilerOptions::CompilerOptions(int argc, const char* const* argv) :
   Language(0), ResourceDir(false), SysRoot(false), NoBuiltinInc(false),
   NoCXXInc(false), StdVersion(false), StdLib(false), HasOutput(false),
-  Verbose(false), JITFormat(0) {
+  Verbose(false), JITFormat(0), TargetCPU(false), PrecompiledInput(false),
+  IncludePathCache(kIncludePathCacheUse) {
   if (argc && argv) {
     // Preserve what's already in Remaining, the user might want to push args
     // to clang while still using main's argc, argv
@@ -178,8 +217,32 @@ void CompilerOptions::Parse(int argc, const char* const argv[],
       // case options::OPT_nostdinc:
       case options::OPT_nostdincxx: NoCXXInc = true; break;
       case options::OPT_v: Verbose = true; break;
+      case options::OPT_march_EQ:
+      case options::OPT_mcpu_EQ: TargetCPU = true; break;
+      case options::OPT_include_pch:
+      case options::OPT_fmodules:
+      case options::OPT_fmodules_ts:
+      case options::OPT_fmodule_file:
+      case options::OPT_fmodule_map_file:
+      case options::OPT_fimplicit_module_maps:
+        PrecompiledInput = true;
+        break;
+      case options::OPT_include: {
+        // The driver replaces -include X by -include-pch X.pch if it exists.
+        const std::string Header = arg->getValue();
+        if (llvm::sys::fs::exists(Header + ".pch")
+            || llvm::sys::fs::exists(Header + ".gch"))
+          PrecompiledInput = true;
+        break;
+      }
 
       default:
+        if (arg->getOption().getKind() == Option::InputClass) {
+          const llvm::StringRef Ext
+            = llvm::sys::path::extension(arg->getValue());
+          if (Ext.equals(".pch") || Ext.equals(".pcm"))
+            PrecompiledInput = true;
+        }
         if (Inputs && arg->getOption().getKind() == Option::InputClass) {
           Inputs->push_back(arg->getValue());
 #ifdef CLING_OBJC_SUPPORT
@@ -202,8 +265,11 @@ void CompilerOptions::Parse(int argc, const char* const argv[],
 }
 
 InvocationOptions::InvocationOptions(int argc, const char* const* argv) :
-  MetaString("."), ErrorOut(false), NoLogo(false), ShowVersion(false),
-  Help(false), NoRuntime(false) {
+  MetaString("."), JITThreads(0), ErrorOut(false), NoLogo(false),
+  ShowVersion(false), Help(false), NoRuntime(false), JITTiered(false),
+  JITLazy(false), JITHugePages(false), JITPerf(false),
+  JITCoalesce(false), JITDiscardIR(false), WarmStart(false),
+  PreambleCache(false), InstantiationCache(false), RetireWrappers(false) {
 
   ArrayRef<const char *> ArgStrings(argv, argv + argc);
   unsigned MissingArgIndex, MissingArgCount;
@@ -0,0 +1,74 @@
+//--------------------------------------------------------------------*- C++ -*-
+// CLING - the C++ LLVM-based InterpreterG :)
+//
+// This file is dual-licensed: you can choose to license it under the University
+// of Illinois Open Source License or the GNU Lesser General Public License. See
+// LICENSE.TXT for details.
+//------------------------------------------------------------------------------
+
+#include "JITStubs.h"
+
+#include "llvm/ExecutionEngine/Orc/IndirectionUtils.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/GlobalVariable.h"
+#include "llvm/IR/Module.h"
+
+using namespace llvm;
+
+namespace cling {
+namespace stubs {
+
+bool isStubbable(const Function& F) {
+  if (F.isDeclaration() || F.hasAvailableExternallyLinkage()
+      || !F.hasName() || F.isIntrinsic() || F.isVarArg()
+      || F.hasFnAttribute(Attribute::Naked))
+    return false;
+  // The stub cannot forward these.
+  for (const Argument& A: F.args())
+    if (A.hasInAllocaAttr())
+      return false;
+  return true;
+}
+
+void nameLocals(Module& M) {
+  const std::string& ModuleID = M.getModuleIdentifier();
+  for (GlobalValue& GV: M.global_values()) {
+    if (GV.isDeclaration() || !GV.hasLocalLinkage()
+        || GV.getName().startswith("llvm."))
+      continue;
+    // Named already, e.g. by the tiered compiler before partitioning.
+    if (GV.getName().endswith("." + ModuleID)) {
+      GV.setLinkage(GlobalValue::InternalLinkage);
+      continue;
+    }
+    if (GV.hasName())
+      GV.setName(GV.getName() + "." + ModuleID);
+    else
+      GV.setName(ModuleID + ".unnamed");
+    // Private symbols do not make it into the object's symbol table.
+    GV.setLinkage(GlobalValue::InternalLinkage);
+  }
+}
+
+GlobalVariable* makeStub(Function& F, Constant* Init) {
+  assert(F.isDeclaration() && "Remove the body first!");
+  const GlobalValue::LinkageTypes Linkage = F.getLinkage();
+  F.clearMetadata();
+  F.setPersonalityFn(nullptr);
+
+  Constant* TypedInit = Init->getType() == F.getType()
+    ? Init : ConstantExpr::getBitCast(Init, F.getType());
+  GlobalVariable* Impl
+    = orc::createImplPointer(*F.getType(), *F.getParent(),
+                             F.getName() + "$impl."
+                             + F.getParent()->getModuleIdentifier(),
+                             TypedInit);
+  Impl->setLinkage(GlobalValue::InternalLinkage);
+  orc::makeStub(F, *Impl);
+  F.setLinkage(Linkage);
+  return Impl;
+}
+
+} // end namespace stubs
+} // end namespace cling
@@ -0,0 +1,45 @@
+//--------------------------------------------------------------------*- C++ -*-
+// CLING - the C++ LLVM-based InterpreterG :)
+//
+// This file is dual-licensed: you can choose to license it under the University
+// of Illinois Open Source License or the GNU Lesser General Public License. See
+// LICENSE.TXT for details.
+//------------------------------------------------------------------------------
+
+#ifndef CLING_JIT_STUBS_H
+#define CLING_JIT_STUBS_H
+
+namespace llvm {
+  class Constant;
+  class Function;
+  class GlobalVariable;
+  class Module;
+}
+
+namespace cling {
+namespace stubs {
+
+  ///\brief Whether F's definition can be replaced by an indirect stub.
+  /// This includes definitions that another module's copy might replace
+  /// (e.g. linkonce_odr ones): each stub calls through the implementation
+  /// pointer of its own module, and code compiled for it must be named
+  /// after that module too.
+  bool isStubbable(const llvm::Function& F);
+
+  ///\brief Give the local definitions of M names unique to M, private ones
+  /// internal linkage, and unnamed ones a name. They stay local to M, but
+  /// code compiled separately can refer to them by name. Names given by an
+  /// earlier call are kept.
+  void nameLocals(llvm::Module& M);
+
+  ///\brief Turn F, whose body has been removed, into a stub calling through
+  /// a new implementation pointer initialized to Init. The pointer has
+  /// internal linkage and a name unique to F's module.
+  /// F keeps its name, linkage and address; its metadata is dropped.
+  ///\returns the implementation pointer.
+  llvm::GlobalVariable* makeStub(llvm::Function& F, llvm::Constant* Init);
+
+} // end namespace stubs
+} // end namespace cling
+
+#endif // CLING_JIT_STUBS_H
@@ -0,0 +1,275 @@
+//--------------------------------------------------------------------*- C++ -*-
+// CLING - the C++ LLVM-based InterpreterG :)
+//
+// This file is dual-licensed: you can choose to license it under the University
+// of Illinois Open Source License or the GNU Lesser General Public License. See
+// LICENSE.TXT for details.
+//------------------------------------------------------------------------------
+
+#include "LazyFunctionCompiler.h"
+
+#include "IncrementalJIT.h"
+#include "JITStubs.h"
+
+#include "cling/Interpreter/Exception.h"
+#include "cling/Utils/Output.h"
+
+#include "llvm/ADT/Triple.h"
+#include "llvm/Bitcode/BitcodeReader.h"
+#include "llvm/Bitcode/BitcodeWriter.h"
+#include "llvm/ExecutionEngine/Orc/CompileUtils.h"
+#include "llvm/ExecutionEngine/Orc/IndirectionUtils.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Target/TargetMachine.h"
+#include "llvm/Transforms/Utils/ValueMapper.h"
+
+#include <atomic>
+
+using namespace llvm;
+
+namespace {
+  ///\brief Called instead of a function that failed to compile. Unwinds to
+  /// the interpreter like other errors during runtime compilation, instead
+  /// of running code that does not exist.
+  static void LazyCompileFailed() {
+    cling::CompilationException::throwingHandler(nullptr,
+                          "cling::LazyFunctionCompiler: function failed to "
+                          "compile, see previous error!", false);
+  }
+
+  static const JITTargetAddress kFailedAddr
+    = (JITTargetAddress)&LazyCompileFailed;
+
+  ///\brief Declares the globals a function body refers to in the module the
+  /// body gets moved to.
+  class DeclMaterializer: public ValueMaterializer {
+    Module& m_Dst;
+  public:
+    DeclMaterializer(Module& Dst): m_Dst(Dst) {}
+
+    Value* materialize(Value* V) override {
+      if (auto F = dyn_cast<Function>(V))
+        return orc::cloneFunctionDecl(m_Dst, *F);
+      if (auto GV = dyn_cast<GlobalVariable>(V))
+        return orc::cloneGlobalVariableDecl(m_Dst, *GV);
+      if (auto GA = dyn_cast<GlobalAlias>(V)) {
+        GlobalValue* Decl;
+        if (auto FT = dyn_cast<FunctionType>(GA->getValueType()))
+          Decl = Function::Create(FT, GlobalValue::ExternalLinkage,
+                                  GA->getName(), &m_Dst);
+        else
+          Decl = new GlobalVariable(m_Dst, GA->getValueType(),
+                                    false /*isConstant*/,
+                                    GlobalValue::ExternalLinkage, nullptr,
+                                    GA->getName());
+        return ConstantExpr::getBitCast(Decl, GA->getType());
+      }
+      return nullptr;
+    }
+  };
+} // unnamed namespace
+
+namespace cling {
+
+LazyFunctionCompiler::LazyFunctionCompiler(IncrementalJIT& JIT,
+                                           TargetMachine& TM):
+  m_JIT(JIT), m_TM(TM),
+  m_CallbackMgr(orc::createLocalCompileCallbackManager(
+                    TM.getTargetTriple(),
+                    (JITTargetAddress)&LazyCompileFailed)) {
+  if (!m_CallbackMgr)
+    cling::errs() << "cling::LazyFunctionCompiler: lazy compilation is not "
+                     "supported for " << TM.getTargetTriple().str() << '\n';
+}
+
+LazyFunctionCompiler::~LazyFunctionCompiler() {}
+
+TargetMachine& LazyFunctionCompiler::getTargetMachine(int CGOptLevel) {
+  std::unique_ptr<TargetMachine>& TM = m_TMs[CGOptLevel];
+  if (!TM)
+    TM.reset(m_TM.getTarget().createTargetMachine(
+                                       m_TM.getTargetTriple().str(),
+                                       m_TM.getTargetCPU(),
+                                       m_TM.getTargetFeatureString(),
+                                       m_TM.Options,
+                                       m_TM.getRelocationModel(),
+                                       m_TM.getCodeModel(),
+                                       (CodeGenOpt::Level)CGOptLevel));
+  return *TM;
+}
+
+void LazyFunctionCompiler::instrument(Module& M, size_t Handle) {
+  std::vector<Function*> Funcs;
+  for (Function& F: M)
+    if (stubs::isStubbable(F))
+      Funcs.push_back(&F);
+  if (Funcs.empty())
+    return;
+
+  // The bodies end up in objects of their own; everything they refer to
+  // must be reachable by name.
+  stubs::nameLocals(M);
+
+  std::unique_ptr<SourceModule> Src(new SourceModule());
+  {
+    raw_string_ostream OS(Src->Bitcode);
+    WriteBitcodeToFile(&M, OS);
+  }
+  // BackendPasses configured m_TM for this module.
+  Src->CGOptLevel = m_TM.getOptLevel();
+
+  std::lock_guard<std::mutex> Lock(m_Lock);
+  for (Function* F: Funcs) {
+    orc::JITCompileCallbackManager::CompileCallbackInfo CCInfo
+      = m_CallbackMgr->getCompileCallback();
+    const JITTargetAddress Trampoline = CCInfo.getAddress();
+    CCInfo.setCompileAction([this, Trampoline]() {
+        return compile(Trampoline);
+      });
+
+    FunctionInfo& FI = m_Functions[Trampoline];
+    FI.Name = F->getName();
+    FI.BodyName = FI.Name + "$body." + M.getModuleIdentifier();
+    FI.Handle = Handle;
+    FI.Source = Src.get();
+    FI.Trampoline = Trampoline;
+    FI.Addr = 0;
+
+    // Refer to the trampoline by name, keeping its address out of the IR
+    // and thus out of the object cache key.
+    std::string TrampolineName
+      = FI.Name + "$trampoline." + M.getModuleIdentifier();
+    m_JIT.addInjectedSymbol(TrampolineName, Trampoline);
+    Function* TrampolineDecl
+      = Function::Create(F->getFunctionType(), GlobalValue::ExternalLinkage,
+                         TrampolineName, &M);
+    Src->Trampolines.push_back(std::move(TrampolineName));
+
+    const GlobalValue::LinkageTypes Linkage = F->getLinkage();
+    F->deleteBody();
+    F->setLinkage(Linkage);
+    FI.ImplName = stubs::makeStub(*F, TrampolineDecl)->getName();
+  }
+  m_Sources[Handle].push_back(std::move(Src));
+}
+
+JITTargetAddress LazyFunctionCompiler::compile(JITTargetAddress Trampoline) {
+  // Linking must not interleave with the JIT adding or removing modules on
+  // other threads; take the JIT's lock first, as it does when calling us.
+  std::lock_guard<std::recursive_mutex> JITLock(m_JIT.getModuleLock());
+  std::lock_guard<std::mutex> Lock(m_Lock);
+  auto IFunc = m_Functions.find(Trampoline);
+  if (IFunc == m_Functions.end())
+    return kFailedAddr;
+  FunctionInfo& FI = IFunc->second;
+  // Unless another thread was first.
+  if (!FI.Addr)
+    FI.Addr = compile(FI);
+  return FI.Addr;
+}
+
+JITTargetAddress LazyFunctionCompiler::compile(const FunctionInfo& FI) {
+  SourceModule& Src = *FI.Source;
+  if (!Src.Module) {
+    // Only the bodies that are called get materialized.
+    Src.Context.reset(new LLVMContext());
+    Expected<std::unique_ptr<Module>> ModOrErr
+      = getLazyBitcodeModule(MemoryBufferRef(Src.Bitcode, "cling-lazy"),
+                             *Src.Context);
+    if (!ModOrErr) {
+      cling::errs() << "cling::LazyFunctionCompiler: cannot read module: "
+                    << toString(ModOrErr.takeError()) << '\n';
+      return kFailedAddr;
+    }
+    Src.Module = std::move(*ModOrErr);
+  }
+
+  Function* SrcF = Src.Module->getFunction(FI.Name);
+  if (!SrcF) {
+    cling::errs() << "cling::LazyFunctionCompiler: cannot find '" << FI.Name
+                  << "'\n";
+    return kFailedAddr;
+  }
+  if (Error Err = SrcF->materialize()) {
+    cling::errs() << "cling::LazyFunctionCompiler: cannot read '" << FI.Name
+                  << "': " << toString(std::move(Err)) << '\n';
+    return kFailedAddr;
+  }
+
+  std::unique_ptr<Module> Dst(new Module(FI.Name + "$lazy", *Src.Context));
+  Dst->setDataLayout(Src.Module->getDataLayout());
+  Dst->setTargetTriple(Src.Module->getTargetTriple());
+
+  ValueToValueMapTy VMap;
+  Function* Body = orc::cloneFunctionDecl(*Dst, *SrcF, &VMap);
+  Body->setName(FI.BodyName);
+  Body->setLinkage(GlobalValue::ExternalLinkage);
+  Body->setVisibility(GlobalValue::DefaultVisibility);
+  DeclMaterializer Materializer(*Dst);
+  orc::moveFunctionBody(*SrcF, VMap, &Materializer, Body);
+
+  typedef object::OwningBinary<object::ObjectFile> ObjectT;
+  std::unique_ptr<ObjectT> Obj(new ObjectT(
+    orc::SimpleCompiler(getTargetMachine(Src.CGOptLevel))(*Dst)));
+  Dst.reset();
+  if (!Obj->getBinary()) {
+    cling::errs() << "cling::LazyFunctionCompiler: cannot compile '"
+                  << FI.Name << "'\n";
+    return kFailedAddr;
+  }
+
+  JITTargetAddress Addr
+    = m_JIT.addFunctionObject(std::move(Obj), FI.Handle, FI.BodyName);
+  const uint64_t ImplAddr = m_JIT.getSymbolAddress(FI.ImplName,
+                                                   false /*AlsoInProcess*/);
+  if (!Addr || !ImplAddr) {
+    cling::errs() << "cling::LazyFunctionCompiler: cannot link '" << FI.Name
+                  << "'\n";
+    Addr = kFailedAddr;
+  }
+  // Skip the trampoline from now on.
+  if (ImplAddr)
+    reinterpret_cast<std::atomic<uintptr_t>*>(ImplAddr)
+      ->store((uintptr_t)Addr, std::memory_order_release);
+  return Addr;
+}
+
+void LazyFunctionCompiler::forget(size_t Handle) {
+  std::lock_guard<std::mutex> Lock(m_Lock);
+  for (auto I = m_Functions.begin(), E = m_Functions.end(); I != E;) {
+    if (I->second.Handle == Handle) {
+      m_CallbackMgr->releaseCompileCallback(I->first);
+      I = m_Functions.erase(I);
+    } else
+      ++I;
+  }
+  auto ISources = m_Sources.find(Handle);
+  if (ISources == m_Sources.end())
+    return;
+  for (auto& Src: ISources->second)
+    for (const std::string& Name: Src->Trampolines)
+      m_JIT.removeInjectedSymbol(Name);
+  m_Sources.erase(ISources);
+}
+
+void LazyFunctionCompiler::printStats(raw_ostream& Out, StringRef Filter) {
+  std::lock_guard<std::mutex> Lock(m_Lock);
+  size_t Compiled = 0;
+  for (const auto& TF: m_Functions)
+    if (TF.second.Addr)
+      ++Compiled;
+  Out << "Lazy compilation: " << Compiled << " of " << m_Functions.size()
+      << " functions compiled\n";
+  if (Filter.empty())
+    return;
+  for (const auto& TF: m_Functions)
+    if (StringRef(TF.second.Name).find(Filter) != StringRef::npos)
+      Out << "  " << TF.second.Name << ": "
+          << (TF.second.Addr ? "compiled" : "not compiled") << '\n';
+}
+
+} // end namespace cling
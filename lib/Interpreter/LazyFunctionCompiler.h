@@ -0,0 +1,122 @@
+//--------------------------------------------------------------------*- C++ -*-
+// CLING - the C++ LLVM-based InterpreterG :)
+//
+// This file is dual-licensed: you can choose to license it under the University
+// of Illinois Open Source License or the GNU Lesser General Public License. See
+// LICENSE.TXT for details.
+//------------------------------------------------------------------------------
+
+#ifndef CLING_LAZY_FUNCTION_COMPILER_H
+#define CLING_LAZY_FUNCTION_COMPILER_H
+
+#include "llvm/ExecutionEngine/JITSymbol.h"
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace llvm {
+  class LLVMContext;
+  class Module;
+  class raw_ostream;
+  class StringRef;
+  class TargetMachine;
+  namespace orc {
+    class JITCompileCallbackManager;
+  }
+}
+
+namespace cling {
+  class IncrementalJIT;
+
+  ///\brief Compiles each function of a transaction only when it is first
+  /// called.
+  ///
+  /// The module handed to the JIT keeps its globals but every function
+  /// definition is replaced by a stub calling through an implementation
+  /// pointer, which initially points to a compile callback trampoline. On
+  /// the first call the function is extracted from the module's bitcode
+  /// (loaded lazily, so only the bodies that are needed get materialized),
+  /// compiled and linked; the implementation pointer is then updated, so
+  /// later calls go straight to the compiled code. A function that cannot be
+  /// compiled throws a CompilationException when called.
+  ///
+  class LazyFunctionCompiler {
+    ///\brief The bitcode of one module, before its functions were stubbed.
+    struct SourceModule {
+      std::string Bitcode;
+      std::unique_ptr<llvm::LLVMContext> Context;
+      std::unique_ptr<llvm::Module> Module;
+      ///\brief CodeGenOpt::Level the module was scheduled to be compiled at.
+      int CGOptLevel;
+      ///\brief Names through which the module refers to its trampolines.
+      std::vector<std::string> Trampolines;
+    };
+
+    struct FunctionInfo {
+      std::string Name;
+      ///\brief IR name of the stub's implementation pointer.
+      std::string ImplName;
+      ///\brief IR name of the compiled body, unique to the stub's module: a
+      /// linkonce_odr function has a stub in each module defining it.
+      std::string BodyName;
+      size_t Handle;
+      SourceModule* Source;
+      llvm::JITTargetAddress Trampoline;
+      ///\brief The compiled code, once the function was first called.
+      llvm::JITTargetAddress Addr;
+    };
+
+    IncrementalJIT& m_JIT;
+    llvm::TargetMachine& m_TM;
+    std::unique_ptr<llvm::orc::JITCompileCallbackManager> m_CallbackMgr;
+
+    ///\brief Source modules by unload handle.
+    std::map<size_t, std::vector<std::unique_ptr<SourceModule>>> m_Sources;
+
+    ///\brief Functions by trampoline address.
+    std::map<llvm::JITTargetAddress, FunctionInfo> m_Functions;
+
+    ///\brief TargetMachines by CodeGenOpt::Level, created on demand.
+    std::unique_ptr<llvm::TargetMachine> m_TMs[4];
+
+    ///\brief Protects the above against functions called from several
+    /// threads for the first time.
+    std::mutex m_Lock;
+
+    llvm::TargetMachine& getTargetMachine(int CGOptLevel);
+    ///\brief The compile action of Trampoline; runs on the thread calling
+    /// the function first.
+    llvm::JITTargetAddress compile(llvm::JITTargetAddress Trampoline);
+
+    ///\brief Compile and link FI.
+    ///\returns its address or, if that fails, the address of a function
+    /// throwing a CompilationException.
+    llvm::JITTargetAddress compile(const FunctionInfo& FI);
+
+  public:
+    LazyFunctionCompiler(IncrementalJIT& JIT, llvm::TargetMachine& TM);
+    ~LazyFunctionCompiler();
+
+    ///\brief Whether lazy compilation is supported for the target.
+    bool isValid() const { return (bool)m_CallbackMgr; }
+
+    ///\brief Replace the function definitions of M by lazy stubs.
+    ///\param [in] M - the module, already optimized.
+    ///\param [in] Handle - the unload handle M will be emitted under.
+    void instrument(llvm::Module& M, size_t Handle);
+
+    ///\brief Drop all functions of the module set Handle.
+    void forget(size_t Handle);
+
+    ///\brief Print how many of the stubbed functions were compiled and,
+    /// for those whose name contains Filter (if not empty), whether they
+    /// were.
+    void printStats(llvm::raw_ostream& Out, llvm::StringRef Filter);
+  };
+
+} // end namespace cling
+
+#endif // CLING_LAZY_FUNCTION_COMPILER_H
@@ -26,6 +26,8 @@
 #include "clang/Sema/Template.h"
 #include "clang/Sema/TemplateDeduction.h"
 
+#include "llvm/ADT/SmallString.h"
+
 using namespace clang;
 
 namespace cling {
@@ -38,13 +40,190 @@ namespace cling {
   // pin *tor here so that we can have clang::Parser defined and be able to call
   // the dtor on the OwningPtr
   LookupHelper::LookupHelper(clang::Parser* P, Interpreter* interp)
-    : m_Parser(P), m_Interpreter(interp) {
+    : m_Parser(P), m_Interpreter(interp), m_CacheGeneration(0),
+      m_Generation(0) {
     // Always properly initialized in isStringType
     // ::memset(m_StringTy, 0, sizeof(m_StringTy));
   }
 
   LookupHelper::~LookupHelper() {}
 
+  namespace {
+    enum CachedLookupKind {
+      kFindType,
+      kFindScope,
+      kFindScopeNoInstantiation,
+      kFindClassTemplate,
+      kFindFunctionProto,
+      kFindFunctionProtoTypes,
+      kFindFunctionArgs,
+      kMatchFunctionProto,
+      kMatchFunctionProtoTypes
+    };
+  }
+
+  ///\brief The key of a lookup in LookupHelper::m_Cache: the kind of lookup,
+  /// its DiagSetting and the name.
+  static llvm::StringRef CacheKey(llvm::SmallVectorImpl<char>& Buf,
+                                  CachedLookupKind Kind,
+                                  LookupHelper::DiagSetting diagOnOff,
+                                  llvm::StringRef Name) {
+    Buf.push_back('0' + Kind);
+    Buf.push_back('0' + diagOnOff);
+    Buf.append(Name.begin(), Name.end());
+    return llvm::StringRef(Buf.data(), Buf.size());
+  }
+
+  ///\brief The key of a function lookup: that of CacheKey() extended by the
+  /// constness of the object, the scope and the prototype or arguments.
+  static llvm::StringRef FunctionCacheKey(llvm::SmallVectorImpl<char>& Buf,
+                                          CachedLookupKind Kind,
+                                          LookupHelper::DiagSetting diagOnOff,
+                                          const Decl* scopeDecl,
+                                          llvm::StringRef funcName,
+                                          bool objectIsConst) {
+    CacheKey(Buf, Kind, diagOnOff, funcName);
+    Buf.push_back('\0');
+    Buf.push_back('0' + objectIsConst);
+    const char* Scope = reinterpret_cast<const char*>(&scopeDecl);
+    Buf.append(Scope, Scope + sizeof(scopeDecl));
+    return llvm::StringRef(Buf.data(), Buf.size());
+  }
+
+  static bool IsIdentifierChar(char C) {
+    return isalnum((unsigned char)C) || C == '_';
+  }
+
+  ///\brief The key of a lookup by a prototype or argument list spelled as
+  /// Proto. Whitespace only matters between two identifier characters or
+  /// two punctuators ("a - -b"), thus "const char *, int" and
+  /// "const char*,int" share their entry.
+  static llvm::StringRef FunctionCacheKey(llvm::SmallVectorImpl<char>& Buf,
+                                          CachedLookupKind Kind,
+                                          LookupHelper::DiagSetting diagOnOff,
+                                          const Decl* scopeDecl,
+                                          llvm::StringRef funcName,
+                                          bool objectIsConst,
+                                          llvm::StringRef Proto) {
+    FunctionCacheKey(Buf, Kind, diagOnOff, scopeDecl, funcName,
+                     objectIsConst);
+    Proto = Proto.trim();
+    for (size_t I = 0, E = Proto.size(); I < E; ++I) {
+      if (!isspace((unsigned char)Proto[I])) {
+        Buf.push_back(Proto[I]);
+        continue;
+      }
+      while (isspace((unsigned char)Proto[I + 1]))
+        ++I;
+      if (IsIdentifierChar(Buf.back()) == IsIdentifierChar(Proto[I + 1]))
+        Buf.push_back(' ');
+    }
+    return llvm::StringRef(Buf.data(), Buf.size());
+  }
+
+  ///\brief The key of a lookup by the types of the parameters.
+  static llvm::StringRef FunctionCacheKey(llvm::SmallVectorImpl<char>& Buf,
+                                          CachedLookupKind Kind,
+                                          LookupHelper::DiagSetting diagOnOff,
+                                          const Decl* scopeDecl,
+                                          llvm::StringRef funcName,
+                                          bool objectIsConst,
+                               const llvm::SmallVectorImpl<QualType>& Proto) {
+    FunctionCacheKey(Buf, Kind, diagOnOff, scopeDecl, funcName,
+                     objectIsConst);
+    for (QualType QT: Proto) {
+      void* Ptr = QT.getAsOpaquePtr();
+      const char* Bytes = reinterpret_cast<const char*>(&Ptr);
+      Buf.append(Bytes, Bytes + sizeof(Ptr));
+    }
+    return llvm::StringRef(Buf.data(), Buf.size());
+  }
+
+  const LookupHelper::CachedLookup*
+  LookupHelper::findCached(llvm::StringRef Key) const {
+    if (m_CacheGeneration != m_Generation) {
+      m_Cache.clear();
+      m_CacheGeneration = m_Generation;
+      return nullptr;
+    }
+    auto I = m_Cache.find(Key);
+    return I == m_Cache.end() ? nullptr : &I->second;
+  }
+
+  void LookupHelper::addToCache(llvm::StringRef Key, const void* Result,
+                                const Type* ResultType,
+                                DiagSetting diagOnOff) const {
+    // Repeating a failed lookup must repeat its diagnostics.
+    if (!Result && diagOnOff == WithDiagnostics)
+      return;
+    // The lookup itself might have committed a transaction; its result
+    // takes that into account.
+    if (m_CacheGeneration != m_Generation) {
+      m_Cache.clear();
+      m_CacheGeneration = m_Generation;
+    }
+    CachedLookup& Entry = m_Cache[Key];
+    Entry.m_Result = Result;
+    Entry.m_ResultType = ResultType;
+  }
+
+  template <class LookupFn>
+  const FunctionDecl*
+  LookupHelper::findCachedFunction(llvm::StringRef Key, DiagSetting diagOnOff,
+                                   LookupFn Lookup) const {
+    if (const CachedLookup* Cached = findCached(Key))
+      return static_cast<const FunctionDecl*>(Cached->m_Result);
+    const FunctionDecl* Result = Lookup();
+    addToCache(Key, Result, nullptr, diagOnOff);
+    return Result;
+  }
+
+  QualType LookupHelper::findType(llvm::StringRef typeName,
+                                  DiagSetting diagOnOff) const {
+    llvm::SmallString<128> Buf;
+    llvm::StringRef Key = CacheKey(Buf, kFindType, diagOnOff, typeName);
+    if (const CachedLookup* Cached = findCached(Key))
+      return QualType::getFromOpaquePtr(Cached->m_Result);
+    QualType Result = findTypeImpl(typeName, diagOnOff);
+    addToCache(Key, Result.getAsOpaquePtr(), nullptr, diagOnOff);
+    return Result;
+  }
+
+  const Decl* LookupHelper::findScope(llvm::StringRef className,
+                                      DiagSetting diagOnOff,
+                                      const Type** resultType /* = 0 */,
+                                      bool instantiateTemplate/*=true*/) const {
+    llvm::SmallString<128> Buf;
+    llvm::StringRef Key
+      = CacheKey(Buf, instantiateTemplate ? kFindScope
+                                          : kFindScopeNoInstantiation,
+                 diagOnOff, className);
+    if (const CachedLookup* Cached = findCached(Key)) {
+      if (resultType)
+        *resultType = Cached->m_ResultType;
+      return static_cast<const Decl*>(Cached->m_Result);
+    }
+    const Type* TheType = nullptr;
+    const Decl* Result = findScopeImpl(className, diagOnOff, &TheType,
+                                       instantiateTemplate);
+    addToCache(Key, Result, TheType, diagOnOff);
+    if (resultType)
+      *resultType = TheType;
+    return Result;
+  }
+
+  const ClassTemplateDecl*
+  LookupHelper::findClassTemplate(llvm::StringRef Name,
+                                  DiagSetting diagOnOff) const {
+    llvm::SmallString<128> Buf;
+    llvm::StringRef Key = CacheKey(Buf, kFindClassTemplate, diagOnOff, Name);
+    if (const CachedLookup* Cached = findCached(Key))
+      return static_cast<const ClassTemplateDecl*>(Cached->m_Result);
+    const ClassTemplateDecl* Result = findClassTemplateImpl(Name, diagOnOff);
+    addToCache(Key, Result, nullptr, diagOnOff);
+    return Result;
+  }
+
   static
   DeclContext* getCompleteContext(const Decl* scopeDecl,
                                   ASTContext& Context, Sema &S);
@@ -394,8 +573,8 @@ namespace cling {
     return false;
   }
 
-  QualType LookupHelper::findType(llvm::StringRef typeName,
-                                  DiagSetting diagOnOff) const {
+  QualType LookupHelper::findTypeImpl(llvm::StringRef typeName,
+                                      DiagSetting diagOnOff) const {
     //
     //  Our return value.
     //
@@ -446,10 +625,280 @@ namespace cling {
     return TheQT;
   }
 
-  const Decl* LookupHelper::findScope(llvm::StringRef className,
-                                      DiagSetting diagOnOff,
-                                      const Type** resultType /* = 0 */,
-                                      bool instantiateTemplate/*=true*/) const {
+  void LookupHelper::findTypes(llvm::ArrayRef<llvm::StringRef> typeNames,
+                               DiagSetting diagOnOff,
+                               llvm::SmallVectorImpl<QualType>& types) const {
+    types.assign(typeNames.size(), QualType());
+    std::vector<std::string> Keys(typeNames.size());
+    // The names to cache the result of, those to parse with the offset of
+    // their terminating ';' in the buffer, and those to look up one by one,
+    // by index.
+    llvm::SmallVector<size_t, 16> ToCache, ToParse, ToFind;
+    llvm::SmallVector<unsigned, 16> Ends;
+    {
+      // Could trigger deserialization of decls.
+      Interpreter::PushTransactionRAII RAII(m_Interpreter);
+
+      std::string Code;
+      for (size_t I = 0, E = typeNames.size(); I < E; ++I) {
+        llvm::StringRef Name = typeNames[I];
+        if (Name.empty())
+          continue;
+        llvm::SmallString<128> Buf;
+        Keys[I] = CacheKey(Buf, kFindType, diagOnOff, Name);
+        // Also re-cache the hits: committing the transaction invalidates
+        // the cache.
+        ToCache.push_back(I);
+        if (const CachedLookup* Cached = findCached(Keys[I])) {
+          types[I] = QualType::getFromOpaquePtr(Cached->m_Result);
+          continue;
+        }
+        if (quickFindType(Name, types[I], *m_Parser, diagOnOff))
+          continue;
+        // ';' separates the names in the buffer; it cannot be in a type.
+        if (Name.find(';') != llvm::StringRef::npos)
+          continue;
+        Code += Name;
+        Ends.push_back(Code.size());
+        Code += ";\n";
+        ToParse.push_back(I);
+      }
+
+      if (!ToParse.empty()) {
+        Parser& P = *m_Parser;
+        ParserStateRAII ResetParserState(P, true /*skipToEOF*/);
+        prepareForParsing(P, m_Interpreter, Code,
+                          llvm::StringRef("lookup.types.by.name.file"),
+                          diagOnOff);
+        const SourceManager& SM = P.getActions().getSourceManager();
+        // Whether the parser stopped at the ';' ending the Nth name.
+        auto isAtEnd = [&](size_t N) {
+          const Token& Tok = P.getCurToken();
+          return Tok.is(clang::tok::semi)
+            && SM.getDecomposedExpansionLoc(Tok.getLocation()).second
+               == Ends[N];
+        };
+        for (size_t N = 0, E = ToParse.size(); N < E; ++N) {
+          const size_t I = ToParse[N];
+          clang::ParsedAttributes Attrs(P.getAttrFactory());
+          TypeResult Res(P.ParseTypeName(0, Declarator::TypeNameContext,
+                                         clang::AS_none, 0, &Attrs));
+          // Accept it only if exactly the name was parsed; anything else is
+          // looked up on its own.
+          if (Res.isUsable() && isAtEnd(N)) {
+            TypeSourceInfo* TSI = 0;
+            types[I] = clang::Sema::GetTypeFromParser(Res.get(), &TSI);
+          } else {
+            // Doesn't reset the diagnostic mappings
+            P.getActions().getDiagnostics().Reset(/*soft=*/true);
+            ToFind.push_back(I);
+            // Unbalanced brackets make the parser skip to another name's
+            // ';': the names after it cannot be told apart anymore.
+            if (!isAtEnd(N))
+              P.SkipUntil(clang::tok::semi, Parser::StopBeforeMatch);
+            if (!isAtEnd(N)) {
+              ToFind.append(ToParse.begin() + N + 1, ToParse.end());
+              break;
+            }
+          }
+          P.ConsumeToken();
+        }
+      }
+
+      for (size_t I: ToFind)
+        types[I] = findTypeImpl(typeNames[I], diagOnOff);
+    }
+
+    // After the transaction was committed, which invalidates the cache.
+    for (size_t I: ToCache)
+      addToCache(Keys[I], types[I].getAsOpaquePtr(), nullptr, diagOnOff);
+  }
+
+  bool LookupHelper::quickFindScope(llvm::StringRef className,
+                                    DiagSetting diagOnOff,
+                                    const Type** resultType,
+                                    bool instantiateTemplate,
+                                    const Decl*& Result) const {
+    Parser &P = *m_Parser;
+    Sema &S = P.getActions();
+    Preprocessor &PP = P.getPreprocessor();
+    ASTContext &Context = S.getASTContext();
+
+    // See if we can find it without a buffer and any clang parsing,
+    // We need to go scope by scope.
+    const Decl *quickResult = nullptr;
+    if (!quickFindDecl(className, quickResult, P, diagOnOff))
+      return false;
+    // The result of quickFindDecl was definitive, we don't need
+    // to check any further.
+    Result = nullptr;
+    if (!quickResult)
+      return true;
+
+    const TagDecl *tagdecl = dyn_cast<TagDecl>(quickResult);
+    const TypedefNameDecl *typedefDecl = dyn_cast<TypedefNameDecl>(quickResult);
+    if (typedefDecl) {
+      QualType T = Context.getTypedefType(typedefDecl);
+      const TagType *TagTy = T->getAs<TagType>();
+      if (TagTy) tagdecl = TagTy->getDecl();
+      // NOTE: Should we instantiate here? ... maybe ...
+      if (tagdecl && resultType) *resultType = T.getTypePtr();
+
+    } else if (tagdecl && resultType) {
+      *resultType = tagdecl->getTypeForDecl();
+    }
+    // fprintf(stderr,"Short cut taken for %s.\n",className.str().c_str());
+    if (tagdecl) {
+      const TagDecl *defdecl = tagdecl->getDefinition();
+      if (!defdecl || !defdecl->isCompleteDefinition()) {
+        // fprintf(stderr,"Incomplete type for %s.\n",className.str().c_str());
+        if (instantiateTemplate) {
+          if (dyn_cast<ClassTemplateSpecializationDecl>(tagdecl)) {
+            // Go back to the normal schedule since we need a valid point
+            // of instantiation:
+            // Assertion failed: (Loc.isValid() &&
+            //    "point of instantiation must be valid!"),
+            //    function setPointOfInstantiation, file DeclTemplate.h,
+            //    line 1520.
+            // Which can happen here because the simple name maybe a
+            // typedef to a template (for example std::string).
+
+            // the next code executed must be the parsing of the name.
+            return false;
+          }
+          Result = RequireCompleteDeclContext(S, PP, tagdecl, diagOnOff);
+        }
+      } else {
+        Result = defdecl; // now pointing to the definition.
+      }
+    } else if (isa<NamespaceDecl>(quickResult)) {
+      Result = quickResult->getCanonicalDecl();
+    } else if (auto alias = dyn_cast<NamespaceAliasDecl>(quickResult)) {
+      Result = alias->getNamespace()->getCanonicalDecl();
+    }
+    //else fprintf(stderr,"Not a scope decl for %s.\n",className.str().c_str());
+    // The name exist and does not point to a 'scope' decl.
+    return true;
+  }
+
+  ///\brief Whether TryAnnotateCXXScopeToken() can be called on the current
+  /// token; it asserts otherwise.
+  static bool canAnnotateScope(Parser& P) {
+    return P.getCurToken().is(clang::tok::identifier)
+      || P.getCurToken().is(clang::tok::coloncolon)
+      || (P.getCurToken().is(clang::tok::annot_template_id)
+          && P.NextToken().is(clang::tok::coloncolon))
+      || P.getCurToken().is(clang::tok::kw_decltype);
+  }
+
+  const Decl* LookupHelper::findScopeFromSpec(CXXScopeSpec& SS,
+                                              const Type** setResultType,
+                                              bool instantiateTemplate) const {
+    Sema &S = m_Parser->getActions();
+    ASTContext &Context = S.getASTContext();
+
+    Decl* TheDecl = 0;
+    NestedNameSpecifier* NNS = SS.getScopeRep();
+    NestedNameSpecifier::SpecifierKind Kind = NNS->getKind();
+    //
+    //  Be careful, not all nested name specifiers refer to classes
+    //  and namespaces, and those are the only things we want.
+    //
+    switch (Kind) {
+      case NestedNameSpecifier::Identifier: {
+          // Dependent type.
+          // We do not accept these.
+        }
+        break;
+      case NestedNameSpecifier::Namespace: {
+          // Namespace.
+          NamespaceDecl* NSD = NNS->getAsNamespace();
+          NSD = NSD->getCanonicalDecl();
+          TheDecl = NSD;
+        }
+        break;
+      case NestedNameSpecifier::NamespaceAlias: {
+          // Namespace alias.
+          // Note: In the future, should we return the alias instead?
+          NamespaceAliasDecl* NSAD = NNS->getAsNamespaceAlias();
+          NamespaceDecl* NSD = NSAD->getNamespace();
+          NSD = NSD->getCanonicalDecl();
+          TheDecl = NSD;
+        }
+        break;
+      case NestedNameSpecifier::TypeSpec:
+          // Type name.
+          // Intentional fall-though
+      case NestedNameSpecifier::TypeSpecWithTemplate: {
+          // Type name qualified with "template".
+          // Note: Do we need to check for a dependent type here?
+          NestedNameSpecifier *prefix = NNS->getPrefix();
+          if (prefix) {
+             QualType temp
+               = Context.getElaboratedType(ETK_None,prefix,
+                                           QualType(NNS->getAsType(),0));
+             *setResultType = temp.getTypePtr();
+          } else {
+             *setResultType = NNS->getAsType();
+          }
+          const TagType* TagTy = (*setResultType)->getAs<TagType>();
+          if (TagTy) {
+            // It is a class, struct, or union.
+            TagDecl* TD = TagTy->getDecl();
+            if (TD) {
+              TheDecl = TD->getDefinition();
+              // NOTE: if (TheDecl) ... check for theDecl->isInvalidDecl()
+              if (TD && TD->isInvalidDecl()) {
+                printf("Warning: FindScope got an invalid tag decl\n");
+              }
+              if (TheDecl && TheDecl->isInvalidDecl()) {
+                printf("ERROR: FindScope about to return an invalid decl\n");
+              }
+              if (!TheDecl && instantiateTemplate) {
+
+                // Make sure it is not just forward declared, and
+                // instantiate any templates.
+                DeclContext *ctxt = TD;
+                if (!S.RequireCompleteDeclContext(SS, ctxt)) {
+                  // Success, type is complete, instantiations have
+                  // been done.
+                  TheDecl = TD->getDefinition();
+                  if (TheDecl->isInvalidDecl()) {
+                    // if the decl is invalid try to clean up
+                    UnloadDecl(&S, TheDecl);
+                    ++m_Generation;
+                    *setResultType = nullptr;
+                    return 0;
+                  }
+                } else {
+                  // NOTE: We cannot instantiate the scope: not a valid decl.
+                  // Need to rollback transaction.
+                  UnloadDecl(&S, TD);
+                  ++m_Generation;
+                  *setResultType = nullptr;
+                  return 0;
+                }
+              }
+            }
+          }
+        }
+        break;
+      case clang::NestedNameSpecifier::Global: {
+          // Name was just "::" and nothing more.
+          TheDecl = Context.getTranslationUnitDecl();
+        }
+        break;
+    case NestedNameSpecifier::Super:
+      // Microsoft's __super::
+      return 0;
+    }
+    return TheDecl;
+  }
+
+  const Decl* LookupHelper::findScopeImpl(llvm::StringRef className,
+                                          DiagSetting diagOnOff,
+                                          const Type** resultType,
+                                          bool instantiateTemplate) const {
 
     //
     //  Some utilities.
@@ -458,7 +907,6 @@ namespace cling {
     Parser &P = *m_Parser;
     Sema &S = P.getActions();
     Preprocessor &PP = P.getPreprocessor();
-    ASTContext &Context = S.getASTContext();
 
 
     // The user wants to see the template instantiation, existing or not.
@@ -467,65 +915,11 @@ namespace cling {
     // Also quickFindDecl could trigger deserialization of decls.
     Interpreter::PushTransactionRAII pushedT(m_Interpreter);
 
-    // See if we can find it without a buffer and any clang parsing,
-    // We need to go scope by scope.
     {
       const Decl *quickResult = nullptr;
-      if (quickFindDecl(className, quickResult, *m_Parser, diagOnOff)) {
-        // The result of quickFindDecl was definitive, we don't need
-        // to check any further.
-        if (!quickResult) {
-          return nullptr;
-        } else {
-          const TagDecl *tagdecl = dyn_cast<TagDecl>(quickResult);
-          const TypedefNameDecl *typedefDecl = dyn_cast<TypedefNameDecl>(quickResult);
-          if (typedefDecl) {
-            QualType T = Context.getTypedefType(typedefDecl);
-            const TagType *TagTy = T->getAs<TagType>();
-            if (TagTy) tagdecl = TagTy->getDecl();
-            // NOTE: Should we instantiate here? ... maybe ...
-            if (tagdecl && resultType) *resultType = T.getTypePtr();
-
-          } else if (tagdecl && resultType) {
-            *resultType = tagdecl->getTypeForDecl();
-          }
-          // fprintf(stderr,"Short cut taken for %s.\n",className.str().c_str());
-          if (tagdecl) {
-            const TagDecl *defdecl = tagdecl->getDefinition();
-            if (!defdecl || !defdecl->isCompleteDefinition()) {
-              // fprintf(stderr,"Incomplete type for %s.\n",className.str().c_str());
-              if (instantiateTemplate) {
-                if (dyn_cast<ClassTemplateSpecializationDecl>(tagdecl)) {
-                  // Go back to the normal schedule since we need a valid point
-                  // of instantiation:
-                  // Assertion failed: (Loc.isValid() &&
-                  //    "point of instantiation must be valid!"),
-                  //    function setPointOfInstantiation, file DeclTemplate.h,
-                  //    line 1520.
-                  // Which can happen here because the simple name maybe a
-                  // typedef to a template (for example std::string).
-
-                  // break;
-                  // the next code executed must be the TransactionRAII below
-                } else
-                  return RequireCompleteDeclContext(S, PP, tagdecl, diagOnOff);
-              } else {
-                return nullptr;
-              }
-            } else {
-              return defdecl; // now pointing to the definition.
-            }
-          } else if (isa<NamespaceDecl>(quickResult)) {
-            return quickResult->getCanonicalDecl();
-          } else if (auto alias = dyn_cast<NamespaceAliasDecl>(quickResult)) {
-            return alias->getNamespace()->getCanonicalDecl();
-          } else {
-            //fprintf(stderr,"Not a scope decl for %s.\n",className.str().c_str());
-            // The name exist and does not point to a 'scope' decl.
-            return nullptr;
-          }
-        }
-      }
+      if (quickFindScope(className, diagOnOff, resultType, instantiateTemplate,
+                         quickResult))
+        return quickResult;
     }
 
     ParserStateRAII ResetParserState(P, true /*skipToEOF*/);
@@ -544,11 +938,7 @@ namespace cling {
     //
     //  Prevent failing on an assert in TryAnnotateCXXScopeToken.
     //
-    if (!P.getCurToken().is(clang::tok::identifier)
-        && !P.getCurToken().is(clang::tok::coloncolon)
-        && !(P.getCurToken().is(clang::tok::annot_template_id)
-             && P.NextToken().is(clang::tok::coloncolon))
-        && !P.getCurToken().is(clang::tok::kw_decltype)) {
+    if (!canAnnotateScope(P)) {
       // error path
       return 0;
     }
@@ -560,111 +950,16 @@ namespace cling {
       return 0;
     }
 
-    Decl* TheDecl = 0;
+    const Decl* TheDecl = 0;
 
     if (P.getCurToken().getKind() == tok::annot_cxxscope) {
       CXXScopeSpec SS;
       S.RestoreNestedNameSpecifierAnnotation(P.getCurToken().getAnnotationValue(),
                                              P.getCurToken().getAnnotationRange(),
                                              SS);
-      if (SS.isValid()) {
-        NestedNameSpecifier* NNS = SS.getScopeRep();
-        NestedNameSpecifier::SpecifierKind Kind = NNS->getKind();
-        // Only accept the parse if we consumed all of the name.
-        if (P.NextToken().getKind() == clang::tok::eof) {
-          //
-          //  Be careful, not all nested name specifiers refer to classes
-          //  and namespaces, and those are the only things we want.
-          //
-          switch (Kind) {
-            case NestedNameSpecifier::Identifier: {
-                // Dependent type.
-                // We do not accept these.
-              }
-              break;
-            case NestedNameSpecifier::Namespace: {
-                // Namespace.
-                NamespaceDecl* NSD = NNS->getAsNamespace();
-                NSD = NSD->getCanonicalDecl();
-                TheDecl = NSD;
-              }
-              break;
-            case NestedNameSpecifier::NamespaceAlias: {
-                // Namespace alias.
-                // Note: In the future, should we return the alias instead?
-                NamespaceAliasDecl* NSAD = NNS->getAsNamespaceAlias();
-                NamespaceDecl* NSD = NSAD->getNamespace();
-                NSD = NSD->getCanonicalDecl();
-                TheDecl = NSD;
-              }
-              break;
-            case NestedNameSpecifier::TypeSpec:
-                // Type name.
-                // Intentional fall-though
-            case NestedNameSpecifier::TypeSpecWithTemplate: {
-                // Type name qualified with "template".
-                // Note: Do we need to check for a dependent type here?
-                NestedNameSpecifier *prefix = NNS->getPrefix();
-                if (prefix) {
-                   QualType temp
-                     = Context.getElaboratedType(ETK_None,prefix,
-                                                 QualType(NNS->getAsType(),0));
-                   *setResultType = temp.getTypePtr();
-                } else {
-                   *setResultType = NNS->getAsType();
-                }
-                const TagType* TagTy = (*setResultType)->getAs<TagType>();
-                if (TagTy) {
-                  // It is a class, struct, or union.
-                  TagDecl* TD = TagTy->getDecl();
-                  if (TD) {
-                    TheDecl = TD->getDefinition();
-                    // NOTE: if (TheDecl) ... check for theDecl->isInvalidDecl()
-                    if (TD && TD->isInvalidDecl()) {
-                      printf("Warning: FindScope got an invalid tag decl\n");
-                    }
-                    if (TheDecl && TheDecl->isInvalidDecl()) {
-                      printf("ERROR: FindScope about to return an invalid decl\n");
-                    }
-                    if (!TheDecl && instantiateTemplate) {
-
-                      // Make sure it is not just forward declared, and
-                      // instantiate any templates.
-                      DeclContext *ctxt = TD;
-                      if (!S.RequireCompleteDeclContext(SS, ctxt)) {
-                        // Success, type is complete, instantiations have
-                        // been done.
-                        TheDecl = TD->getDefinition();
-                        if (TheDecl->isInvalidDecl()) {
-                          // if the decl is invalid try to clean up
-                          UnloadDecl(&S, TheDecl);
-                          *setResultType = nullptr;
-                          return 0;
-                        }
-                      } else {
-                        // NOTE: We cannot instantiate the scope: not a valid decl.
-                        // Need to rollback transaction.
-                        UnloadDecl(&S, TD);
-                        *setResultType = nullptr;
-                        return 0;
-                      }
-                    }
-                  }
-                }
-              }
-              break;
-            case clang::NestedNameSpecifier::Global: {
-                // Name was just "::" and nothing more.
-                TheDecl = Context.getTranslationUnitDecl();
-              }
-              break;
-          case NestedNameSpecifier::Super:
-            // Microsoft's __super::
-            return 0;
-          }
-          return TheDecl;
-        }
-      }
+      // Only accept the parse if we consumed all of the name.
+      if (SS.isValid() && P.NextToken().getKind() == clang::tok::eof)
+        return findScopeFromSpec(SS, setResultType, instantiateTemplate);
     }
     //
     //  Cleanup after failed parse as a nested-name-specifier.
@@ -710,8 +1005,118 @@ namespace cling {
     return TheDecl;
   }
 
-  const ClassTemplateDecl* LookupHelper::findClassTemplate(llvm::StringRef Name,
-                                                           DiagSetting diagOnOff) const {
+  void LookupHelper::findScopes(llvm::ArrayRef<llvm::StringRef> classNames,
+                                DiagSetting diagOnOff,
+                                llvm::SmallVectorImpl<const Decl*>& scopes,
+                                llvm::SmallVectorImpl<const Type*>* resultTypes,
+                                bool instantiateTemplate) const {
+    scopes.assign(classNames.size(), nullptr);
+    llvm::SmallVector<const Type*, 16> Types(classNames.size(), nullptr);
+    std::vector<std::string> Keys(classNames.size());
+    // As in findTypes().
+    llvm::SmallVector<size_t, 16> ToCache, ToParse, ToFind;
+    llvm::SmallVector<unsigned, 16> Ends;
+    {
+      // The user wants to see the template instantiations, existing or not;
+      // they and the decls deserialized by quickFindDecl end up here.
+      Interpreter::PushTransactionRAII RAII(m_Interpreter);
+
+      std::string Code;
+      for (size_t I = 0, E = classNames.size(); I < E; ++I) {
+        llvm::StringRef Name = classNames[I];
+        llvm::SmallString<128> Buf;
+        Keys[I] = CacheKey(Buf, instantiateTemplate ? kFindScope
+                                                    : kFindScopeNoInstantiation,
+                           diagOnOff, Name);
+        // Also re-cache the hits: committing the transaction invalidates
+        // the cache.
+        ToCache.push_back(I);
+        if (const CachedLookup* Cached = findCached(Keys[I])) {
+          scopes[I] = static_cast<const Decl*>(Cached->m_Result);
+          Types[I] = Cached->m_ResultType;
+          continue;
+        }
+        if (quickFindScope(Name, diagOnOff, &Types[I], instantiateTemplate,
+                           scopes[I]))
+          continue;
+        // ';' separates the names in the buffer; it cannot be in a scope.
+        if (Name.empty() || Name.find(';') != llvm::StringRef::npos) {
+          ToFind.push_back(I);
+          continue;
+        }
+        Code += Name;
+        Code += "::";
+        Ends.push_back(Code.size());
+        Code += ";\n";
+        ToParse.push_back(I);
+      }
+
+      if (!ToParse.empty()) {
+        Parser& P = *m_Parser;
+        Sema& S = P.getActions();
+        ParserStateRAII ResetParserState(P, true /*skipToEOF*/);
+        prepareForParsing(P, m_Interpreter, Code,
+                          llvm::StringRef("lookup.scopes.by.name.file"),
+                          diagOnOff);
+        const SourceManager& SM = S.getSourceManager();
+        // Whether Tok is the ';' ending the Nth name.
+        auto isEnd = [&](const Token& Tok, size_t N) {
+          return Tok.is(clang::tok::semi)
+            && SM.getDecomposedExpansionLoc(Tok.getLocation()).second
+               == Ends[N];
+        };
+        for (size_t N = 0, E = ToParse.size(); N < E; ++N) {
+          const size_t I = ToParse[N];
+          // Accept it only if the whole name is a nested-name-specifier;
+          // anything else is looked up on its own, e.g. as a type.
+          bool Parsed = canAnnotateScope(P)
+            && !P.TryAnnotateCXXScopeToken(false)
+            && P.getCurToken().is(tok::annot_cxxscope)
+            && isEnd(P.NextToken(), N);
+          if (Parsed) {
+            CXXScopeSpec SS;
+            S.RestoreNestedNameSpecifierAnnotation(
+                                         P.getCurToken().getAnnotationValue(),
+                                         P.getCurToken().getAnnotationRange(),
+                                         SS);
+            Parsed = SS.isValid();
+            if (Parsed)
+              scopes[I] = findScopeFromSpec(SS, &Types[I],
+                                            instantiateTemplate);
+          }
+          if (!Parsed) {
+            // Doesn't reset the diagnostic mappings
+            S.getDiagnostics().Reset(/*soft=*/true);
+            ToFind.push_back(I);
+          }
+          // Past the annotation, or what the parser choked on.
+          if (!isEnd(P.getCurToken(), N))
+            P.SkipUntil(clang::tok::semi, Parser::StopBeforeMatch);
+          // Unbalanced brackets make the parser skip to another name's
+          // ';': the names after it cannot be told apart anymore.
+          if (!isEnd(P.getCurToken(), N)) {
+            ToFind.append(ToParse.begin() + N + 1, ToParse.end());
+            break;
+          }
+          P.ConsumeToken();
+        }
+      }
+
+      for (size_t I: ToFind)
+        scopes[I] = findScopeImpl(classNames[I], diagOnOff, &Types[I],
+                                  instantiateTemplate);
+    }
+
+    // After the transaction was committed, which invalidates the cache.
+    for (size_t I: ToCache)
+      addToCache(Keys[I], scopes[I], Types[I], diagOnOff);
+    if (resultTypes)
+      resultTypes->assign(Types.begin(), Types.end());
+  }
+
+  const ClassTemplateDecl*
+  LookupHelper::findClassTemplateImpl(llvm::StringRef Name,
+                                      DiagSetting diagOnOff) const {
     //
     //  Find a class template decl given its name.
     //
@@ -1690,13 +2095,19 @@ namespace cling {
                                   DiagSetting diagOnOff, bool objectIsConst) const {
     assert(scopeDecl && "Decl cannot be null");
 
-    return execFindFunction<ExprFromTypes>(*m_Parser, m_Interpreter,
-                                           scopeDecl,
-                                           funcName,
-                                           funcProto,
-                                           objectIsConst,
-                                           overloadFunctionSelector,
-                                           diagOnOff);
+    llvm::SmallString<128> Buf;
+    llvm::StringRef Key
+      = FunctionCacheKey(Buf, kFindFunctionProtoTypes, diagOnOff, scopeDecl,
+                         funcName, objectIsConst, funcProto);
+    return findCachedFunction(Key, diagOnOff, [&]() {
+      return execFindFunction<ExprFromTypes>(*m_Parser, m_Interpreter,
+                                             scopeDecl,
+                                             funcName,
+                                             funcProto,
+                                             objectIsConst,
+                                             overloadFunctionSelector,
+                                             diagOnOff);
+    });
   }
 
   const FunctionDecl* LookupHelper::findFunctionProto(const Decl* scopeDecl,
@@ -1706,13 +2117,19 @@ namespace cling {
                                                       bool objectIsConst) const{
     assert(scopeDecl && "Decl cannot be null");
 
-    return execFindFunction<ParseProto>(*m_Parser, m_Interpreter,
-                                        scopeDecl,
-                                        funcName,
-                                        funcProto,
-                                        objectIsConst,
-                                        overloadFunctionSelector,
-                                        diagOnOff);
+    llvm::SmallString<128> Buf;
+    llvm::StringRef Key
+      = FunctionCacheKey(Buf, kFindFunctionProto, diagOnOff, scopeDecl,
+                         funcName, objectIsConst, funcProto);
+    return findCachedFunction(Key, diagOnOff, [&]() {
+      return execFindFunction<ParseProto>(*m_Parser, m_Interpreter,
+                                          scopeDecl,
+                                          funcName,
+                                          funcProto,
+                                          objectIsConst,
+                                          overloadFunctionSelector,
+                                          diagOnOff);
+    });
   }
 
   const FunctionDecl*
@@ -1723,13 +2140,19 @@ namespace cling {
                                    bool objectIsConst) const {
     assert(scopeDecl && "Decl cannot be null");
 
-    return execFindFunction<ParseProto>(*m_Parser, m_Interpreter,
-                                        scopeDecl,
-                                        funcName,
-                                        funcProto,
-                                        objectIsConst,
-                                        matchFunctionSelector,
-                                        diagOnOff);
+    llvm::SmallString<128> Buf;
+    llvm::StringRef Key
+      = FunctionCacheKey(Buf, kMatchFunctionProto, diagOnOff, scopeDecl,
+                         funcName, objectIsConst, funcProto);
+    return findCachedFunction(Key, diagOnOff, [&]() {
+      return execFindFunction<ParseProto>(*m_Parser, m_Interpreter,
+                                          scopeDecl,
+                                          funcName,
+                                          funcProto,
+                                          objectIsConst,
+                                          matchFunctionSelector,
+                                          diagOnOff);
+    });
   }
 
   const FunctionDecl*
@@ -1740,13 +2163,19 @@ namespace cling {
                                    bool objectIsConst) const {
     assert(scopeDecl && "Decl cannot be null");
 
-    return execFindFunction<ExprFromTypes>(*m_Parser, m_Interpreter,
-                                           scopeDecl,
-                                           funcName,
-                                           funcProto,
-                                           objectIsConst,
-                                           matchFunctionSelector,
-                                           diagOnOff);
+    llvm::SmallString<128> Buf;
+    llvm::StringRef Key
+      = FunctionCacheKey(Buf, kMatchFunctionProtoTypes, diagOnOff, scopeDecl,
+                         funcName, objectIsConst, funcProto);
+    return findCachedFunction(Key, diagOnOff, [&]() {
+      return execFindFunction<ExprFromTypes>(*m_Parser, m_Interpreter,
+                                             scopeDecl,
+                                             funcName,
+                                             funcProto,
+                                             objectIsConst,
+                                             matchFunctionSelector,
+                                             diagOnOff);
+    });
   }
 
   struct ParseArgs {
@@ -1833,13 +2262,19 @@ namespace cling {
                                  bool objectIsConst) const {
     assert(scopeDecl && "Decl cannot be null");
 
-    return execFindFunction<ParseArgs>(*m_Parser, m_Interpreter,
-                                       scopeDecl,
-                                       funcName,
-                                       funcArgs,
-                                       objectIsConst,
-                                       overloadFunctionSelector,
-                                       diagOnOff);
+    llvm::SmallString<128> Buf;
+    llvm::StringRef Key
+      = FunctionCacheKey(Buf, kFindFunctionArgs, diagOnOff, scopeDecl,
+                         funcName, objectIsConst, funcArgs);
+    return findCachedFunction(Key, diagOnOff, [&]() {
+      return execFindFunction<ParseArgs>(*m_Parser, m_Interpreter,
+                                         scopeDecl,
+                                         funcName,
+                                         funcArgs,
+                                         objectIsConst,
+                                         overloadFunctionSelector,
+                                         diagOnOff);
+    });
   }
 
   void LookupHelper::findArgList(llvm::StringRef argList,
@@ -0,0 +1,132 @@
+//--------------------------------------------------------------------*- C++ -*-
+// CLING - the C++ LLVM-based InterpreterG :)
+//
+// This file is dual-licensed: you can choose to license it under the University
+// of Illinois Open Source License or the GNU Lesser General Public License. See
+// LICENSE.TXT for details.
+//------------------------------------------------------------------------------
+
+#include "ParallelCompiler.h"
+
+#include "JITStubs.h"
+
+#include "llvm/Bitcode/BitcodeReader.h"
+#include "llvm/Bitcode/BitcodeWriter.h"
+#include "llvm/ExecutionEngine/Orc/CompileUtils.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Target/TargetMachine.h"
+#include "llvm/Transforms/Utils/Cloning.h"
+#include "llvm/Transforms/Utils/SplitModule.h"
+
+#include <algorithm>
+
+using namespace llvm;
+
+namespace {
+  ///\brief Below this many function definitions per partition the cost of
+  /// cloning and serializing outweighs the parallel speedup.
+  enum { kMinFunctionsPerPartition = 32 };
+}
+
+namespace cling {
+
+ParallelCompiler::ParallelCompiler(TargetMachine& TM,
+                                   unsigned NumThreads):
+  m_TM(TM), m_NumThreads(NumThreads), m_Pool(NumThreads) {}
+
+ParallelCompiler::~ParallelCompiler() {
+  // Jobs write into m_Jobs' entries; let them finish before those go away.
+  m_Pool.wait();
+}
+
+std::unique_ptr<TargetMachine> ParallelCompiler::createTargetMachine() const {
+  return std::unique_ptr<TargetMachine>(
+    m_TM.getTarget().createTargetMachine(m_TM.getTargetTriple().str(),
+                                         m_TM.getTargetCPU(),
+                                         m_TM.getTargetFeatureString(),
+                                         m_TM.Options,
+                                         m_TM.getRelocationModel(),
+                                         m_TM.getCodeModel(),
+                                         m_TM.getOptLevel()));
+}
+
+void ParallelCompiler::runJob(Job& J, TargetMachine& TM) {
+  // LLVMContexts are not thread-safe: every job gets its own.
+  LLVMContext Ctx;
+  Expected<std::unique_ptr<Module>> ModOrErr
+    = parseBitcodeFile(MemoryBufferRef(J.Bitcode, "cling-partition"), Ctx);
+  if (!ModOrErr) {
+    // Leave J.Object empty; the module is then compiled on the main thread.
+    consumeError(ModOrErr.takeError());
+    return;
+  }
+  J.Object = orc::SimpleCompiler(TM)(**ModOrErr);
+  J.Bitcode.clear();
+}
+
+std::vector<std::unique_ptr<Module>>
+ParallelCompiler::partition(Module& M) {
+  std::vector<std::unique_ptr<Module>> Parts;
+  unsigned NumDefs = 0;
+  for (const Function& F: M)
+    if (!F.isDeclaration())
+      ++NumDefs;
+
+  const unsigned N = std::min(m_NumThreads,
+                              NumDefs / (unsigned)kMinFunctionsPerPartition);
+  if (N < 2)
+    return Parts;
+
+  // Split a clone: the transaction keeps M for its static initializers and
+  // for unloading.
+  std::unique_ptr<Module> Clone = CloneModule(&M);
+  // The partitions refer to each other's locals, which SplitModule() makes
+  // external under their own names. Make these unique to M, or they would
+  // bind to another transaction's locals of the same name.
+  stubs::nameLocals(*Clone);
+  SplitModule(std::move(Clone), N,
+              [&](std::unique_ptr<Module> Part) {
+                Parts.push_back(std::move(Part));
+              }, false /*PreserveLocals*/);
+  return Parts;
+}
+
+void ParallelCompiler::enqueue(Module& M) {
+  std::unique_ptr<Job>& J = m_Jobs[&M];
+  J.reset(new Job());
+  {
+    raw_string_ostream OS(J->Bitcode);
+    WriteBitcodeToFile(&M, OS);
+  }
+
+  // Snapshot the TargetMachine configuration now: BackendPasses adjusts the
+  // opt level of m_TM for each module.
+  std::shared_ptr<TargetMachine> TM(createTargetMachine());
+  Job* PJ = J.get();
+  J->Done = m_Pool.async([PJ, TM]() { runJob(*PJ, *TM); });
+}
+
+ParallelCompiler::ObjectT ParallelCompiler::operator()(Module& M) {
+  auto IJob = m_Jobs.find(&M);
+  if (IJob != m_Jobs.end()) {
+    std::unique_ptr<Job> J = std::move(IJob->second);
+    m_Jobs.erase(IJob);
+    J->Done.wait();
+    if (J->Object.getBinary())
+      return std::move(J->Object);
+  }
+  return orc::SimpleCompiler(m_TM)(M);
+}
+
+void ParallelCompiler::forget(const Module* M) {
+  auto IJob = m_Jobs.find(M);
+  if (IJob == m_Jobs.end())
+    return;
+  IJob->second->Done.wait();
+  m_Jobs.erase(IJob);
+}
+
+} // end namespace cling
@@ -0,0 +1,84 @@
+//--------------------------------------------------------------------*- C++ -*-
+// CLING - the C++ LLVM-based InterpreterG :)
+//
+// This file is dual-licensed: you can choose to license it under the University
+// of Illinois Open Source License or the GNU Lesser General Public License. See
+// LICENSE.TXT for details.
+//------------------------------------------------------------------------------
+
+#ifndef CLING_PARALLEL_COMPILER_H
+#define CLING_PARALLEL_COMPILER_H
+
+#include "llvm/Object/Binary.h"
+#include "llvm/Object/ObjectFile.h"
+#include "llvm/Support/ThreadPool.h"
+
+#include <future>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace llvm {
+  class Module;
+  class TargetMachine;
+}
+
+namespace cling {
+
+  ///\brief Compiles modules handed to the JIT on a pool of worker threads.
+  ///
+  /// Large modules are split into partitions (see llvm::SplitModule) which
+  /// are serialized to bitcode on the calling thread and then compiled, each
+  /// in a private LLVMContext with a private TargetMachine, in the
+  /// background. The JIT's compile layer picks up the resulting objects in
+  /// the order of the module set it was given, so link order is unchanged.
+  ///
+  class ParallelCompiler {
+  public:
+    typedef llvm::object::OwningBinary<llvm::object::ObjectFile> ObjectT;
+
+  private:
+    struct Job {
+      std::string Bitcode;
+      ObjectT Object;
+      std::shared_future<void> Done;
+    };
+
+    ///\brief The TargetMachine whose configuration the workers replicate.
+    llvm::TargetMachine& m_TM;
+
+    ///\brief Number of worker threads.
+    unsigned m_NumThreads;
+
+    ///\brief Compilations in flight or finished but not yet collected.
+    std::map<const llvm::Module*, std::unique_ptr<Job>> m_Jobs;
+
+    llvm::ThreadPool m_Pool;
+
+    std::unique_ptr<llvm::TargetMachine> createTargetMachine() const;
+    static void runJob(Job& J, llvm::TargetMachine& TM);
+
+  public:
+    ParallelCompiler(llvm::TargetMachine& TM, unsigned NumThreads);
+    ~ParallelCompiler();
+
+    ///\brief Split M into partitions worth compiling on separate threads.
+    ///\returns the partitions, or nothing if M is too small to benefit.
+    std::vector<std::unique_ptr<llvm::Module>> partition(llvm::Module& M);
+
+    ///\brief Start compiling M in the background.
+    void enqueue(llvm::Module& M);
+
+    ///\brief Return the object compiled for M, waiting for its job as needed.
+    /// Modules that were not enqueued are compiled on the calling thread.
+    ObjectT operator()(llvm::Module& M);
+
+    ///\brief Drop the (pending) job for M, e.g. when M gets unloaded or its
+    /// object is found in the object cache.
+    void forget(const llvm::Module* M);
+  };
+
+} // end namespace cling
+
+#endif // CLING_PARALLEL_COMPILER_H
@@ -0,0 +1,321 @@
+//--------------------------------------------------------------------*- C++ -*-
+// CLING - the C++ LLVM-based InterpreterG :)
+//
+// This file is dual-licensed: you can choose to license it under the University
+// of Illinois Open Source License or the GNU Lesser General Public License. See
+// LICENSE.TXT for details.
+//------------------------------------------------------------------------------
+
+#include "PerfJITEventListener.h"
+
+#include "cling/Utils/Output.h"
+
+#include "llvm/ExecutionEngine/JITEventListener.h"
+
+#if defined(__linux__)
+
+#include "llvm/DebugInfo/DIContext.h"
+#include "llvm/DebugInfo/DWARF/DWARFContext.h"
+#include "llvm/Object/ObjectFile.h"
+#include "llvm/Object/SymbolSize.h"
+#include "llvm/Support/Errno.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/Process.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <mutex>
+#include <string>
+
+#include <elf.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+using namespace llvm;
+
+namespace {
+  // See tools/perf/Documentation/jitdump-specification.txt in the Linux
+  // kernel sources.
+  enum {
+    kJitDumpMagic = 0x4A695444, // "JiTD"
+    kJitDumpVersion = 1,
+    kJitCodeLoad = 0,
+    kJitCodeDebugInfo = 2,
+    kJitCodeClose = 3
+  };
+
+  struct JitDumpHeader {
+    uint32_t Magic;
+    uint32_t Version;
+    uint32_t TotalSize;
+    uint32_t ElfMach;
+    uint32_t Pad1;
+    uint32_t Pid;
+    uint64_t Timestamp;
+    uint64_t Flags;
+  };
+
+  struct JitDumpRecordHeader {
+    uint32_t Id;
+    uint32_t TotalSize;
+    uint64_t Timestamp;
+  };
+
+  struct JitDumpCodeLoad {
+    JitDumpRecordHeader Prefix;
+    uint32_t Pid;
+    uint32_t Tid;
+    uint64_t Vma;
+    uint64_t CodeAddr;
+    uint64_t CodeSize;
+    uint64_t CodeIndex;
+  };
+
+  struct JitDumpDebugInfo {
+    JitDumpRecordHeader Prefix;
+    uint64_t CodeAddr;
+    uint64_t NrEntry;
+  };
+
+  struct JitDumpDebugEntry {
+    uint64_t Addr;
+    int32_t Line;
+    int32_t Discrim;
+  };
+
+  static uint32_t getElfMachine() {
+#if defined(__x86_64__)
+    return EM_X86_64;
+#elif defined(__i386__)
+    return EM_386;
+#elif defined(__aarch64__)
+    return EM_AARCH64;
+#elif defined(__arm__)
+    return EM_ARM;
+#elif defined(__powerpc64__)
+    return EM_PPC64;
+#elif defined(__powerpc__)
+    return EM_PPC;
+#else
+    return EM_NONE;
+#endif
+  }
+
+  ///\brief perf matches jitdump records with samples by CLOCK_MONOTONIC.
+  static uint64_t getTimestamp() {
+    struct timespec TS;
+    if (::clock_gettime(CLOCK_MONOTONIC, &TS))
+      return 0;
+    return (uint64_t)TS.tv_sec * 1000000000 + TS.tv_nsec;
+  }
+
+  class PerfJITEventListener: public JITEventListener {
+    std::unique_ptr<raw_fd_ostream> m_PerfMap;
+    std::unique_ptr<raw_fd_ostream> m_JitDump;
+    ///\brief perf finds the jitdump through this mapping of the file.
+    void* m_Marker = nullptr;
+    size_t m_MarkerSize = 0;
+    uint64_t m_CodeIndex = 0;
+    const uint32_t m_Pid;
+    std::mutex m_Lock;
+
+    bool openPerfMap();
+    bool openJitDump();
+    void writeDebugInfo(uint64_t Addr, const DILineInfoTable& Lines);
+    void writeCodeLoad(StringRef Name, uint64_t Addr, uint64_t Size);
+
+  public:
+    PerfJITEventListener(): m_Pid(::getpid()) {}
+    ~PerfJITEventListener() override;
+
+    bool init() { return openPerfMap() && openJitDump(); }
+
+    void NotifyObjectEmitted(const object::ObjectFile& Obj,
+                             const RuntimeDyld::LoadedObjectInfo& L) override;
+
+    // Neither format has a record for code going away: perf attributes
+    // samples to the latest code loaded at an address, so code reusing the
+    // memory of an unloaded transaction supersedes it.
+  };
+
+  bool PerfJITEventListener::openPerfMap() {
+    std::string Path = "/tmp/perf-" + std::to_string(m_Pid) + ".map";
+    std::error_code EC;
+    m_PerfMap.reset(new raw_fd_ostream(Path, EC, sys::fs::F_Append
+                                                 | sys::fs::F_Text));
+    if (EC) {
+      cling::errs() << "cling::PerfJITEventListener: cannot open '" << Path
+                    << "': " << EC.message() << '\n';
+      m_PerfMap.reset();
+      return false;
+    }
+    return true;
+  }
+
+  bool PerfJITEventListener::openJitDump() {
+    std::string Path = "/tmp";
+    if (const char* Dir = ::getenv("JITDUMPDIR"))
+      Path = Dir;
+    Path += "/jit-" + std::to_string(m_Pid) + ".dump";
+
+    const int FD = ::open(Path.c_str(), O_CREAT | O_TRUNC | O_RDWR, 0666);
+    if (FD < 0) {
+      cling::errs() << "cling::PerfJITEventListener: cannot open '" << Path
+                    << "': " << sys::StrError() << '\n';
+      return false;
+    }
+
+    // perf record notices the jitdump through an executable mapping of it.
+    m_MarkerSize = sys::Process::getPageSize();
+    m_Marker = ::mmap(nullptr, m_MarkerSize, PROT_READ | PROT_EXEC,
+                      MAP_PRIVATE, FD, 0);
+    if (m_Marker == MAP_FAILED) {
+      cling::errs() << "cling::PerfJITEventListener: cannot map '" << Path
+                    << "': " << sys::StrError() << '\n';
+      m_Marker = nullptr;
+      ::close(FD);
+      return false;
+    }
+
+    m_JitDump.reset(new raw_fd_ostream(FD, true /*shouldClose*/));
+    JitDumpHeader Header = {};
+    Header.Magic = kJitDumpMagic;
+    Header.Version = kJitDumpVersion;
+    Header.TotalSize = sizeof(Header);
+    Header.ElfMach = getElfMachine();
+    Header.Pid = m_Pid;
+    Header.Timestamp = getTimestamp();
+    m_JitDump->write((const char*)&Header, sizeof(Header));
+    m_JitDump->flush();
+    return true;
+  }
+
+  PerfJITEventListener::~PerfJITEventListener() {
+    if (m_JitDump) {
+      JitDumpRecordHeader Close = {};
+      Close.Id = kJitCodeClose;
+      Close.TotalSize = sizeof(Close);
+      Close.Timestamp = getTimestamp();
+      m_JitDump->write((const char*)&Close, sizeof(Close));
+      m_JitDump.reset();
+    }
+    if (m_Marker)
+      ::munmap(m_Marker, m_MarkerSize);
+  }
+
+  void PerfJITEventListener::writeDebugInfo(uint64_t Addr,
+                                            const DILineInfoTable& Lines) {
+    JitDumpDebugInfo Rec = {};
+    Rec.Prefix.Id = kJitCodeDebugInfo;
+    Rec.Prefix.TotalSize = sizeof(Rec);
+    Rec.Prefix.Timestamp = getTimestamp();
+    Rec.CodeAddr = Addr;
+    Rec.NrEntry = Lines.size();
+    for (const auto& AddrLine: Lines)
+      Rec.Prefix.TotalSize += sizeof(JitDumpDebugEntry)
+        + AddrLine.second.FileName.size() + 1;
+    m_JitDump->write((const char*)&Rec, sizeof(Rec));
+
+    for (const auto& AddrLine: Lines) {
+      JitDumpDebugEntry Entry = {};
+      Entry.Addr = AddrLine.first;
+      Entry.Line = AddrLine.second.Line;
+      m_JitDump->write((const char*)&Entry, sizeof(Entry));
+      const std::string& File = AddrLine.second.FileName;
+      m_JitDump->write(File.c_str(), File.size() + 1);
+    }
+  }
+
+  void PerfJITEventListener::writeCodeLoad(StringRef Name, uint64_t Addr,
+                                           uint64_t Size) {
+    JitDumpCodeLoad Rec = {};
+    Rec.Prefix.Id = kJitCodeLoad;
+    Rec.Prefix.TotalSize = sizeof(Rec) + Name.size() + 1 + Size;
+    Rec.Prefix.Timestamp = getTimestamp();
+    Rec.Pid = m_Pid;
+    Rec.Tid = ::syscall(SYS_gettid);
+    Rec.Vma = Addr;
+    Rec.CodeAddr = Addr;
+    Rec.CodeSize = Size;
+    Rec.CodeIndex = m_CodeIndex++;
+    m_JitDump->write((const char*)&Rec, sizeof(Rec));
+    m_JitDump->write(Name.data(), Name.size());
+    m_JitDump->write('\0');
+    // The code is relocated by now, see IncrementalJIT::NotifyObjectsFinalized.
+    m_JitDump->write((const char*)(uintptr_t)Addr, Size);
+  }
+
+  void PerfJITEventListener::NotifyObjectEmitted(
+                                      const object::ObjectFile& Obj,
+                                      const RuntimeDyld::LoadedObjectInfo& L) {
+    // Symbol addresses of the debug object are those the code was loaded to.
+    object::OwningBinary<object::ObjectFile> DebugObjOwner
+      = L.getObjectForDebug(Obj);
+    const object::ObjectFile* DebugObj = DebugObjOwner.getBinary();
+    if (!DebugObj)
+      return;
+    DWARFContextInMemory Context(*DebugObj);
+
+    std::lock_guard<std::mutex> Lock(m_Lock);
+    for (const auto& SymSize: object::computeSymbolSizes(*DebugObj)) {
+      const object::SymbolRef& Sym = SymSize.first;
+      Expected<object::SymbolRef::Type> Type = Sym.getType();
+      if (!Type) {
+        consumeError(Type.takeError());
+        continue;
+      }
+      if (*Type != object::SymbolRef::ST_Function)
+        continue;
+      Expected<StringRef> Name = Sym.getName();
+      if (!Name) {
+        consumeError(Name.takeError());
+        continue;
+      }
+      Expected<uint64_t> Addr = Sym.getAddress();
+      if (!Addr) {
+        consumeError(Addr.takeError());
+        continue;
+      }
+      const uint64_t Size = SymSize.second;
+      if (!*Addr || !Size)
+        continue;
+
+      *m_PerfMap << format_hex_no_prefix(*Addr, 1) << ' '
+                 << format_hex_no_prefix(Size, 1) << ' ' << *Name << '\n';
+
+      // Line tables must precede the code they describe.
+      DILineInfoTable Lines
+        = Context.getLineInfoForAddressRange(*Addr, Size,
+                   DILineInfoSpecifier(
+                     DILineInfoSpecifier::FileLineInfoKind::AbsoluteFilePath));
+      if (!Lines.empty())
+        writeDebugInfo(*Addr, Lines);
+      writeCodeLoad(*Name, *Addr, Size);
+    }
+    m_PerfMap->flush();
+    m_JitDump->flush();
+  }
+} // unnamed namespace
+
+namespace cling {
+  std::unique_ptr<JITEventListener> createPerfJITEventListener() {
+    std::unique_ptr<PerfJITEventListener> Listener(new PerfJITEventListener());
+    if (!Listener->init())
+      return nullptr;
+    return std::move(Listener);
+  }
+} // end namespace cling
+
+#else // __linux__
+
+namespace cling {
+  std::unique_ptr<llvm::JITEventListener> createPerfJITEventListener() {
+    cling::errs() << "cling::PerfJITEventListener: perf is only supported "
+                     "on Linux\n";
+    return nullptr;
+  }
+} // end namespace cling
+
+#endif // __linux__
@@ -0,0 +1,35 @@
+//--------------------------------------------------------------------*- C++ -*-
+// CLING - the C++ LLVM-based InterpreterG :)
+//
+// This file is dual-licensed: you can choose to license it under the University
+// of Illinois Open Source License or the GNU Lesser General Public License. See
+// LICENSE.TXT for details.
+//------------------------------------------------------------------------------
+
+#ifndef CLING_PERF_JIT_EVENT_LISTENER_H
+#define CLING_PERF_JIT_EVENT_LISTENER_H
+
+#include <memory>
+
+namespace llvm {
+  class JITEventListener;
+}
+
+namespace cling {
+
+  ///\brief Create a listener telling the Linux perf tool about JIT-compiled
+  /// functions.
+  ///
+  /// Each function is appended to /tmp/perf-<pid>.map, which `perf report`
+  /// picks up directly, and to a jitdump file jit-<pid>.dump in $JITDUMPDIR
+  /// (or /tmp), holding the code and line tables, if the code was compiled
+  /// with debug info. Profiles recorded with `perf record -k 1` can be
+  /// combined with it through `perf inject --jit`.
+  ///
+  ///\returns nullptr if not supported on this platform or if the files
+  /// cannot be created.
+  std::unique_ptr<llvm::JITEventListener> createPerfJITEventListener();
+
+} // end namespace cling
+
+#endif // CLING_PERF_JIT_EVENT_LISTENER_H
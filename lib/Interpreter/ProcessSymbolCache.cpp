@@ -0,0 +1,77 @@
+//--------------------------------------------------------------------*- C++ -*-
+// CLING - the C++ LLVM-based InterpreterG :)
+//
+// This file is dual-licensed: you can choose to license it under the University
+// of Illinois Open Source License or the GNU Lesser General Public License. See
+// LICENSE.TXT for details.
+//------------------------------------------------------------------------------
+
+#include "ProcessSymbolCache.h"
+
+#include "llvm/Support/StringSaver.h"
+
+using namespace llvm;
+
+namespace cling {
+
+bool ProcessSymbolCache::lookup(KeyT Key, JITTargetAddress& Addr) const {
+  std::lock_guard<std::mutex> Lock(m_Lock);
+  auto I = m_Symbols.find(Key);
+  if (I == m_Symbols.end())
+    return false;
+  Addr = I->second;
+  return true;
+}
+
+void ProcessSymbolCache::lookup(ArrayRef<KeyT> Keys,
+                                MutableArrayRef<JITTargetAddress> Addrs,
+                                SmallVectorImpl<unsigned>& Misses) const {
+  assert(Keys.size() == Addrs.size() && "One address per key!");
+  std::lock_guard<std::mutex> Lock(m_Lock);
+  for (unsigned I = 0, N = Keys.size(); I < N; ++I) {
+    auto ISym = m_Symbols.find(Keys[I]);
+    if (ISym == m_Symbols.end())
+      Misses.push_back(I);
+    else
+      Addrs[I] = ISym->second;
+  }
+}
+
+void ProcessSymbolCache::insertImpl(KeyT Key, JITTargetAddress Addr) {
+  auto I = m_Symbols.find(Key);
+  if (I != m_Symbols.end()) {
+    I->second = Addr;
+    return;
+  }
+  // The key refers to the caller's string; keep our own copy.
+  StringSaver Saver(m_Names);
+  m_Symbols.insert(std::make_pair(KeyT(Saver.save(Key.val()), Key.hash()),
+                                  Addr));
+}
+
+void ProcessSymbolCache::insert(KeyT Key, JITTargetAddress Addr) {
+  std::lock_guard<std::mutex> Lock(m_Lock);
+  insertImpl(Key, Addr);
+}
+
+void ProcessSymbolCache::insert(ArrayRef<KeyT> Keys,
+                                ArrayRef<JITTargetAddress> Addrs) {
+  assert(Keys.size() == Addrs.size() && "One address per key!");
+  std::lock_guard<std::mutex> Lock(m_Lock);
+  for (unsigned I = 0, N = Keys.size(); I < N; ++I)
+    insertImpl(Keys[I], Addrs[I]);
+}
+
+void ProcessSymbolCache::erase(KeyT Key) {
+  std::lock_guard<std::mutex> Lock(m_Lock);
+  // The name stays in m_Names until clear().
+  m_Symbols.erase(Key);
+}
+
+void ProcessSymbolCache::clear() {
+  std::lock_guard<std::mutex> Lock(m_Lock);
+  m_Symbols.clear();
+  m_Names.Reset();
+}
+
+} // end namespace cling
@@ -0,0 +1,69 @@
+//--------------------------------------------------------------------*- C++ -*-
+// CLING - the C++ LLVM-based InterpreterG :)
+//
+// This file is dual-licensed: you can choose to license it under the University
+// of Illinois Open Source License or the GNU Lesser General Public License. See
+// LICENSE.TXT for details.
+//------------------------------------------------------------------------------
+
+#ifndef CLING_PROCESS_SYMBOL_CACHE_H
+#define CLING_PROCESS_SYMBOL_CACHE_H
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/CachedHashString.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ExecutionEngine/JITSymbol.h"
+#include "llvm/Support/Allocator.h"
+
+#include <mutex>
+
+namespace cling {
+
+  ///\brief Remembers the outcome of looking up symbols in the process, i.e.
+  /// in the binary and all loaded libraries: the address, or that the symbol
+  /// does not exist (a zero address).
+  ///
+  /// Keys carry their hash, so that it is computed once per name also when
+  /// resolving the symbols of a whole object (see lookup(ArrayRef)). The
+  /// cache must be cleared whenever the set of loaded libraries changes.
+  ///
+  class ProcessSymbolCache {
+  public:
+    typedef llvm::CachedHashStringRef KeyT;
+
+  private:
+    llvm::BumpPtrAllocator m_Names;
+    llvm::DenseMap<KeyT, llvm::JITTargetAddress> m_Symbols;
+    mutable std::mutex m_Lock;
+
+    void insertImpl(KeyT Key, llvm::JITTargetAddress Addr);
+
+  public:
+    ///\brief Find the cached address of Key.
+    ///\returns Whether Key was cached; Addr is 0 if the symbol is known not
+    /// to exist.
+    bool lookup(KeyT Key, llvm::JITTargetAddress& Addr) const;
+
+    ///\brief Find the cached addresses of Keys.
+    ///\param [out] Addrs - the address of each key, if cached.
+    ///\param [out] Misses - indexes of the keys that were not cached.
+    void lookup(llvm::ArrayRef<KeyT> Keys,
+                llvm::MutableArrayRef<llvm::JITTargetAddress> Addrs,
+                llvm::SmallVectorImpl<unsigned>& Misses) const;
+
+    ///\brief Remember the address of Key; 0 if it is not in the process.
+    void insert(KeyT Key, llvm::JITTargetAddress Addr);
+    void insert(llvm::ArrayRef<KeyT> Keys,
+                llvm::ArrayRef<llvm::JITTargetAddress> Addrs);
+
+    ///\brief Forget Key.
+    void erase(KeyT Key);
+
+    ///\brief Forget all symbols.
+    void clear();
+  };
+
+} // end namespace cling
+
+#endif // CLING_PROCESS_SYMBOL_CACHE_H
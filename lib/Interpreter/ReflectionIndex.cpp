@@ -0,0 +1,221 @@
+//------------------------------------------------------------------------------
+// CLING - the C++ LLVM-based InterpreterG :)
+//
+// This file is dual-licensed: you can choose to license it under the University
+// of Illinois Open Source License or the GNU Lesser General Public License. See
+// LICENSE.TXT for details.
+//------------------------------------------------------------------------------
+
+#include "cling/Interpreter/ReflectionIndex.h"
+
+#include "cling/Interpreter/DeclNameIndex.h"
+#include "cling/Interpreter/Interpreter.h"
+#include "cling/Interpreter/LookupHelper.h"
+
+#include "clang/AST/ASTContext.h"
+#include "clang/AST/DeclCXX.h"
+#include "clang/AST/RecordLayout.h"
+#include "clang/Frontend/CompilerInstance.h"
+
+using namespace clang;
+
+namespace {
+  using cling::ReflectionIndex;
+
+  ///\brief Take what ND tells about its name into E.
+  static void Describe(const NamedDecl* ND, ASTContext& Context,
+                       ReflectionIndex::Entry& E) {
+    if (const NamespaceDecl* NSD = dyn_cast<NamespaceDecl>(ND)) {
+      E.m_Scope = NSD->getCanonicalDecl();
+    } else if (const NamespaceAliasDecl* NAD
+                 = dyn_cast<NamespaceAliasDecl>(ND)) {
+      E.m_Scope = NAD->getNamespace()->getCanonicalDecl();
+    } else if (const TagDecl* TD = dyn_cast<TagDecl>(ND)) {
+      E.m_Type = Context.getTypeDeclType(TD).getAsOpaquePtr();
+      if (const TagDecl* Def = TD->getDefinition())
+        E.m_Scope = Def;
+    } else if (const TypedefNameDecl* TND = dyn_cast<TypedefNameDecl>(ND)) {
+      QualType QT = Context.getTypedefType(TND);
+      E.m_Type = QT.getAsOpaquePtr();
+      if (const TagType* TT = QT->getAs<TagType>())
+        if (const TagDecl* Def = TT->getDecl()->getDefinition())
+          E.m_Scope = Def;
+    } else if (const FunctionDecl* FD = dyn_cast<FunctionDecl>(ND)) {
+      if (!E.m_Function)
+        E.m_Function = FD;
+    }
+  }
+} // unnamed namespace
+
+namespace cling {
+
+  void ReflectionIndex::Entry::merge(const Entry& Other) {
+    if (!m_Scope)
+      m_Scope = Other.m_Scope;
+    if (!m_Type)
+      m_Type = Other.m_Type;
+    if (!m_Function)
+      m_Function = Other.m_Function;
+    if (m_Offset < 0)
+      m_Offset = Other.m_Offset;
+  }
+
+  ReflectionIndex::UpdateRAII::UpdateRAII(ReflectionIndex* Index,
+                                          bool Unloading): m_Index(Index) {
+    if (!m_Index)
+      return;
+    if (!m_Index->m_UpdateDepth++)
+      ++m_Index->m_Generation;
+    // Stop answering queries with declarations that are about to go.
+    if (Unloading)
+      m_Index->clear();
+  }
+
+  ReflectionIndex::UpdateRAII::~UpdateRAII() {
+    if (m_Index && !--m_Index->m_UpdateDepth)
+      ++m_Index->m_Generation;
+  }
+
+  ReflectionIndex::ReflectionIndex(Interpreter& Interp):
+    m_Interpreter(Interp), m_Generation(0), m_UpdateDepth(0) {}
+
+  ReflectionIndex::~ReflectionIndex() {}
+
+  void ReflectionIndex::publish(llvm::StringMap<Entry>&& Names) {
+    if (Names.empty())
+      return;
+    auto Next = std::make_shared<Snapshot>();
+    Next->m_Names = std::move(Names);
+    // Merge older snapshots that are not larger than the new one, keeping
+    // the number of snapshots logarithmic in the number of names.
+    std::shared_ptr<const Snapshot> Prev = std::atomic_load(&m_Current);
+    while (Prev && Prev->m_Names.size() <= Next->m_Names.size()) {
+      for (const auto& Older: Prev->m_Names)
+        Next->m_Names[Older.getKey()].merge(Older.getValue());
+      Prev = Prev->m_Prev;
+    }
+    Next->m_Prev = std::move(Prev);
+    std::atomic_store(&m_Current,
+                      std::shared_ptr<const Snapshot>(std::move(Next)));
+  }
+
+  bool ReflectionIndex::find(llvm::StringRef Name, Entry& Result) const {
+    const unsigned Generation = m_Generation.load();
+    if (Generation & 1)
+      return false;
+    const std::shared_ptr<const Snapshot> Current
+      = std::atomic_load(&m_Current);
+    for (const Snapshot* S = Current.get(); S; S = S->m_Prev.get()) {
+      auto I = S->m_Names.find(Name);
+      if (I != S->m_Names.end())
+        Result.merge(I->getValue());
+    }
+    return m_Generation.load() == Generation;
+  }
+
+  ReflectionIndex::Entry ReflectionIndex::lookup(llvm::StringRef Name) const {
+    Entry Result;
+    ASTContext& Context = m_Interpreter.getCI()->getASTContext();
+    for (const NamedDecl* ND: m_Interpreter.getDeclNameIndex().find(Name))
+      Describe(ND, Context, Result);
+    return Result;
+  }
+
+  void ReflectionIndex::clear() {
+    std::atomic_store(&m_Current, std::shared_ptr<const Snapshot>());
+  }
+
+  QualType ReflectionIndex::findType(llvm::StringRef Name) {
+    Name = DeclNameIndex::normalizeName(Name);
+    Entry Known;
+    if (find(Name, Known) && Known.m_Type)
+      return QualType::getFromOpaquePtr(Known.m_Type);
+
+    std::lock_guard<std::mutex> Lock(m_Lock);
+    QualType QT = QualType::getFromOpaquePtr(lookup(Name).m_Type);
+    if (QT.isNull())
+      QT = m_Interpreter.getLookupHelper()
+        .findType(Name, LookupHelper::NoDiagnostics);
+    if (!QT.isNull()) {
+      llvm::StringMap<Entry> Names;
+      Names[Name].m_Type = QT.getAsOpaquePtr();
+      publish(std::move(Names));
+    }
+    return QT;
+  }
+
+  const Decl* ReflectionIndex::findScope(llvm::StringRef Name) {
+    Name = DeclNameIndex::normalizeName(Name);
+    Entry Known;
+    if (find(Name, Known) && Known.m_Scope)
+      return Known.m_Scope;
+
+    std::lock_guard<std::mutex> Lock(m_Lock);
+    const Decl* Scope = lookup(Name).m_Scope;
+    if (!Scope)
+      Scope = m_Interpreter.getLookupHelper()
+        .findScope(Name, LookupHelper::NoDiagnostics);
+    if (Scope) {
+      llvm::StringMap<Entry> Names;
+      Names[Name].m_Scope = Scope;
+      publish(std::move(Names));
+    }
+    return Scope;
+  }
+
+  const FunctionDecl* ReflectionIndex::findAnyFunction(llvm::StringRef Name) {
+    Name = DeclNameIndex::normalizeName(Name);
+    Entry Known;
+    if (find(Name, Known) && Known.m_Function)
+      return Known.m_Function;
+
+    std::lock_guard<std::mutex> Lock(m_Lock);
+    const LookupHelper& LH = m_Interpreter.getLookupHelper();
+    const FunctionDecl* FD = lookup(Name).m_Function;
+    if (!FD) {
+      const size_t Sep = Name.rfind("::");
+      if (Sep == llvm::StringRef::npos)
+        FD = LH.findAnyFunction(Name, LookupHelper::NoDiagnostics);
+      else if (const Decl* Scope = LH.findScope(Name.substr(0, Sep),
+                                                LookupHelper::NoDiagnostics))
+        FD = LH.findAnyFunction(Scope, Name.substr(Sep + 2),
+                                LookupHelper::NoDiagnostics);
+    }
+    if (FD) {
+      llvm::StringMap<Entry> Names;
+      Names[Name].m_Function = FD;
+      publish(std::move(Names));
+    }
+    return FD;
+  }
+
+  int64_t ReflectionIndex::getDataMemberOffset(llvm::StringRef Scope,
+                                               llvm::StringRef Member) {
+    const std::string Name
+      = DeclNameIndex::normalizeName(Scope).str() + "::" + Member.str();
+    Entry Known;
+    if (find(Name, Known) && Known.m_Offset >= 0)
+      return Known.m_Offset;
+
+    std::lock_guard<std::mutex> Lock(m_Lock);
+    const LookupHelper& LH = m_Interpreter.getLookupHelper();
+    const Decl* ScopeDecl = LH.findScope(DeclNameIndex::normalizeName(Scope),
+                                         LookupHelper::NoDiagnostics);
+    if (!ScopeDecl)
+      return -1;
+    const FieldDecl* FD = dyn_cast_or_null<FieldDecl>(
+      LH.findDataMember(ScopeDecl, Member, LookupHelper::NoDiagnostics));
+    if (!FD || FD->isBitField() || FD->getParent()->isDependentContext()
+        || FD->getParent()->isInvalidDecl()
+        || !FD->getParent()->isCompleteDefinition())
+      return -1;
+    ASTContext& C = m_Interpreter.getCI()->getASTContext();
+    const ASTRecordLayout& Layout = C.getASTRecordLayout(FD->getParent());
+    const int64_t Offset = C.toCharUnitsFromBits(
+      Layout.getFieldOffset(FD->getFieldIndex())).getQuantity();
+    llvm::StringMap<Entry> Names;
+    Names[Name].m_Offset = Offset;
+    publish(std::move(Names));
+    return Offset;
+  }
+} // end namespace cling
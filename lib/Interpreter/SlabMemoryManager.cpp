@@ -0,0 +1,273 @@
+//--------------------------------------------------------------------*- C++ -*-
+// CLING - the C++ LLVM-based InterpreterG :)
+//
+// This file is dual-licensed: you can choose to license it under the University
+// of Illinois Open Source License or the GNU Lesser General Public License. See
+// LICENSE.TXT for details.
+//------------------------------------------------------------------------------
+
+#include "SlabMemoryManager.h"
+
+#include "llvm/Support/MathExtras.h"
+#include "llvm/Support/Process.h"
+
+#include <algorithm>
+
+#if defined(__linux__)
+#include <sys/mman.h>
+#endif
+
+using namespace llvm;
+
+namespace {
+  enum {
+    kDefaultSlabSize = 4 * 1024 * 1024,
+    kHugePageSize = 2 * 1024 * 1024
+  };
+
+  static unsigned getFinalPermissions(cling::SlabMemoryManager::PoolKind K) {
+    switch (K) {
+    case cling::SlabMemoryManager::kCode:
+      return sys::Memory::MF_READ | sys::Memory::MF_EXEC;
+    case cling::SlabMemoryManager::kROData:
+      return sys::Memory::MF_READ;
+    default:
+      return sys::Memory::MF_READ | sys::Memory::MF_WRITE;
+    }
+  }
+
+  ///\brief Return [Addr, Addr + Size) to Free, coalescing it with its
+  /// neighbors within the slab [SlabBegin, SlabEnd). Slabs are mapped next
+  /// to each other, but a free range must never span two of them: each is
+  /// unmapped on its own.
+  static void addFree(std::map<uint8_t*, size_t>& Free, uint8_t* Addr,
+                      size_t Size, uint8_t* SlabBegin, uint8_t* SlabEnd) {
+    auto Next = Free.lower_bound(Addr);
+    if (Next != Free.end() && Addr + Size == Next->first
+        && Next->first < SlabEnd) {
+      Size += Next->second;
+      Next = Free.erase(Next);
+    }
+    if (Next != Free.begin() && Addr > SlabBegin) {
+      auto Prev = std::prev(Next);
+      if (Prev->first + Prev->second == Addr) {
+        Prev->second += Size;
+        return;
+      }
+    }
+    Free.emplace_hint(Next, Addr, Size);
+  }
+} // unnamed namespace
+
+namespace cling {
+
+SlabMemoryManager::SlabMemoryManager():
+  m_PageSize(sys::Process::getPageSize()), m_SlabSize(kDefaultSlabSize),
+  m_HugePages(false) {}
+
+SlabMemoryManager::~SlabMemoryManager() {
+  for (Pool& P: m_Pools)
+    for (auto& BaseSlab: P.Slabs)
+      sys::Memory::releaseMappedMemory(BaseSlab.second.Block);
+}
+
+void SlabMemoryManager::setUseHugePages(bool Use) {
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+  m_HugePages = Use;
+  if (m_HugePages)
+    m_SlabSize = alignTo(m_SlabSize, kHugePageSize);
+#else
+  (void)Use;
+#endif
+}
+
+SlabMemoryManager::Slab*
+SlabMemoryManager::allocateSlab(PoolKind Kind, size_t MinSize) {
+  size_t Size = std::max(m_SlabSize, (size_t)alignTo(MinSize, m_PageSize));
+  if (m_HugePages)
+    Size += kHugePageSize; // room to align the huge pages within the slab
+
+  // Keep all slabs close together: sections refer to each other through
+  // 32 bit PC-relative relocations (e.g. from .eh_frame).
+  const sys::MemoryBlock* Near = nullptr;
+  for (Pool& P: m_Pools)
+    if (P.Current)
+      Near = &P.Current->Block;
+
+  std::error_code EC;
+  sys::MemoryBlock MB
+    = sys::Memory::allocateMappedMemory(Size, Near,
+                                        sys::Memory::MF_READ
+                                        | sys::Memory::MF_WRITE, EC);
+  if (EC)
+    return nullptr;
+
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+  if (m_HugePages) {
+    const uintptr_t Base = (uintptr_t)MB.base();
+    const uintptr_t Start = alignTo(Base, kHugePageSize);
+    const uintptr_t End = alignDown(Base + MB.size(), kHugePageSize);
+    if (End > Start)
+      ::madvise((void*)Start, End - Start, MADV_HUGEPAGE);
+  }
+#endif
+
+  Slab& S = m_Pools[Kind].Slabs[(uint8_t*)MB.base()];
+  S.Block = MB;
+  return &S;
+}
+
+SlabMemoryManager::Slab& SlabMemoryManager::getSlab(Pool& P, uint8_t* Addr) {
+  auto I = P.Slabs.upper_bound(Addr);
+  assert(I != P.Slabs.begin() && "Address not in any slab!");
+  return (--I)->second;
+}
+
+uint8_t* SlabMemoryManager::allocateFromFree(Pool& P, size_t Size) {
+  for (auto I = P.Free.begin(), E = P.Free.end(); I != E; ++I) {
+    if (I->second < Size)
+      continue;
+    uint8_t* Addr = I->first;
+    const size_t Remaining = I->second - Size;
+    P.Free.erase(I);
+    if (Remaining)
+      P.Free.emplace(Addr + Size, Remaining);
+    return Addr;
+  }
+  return nullptr;
+}
+
+uint8_t* SlabMemoryManager::allocate(PoolKind Kind, uintptr_t Size,
+                                     unsigned Alignment) {
+  if (!Alignment)
+    Alignment = 16;
+
+  // Page granularity: a freed range can change permissions without touching
+  // live neighbors.
+  size_t AllocSize = alignTo(std::max(Size, (uintptr_t)1), m_PageSize);
+  if (Alignment > m_PageSize)
+    AllocSize += Alignment;
+
+  Pool& P = m_Pools[Kind];
+  uint8_t* Start = allocateFromFree(P, AllocSize);
+  if (!Start) {
+    if (!P.Current
+        || P.Current->Block.size() - P.Current->Used < AllocSize) {
+      if (P.Current) {
+        // Leave the tail of the old slab for smaller allocations.
+        uint8_t* Tail = (uint8_t*)P.Current->Block.base() + P.Current->Used;
+        const size_t TailSize = P.Current->Block.size() - P.Current->Used;
+        P.Current->Used = P.Current->Block.size();
+        if (TailSize)
+          addFree(P.Free, Tail, TailSize, (uint8_t*)P.Current->Block.base(),
+                  Tail + TailSize);
+      }
+      P.Current = allocateSlab(Kind, AllocSize);
+      if (!P.Current)
+        return nullptr;
+    }
+    Start = (uint8_t*)P.Current->Block.base() + P.Current->Used;
+    P.Current->Used += AllocSize;
+  }
+  getSlab(P, Start).Live += AllocSize;
+  P.Pending.push_back(sys::MemoryBlock(Start, AllocSize));
+
+  uint8_t* Addr = (uint8_t*)alignTo((uintptr_t)Start, Alignment);
+  Allocation& A = m_Allocations[Addr];
+  A.Kind = Kind;
+  A.Start = Start;
+  A.Size = AllocSize;
+  return Addr;
+}
+
+void SlabMemoryManager::releaseIfUnused(Pool& P, Slab& S) {
+  if (S.Live || &S == P.Current)
+    return;
+  uint8_t* Base = (uint8_t*)S.Block.base();
+  // Free ranges never cross slab boundaries, see addFree().
+  P.Free.erase(P.Free.lower_bound(Base),
+               P.Free.lower_bound(Base + S.Block.size()));
+  sys::Memory::releaseMappedMemory(S.Block);
+  P.Slabs.erase(Base);
+}
+
+void SlabMemoryManager::deallocate(uint8_t* Addr) {
+  auto IAlloc = m_Allocations.find(Addr);
+  if (IAlloc == m_Allocations.end())
+    return;
+  const Allocation A = IAlloc->second;
+  m_Allocations.erase(IAlloc);
+
+  Pool& P = m_Pools[A.Kind];
+  sys::MemoryBlock Block(A.Start, A.Size);
+  auto IPending = std::find_if(P.Pending.begin(), P.Pending.end(),
+                               [&](const sys::MemoryBlock& MB) {
+                                 return MB.base() == Block.base();
+                               });
+  if (IPending != P.Pending.end())
+    P.Pending.erase(IPending);
+  else if (A.Kind != kRWData) {
+    // Free memory stays writable and, more importantly, not executable:
+    // stale calls into unloaded code fault instead of running garbage.
+    sys::Memory::protectMappedMemory(Block, sys::Memory::MF_READ
+                                            | sys::Memory::MF_WRITE);
+  }
+
+  Slab& S = getSlab(P, A.Start);
+  addFree(P.Free, A.Start, A.Size, (uint8_t*)S.Block.base(),
+          (uint8_t*)S.Block.base() + S.Block.size());
+  S.Live -= A.Size;
+  releaseIfUnused(P, S);
+}
+
+uint8_t* SlabMemoryManager::allocateCodeSection(uintptr_t Size,
+                                                unsigned Alignment,
+                                                unsigned /*SectionID*/,
+                                                StringRef /*SectionName*/) {
+  return allocate(kCode, Size, Alignment);
+}
+
+uint8_t* SlabMemoryManager::allocateDataSection(uintptr_t Size,
+                                                unsigned Alignment,
+                                                unsigned /*SectionID*/,
+                                                StringRef /*SectionName*/,
+                                                bool IsReadOnly) {
+  return allocate(IsReadOnly ? kROData : kRWData, Size, Alignment);
+}
+
+bool SlabMemoryManager::finalizeMemory(std::string* ErrMsg) {
+  for (unsigned K = 0; K < kNumPools; ++K) {
+    Pool& P = m_Pools[K];
+    if (P.Pending.empty())
+      continue;
+
+    if (K != kRWData) {
+      // One mprotect per run of adjacent ranges.
+      std::sort(P.Pending.begin(), P.Pending.end(),
+                [](const sys::MemoryBlock& L, const sys::MemoryBlock& R) {
+                  return L.base() < R.base();
+                });
+      const unsigned Perms = getFinalPermissions((PoolKind)K);
+      for (size_t I = 0, N = P.Pending.size(); I < N;) {
+        uint8_t* Start = (uint8_t*)P.Pending[I].base();
+        uint8_t* End = Start + P.Pending[I].size();
+        for (++I; I < N && (uint8_t*)P.Pending[I].base() == End; ++I)
+          End += P.Pending[I].size();
+        sys::MemoryBlock Range(Start, End - Start);
+        if (std::error_code EC = sys::Memory::protectMappedMemory(Range,
+                                                                  Perms)) {
+          if (ErrMsg)
+            *ErrMsg = EC.message();
+          return true;
+        }
+      }
+      if (K == kCode)
+        for (const sys::MemoryBlock& MB: P.Pending)
+          sys::Memory::InvalidateInstructionCache(MB.base(), MB.size());
+    }
+    P.Pending.clear();
+  }
+  return false;
+}
+
+} // end namespace cling
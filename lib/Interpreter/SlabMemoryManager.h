@@ -0,0 +1,114 @@
+//--------------------------------------------------------------------*- C++ -*-
+// CLING - the C++ LLVM-based InterpreterG :)
+//
+// This file is dual-licensed: you can choose to license it under the University
+// of Illinois Open Source License or the GNU Lesser General Public License. See
+// LICENSE.TXT for details.
+//------------------------------------------------------------------------------
+
+#ifndef CLING_SLAB_MEMORY_MANAGER_H
+#define CLING_SLAB_MEMORY_MANAGER_H
+
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ExecutionEngine/RTDyldMemoryManager.h"
+#include "llvm/Support/Memory.h"
+
+#include <map>
+#include <vector>
+
+namespace cling {
+
+  ///\brief Memory manager carving the JIT's sections out of large slabs.
+  ///
+  /// Code, read-only and read-write data each come from their own pool of
+  /// slabs. Allocations are page granular, so that memory can be returned
+  /// to a pool (see deallocate()) when a transaction is unloaded and reused
+  /// by later ones without ever sharing a page with live code. Slabs that
+  /// become entirely free are unmapped. Permissions of everything allocated
+  /// since the last finalizeMemory() are applied in one go, coalescing
+  /// adjacent ranges. On Linux, slabs can be backed by transparent huge
+  /// pages.
+  ///
+  class SlabMemoryManager: public llvm::RTDyldMemoryManager {
+  public:
+    enum PoolKind {
+      kCode,
+      kROData,
+      kRWData,
+      kNumPools
+    };
+
+  private:
+    struct Slab {
+      llvm::sys::MemoryBlock Block;
+      ///\brief Bump pointer offset.
+      size_t Used = 0;
+      ///\brief Bytes handed out and not yet deallocated.
+      size_t Live = 0;
+    };
+
+    struct Pool {
+      ///\brief Slabs by base address.
+      std::map<uint8_t*, Slab> Slabs;
+      ///\brief The slab currently bump-allocated from.
+      Slab* Current = nullptr;
+      ///\brief Deallocated ranges (start -> size), coalesced within each
+      /// slab.
+      std::map<uint8_t*, size_t> Free;
+      ///\brief Ranges allocated since the last finalizeMemory().
+      std::vector<llvm::sys::MemoryBlock> Pending;
+    };
+
+    struct Allocation {
+      PoolKind Kind;
+      ///\brief Page-aligned start of the range; the returned address might
+      /// be further aligned.
+      uint8_t* Start;
+      size_t Size;
+    };
+
+    Pool m_Pools[kNumPools];
+    llvm::DenseMap<uint8_t*, Allocation> m_Allocations;
+    const size_t m_PageSize;
+    size_t m_SlabSize;
+    bool m_HugePages;
+
+    uint8_t* allocate(PoolKind Kind, uintptr_t Size, unsigned Alignment);
+    uint8_t* allocateFromFree(Pool& P, size_t Size);
+    Slab* allocateSlab(PoolKind Kind, size_t MinSize);
+    void releaseIfUnused(Pool& P, Slab& S);
+    Slab& getSlab(Pool& P, uint8_t* Addr);
+
+  public:
+    SlabMemoryManager();
+    ~SlabMemoryManager() override;
+
+    ///\brief Back newly allocated slabs by transparent huge pages, if the
+    /// system supports them.
+    void setUseHugePages(bool Use);
+
+    ///\brief Return memory returned by allocate*Section() to its pool.
+    void deallocate(uint8_t* Addr);
+
+    uint8_t* allocateCodeSection(uintptr_t Size, unsigned Alignment,
+                                 unsigned SectionID,
+                                 llvm::StringRef SectionName) override;
+
+    uint8_t* allocateDataSection(uintptr_t Size, unsigned Alignment,
+                                 unsigned SectionID,
+                                 llvm::StringRef SectionName,
+                                 bool IsReadOnly) override;
+
+    bool finalizeMemory(std::string* ErrMsg = nullptr) override;
+
+    ///\brief Simply wraps the base class's function setting AbortOnFailure
+    /// to false and instead using the error handling mechanism to report it.
+    void* getPointerToNamedFunction(const std::string& Name,
+                                    bool /*AbortOnFailure*/ = true) override {
+      return RTDyldMemoryManager::getPointerToNamedFunction(Name, false);
+    }
+  };
+
+} // end namespace cling
+
+#endif // CLING_SLAB_MEMORY_MANAGER_H
@@ -0,0 +1,359 @@
+//--------------------------------------------------------------------*- C++ -*-
+// CLING - the C++ LLVM-based InterpreterG :)
+//
+// This file is dual-licensed: you can choose to license it under the University
+// of Illinois Open Source License or the GNU Lesser General Public License. See
+// LICENSE.TXT for details.
+//------------------------------------------------------------------------------
+
+#include "TieredCompiler.h"
+
+#include "IncrementalJIT.h"
+#include "JITStubs.h"
+
+#include "llvm/Analysis/TargetLibraryInfo.h"
+#include "llvm/Analysis/TargetTransformInfo.h"
+#include "llvm/Bitcode/BitcodeReader.h"
+#include "llvm/Bitcode/BitcodeWriter.h"
+#include "llvm/ExecutionEngine/Orc/CompileUtils.h"
+#include "llvm/IR/CFG.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/Dominators.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/LegacyPassManager.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Target/TargetMachine.h"
+#include "llvm/Transforms/IPO.h"
+#include "llvm/Transforms/IPO/PassManagerBuilder.h"
+#include "llvm/Transforms/Utils/BasicBlockUtils.h"
+
+#include <atomic>
+
+using namespace llvm;
+
+namespace {
+  ///\brief Entry point of the O0 code into the TieredCompiler.
+  static void TierUpHook(void* TC, uint64_t ID) {
+    static_cast<cling::TieredCompiler*>(TC)->tierUp(ID);
+  }
+
+  static const char kTierUpHookName[] = "__cling_TierUp";
+
+  ///\brief Symbol resolving to the TieredCompiler. The O0 code refers to it
+  /// by name rather than by address, keeping the IR (and thus the object
+  /// cache key) independent of the process.
+  static const char kTieredCompilerName[] = "__cling_TieredCompiler";
+
+  ///\brief Count one more call or loop iteration in Count before
+  /// InsertBefore. The one reaching Threshold calls Hook(This, ID).
+  static void countEvent(Instruction* InsertBefore, GlobalVariable* Count,
+                         unsigned Threshold, Constant* Hook, Constant* This,
+                         uint64_t ID) {
+    LLVMContext& Ctx = Count->getContext();
+    IntegerType* Int32Ty = Type::getInt32Ty(Ctx);
+    IRBuilder<> Builder(InsertBefore);
+    Value* Events
+      = Builder.CreateAtomicRMW(AtomicRMWInst::Add, Count,
+                                ConstantInt::get(Int32Ty, 1),
+                                AtomicOrdering::Monotonic);
+    Value* Hot
+      = Builder.CreateICmpEQ(Events, ConstantInt::get(Int32Ty, Threshold));
+    TerminatorInst* Up = SplitBlockAndInsertIfThen(Hot, InsertBefore,
+                                                   false /*Unreachable*/);
+    Builder.SetInsertPoint(Up);
+    Builder.CreateCall(Hook, {This, ConstantInt::get(Type::getInt64Ty(Ctx),
+                                                     ID)});
+  }
+
+  ///\brief Reduce the pristine module to the definition of FuncName, renamed
+  /// to FuncName$tier1. Everything else refers to the symbols already in the
+  /// JIT, including the module's local ones (see stubs::nameLocals()); ODR
+  /// definitions stay available for inlining.
+  static Function* extractForTierUp(Module& M, StringRef FuncName) {
+    Function* Hot = M.getFunction(FuncName);
+    if (!Hot || Hot->isDeclaration())
+      return nullptr;
+
+    for (auto I = M.alias_begin(), E = M.alias_end(); I != E;) {
+      GlobalAlias& GA = *I++;
+      GlobalValue* Decl;
+      if (auto FT = dyn_cast<FunctionType>(GA.getValueType()))
+        Decl = Function::Create(FT, GlobalValue::ExternalLinkage, "", &M);
+      else
+        Decl = new GlobalVariable(M, GA.getValueType(), false /*isConstant*/,
+                                  GlobalValue::ExternalLinkage, nullptr);
+      Decl->takeName(&GA);
+      GA.replaceAllUsesWith(ConstantExpr::getBitCast(Decl, GA.getType()));
+      GA.eraseFromParent();
+    }
+
+    for (Function& F: M) {
+      if (&F == Hot || F.isDeclaration())
+        continue;
+      F.setComdat(nullptr);
+      if (F.hasLinkOnceODRLinkage() || F.hasWeakODRLinkage())
+        F.setLinkage(GlobalValue::AvailableExternallyLinkage);
+      else if (!F.hasAvailableExternallyLinkage())
+        F.deleteBody();
+    }
+
+    for (auto I = M.global_begin(), E = M.global_end(); I != E;) {
+      GlobalVariable& GV = *I++;
+      if (GV.getName().startswith("llvm.")) {
+        GV.eraseFromParent();
+        continue;
+      }
+      if (GV.isDeclaration())
+        continue;
+      GV.setComdat(nullptr);
+      GV.setInitializer(nullptr);
+      GV.setLinkage(GlobalValue::ExternalLinkage);
+    }
+
+    Hot->setName(FuncName + "$tier1");
+    Hot->setComdat(nullptr);
+    Hot->setLinkage(GlobalValue::ExternalLinkage);
+    Hot->setVisibility(GlobalValue::DefaultVisibility);
+    return Hot;
+  }
+} // unnamed namespace
+
+namespace cling {
+
+TieredCompiler::TieredCompiler(IncrementalJIT& JIT, TargetMachine& TM,
+                               int OptLevel):
+  m_JIT(JIT), m_TM(TM), m_OptLevel(OptLevel), m_Pool(1) {
+  m_JIT.lookupSymbol(kTierUpHookName, (void*)&TierUpHook, true /*Jit*/);
+  m_JIT.lookupSymbol(kTieredCompilerName, this, true /*Jit*/);
+}
+
+TieredCompiler::~TieredCompiler() {
+  {
+    std::lock_guard<std::mutex> Lock(m_Lock);
+    for (auto& IDFunc: m_Functions)
+      IDFunc.second->State = FunctionInfo::kDead;
+  }
+  m_Pool.wait();
+}
+
+std::unique_ptr<TargetMachine> TieredCompiler::createTargetMachine() const {
+  static constexpr CodeGenOpt::Level CGOptLevel[] = {
+    CodeGenOpt::None, CodeGenOpt::Less, CodeGenOpt::Default,
+    CodeGenOpt::Aggressive
+  };
+  return std::unique_ptr<TargetMachine>(
+    m_TM.getTarget().createTargetMachine(m_TM.getTargetTriple().str(),
+                                         m_TM.getTargetCPU(),
+                                         m_TM.getTargetFeatureString(),
+                                         m_TM.Options,
+                                         m_TM.getRelocationModel(),
+                                         m_TM.getCodeModel(),
+                                         CGOptLevel[m_OptLevel]));
+}
+
+void TieredCompiler::instrument(Module& M, size_t Handle) {
+  std::vector<Function*> Funcs;
+  for (Function& F: M)
+    if (stubs::isStubbable(F))
+      Funcs.push_back(&F);
+  if (Funcs.empty())
+    return;
+
+  // The optimized code refers to this module's globals, local ones included.
+  stubs::nameLocals(M);
+  auto Bitcode = std::make_shared<std::string>();
+  {
+    raw_string_ostream OS(*Bitcode);
+    WriteBitcodeToFile(&M, OS);
+  }
+
+  LLVMContext& Ctx = M.getContext();
+  Type* VoidTy = Type::getVoidTy(Ctx);
+  IntegerType* Int32Ty = Type::getInt32Ty(Ctx);
+  IntegerType* Int64Ty = Type::getInt64Ty(Ctx);
+  PointerType* Int8PtrTy = Type::getInt8PtrTy(Ctx);
+  Constant* Hook
+    = M.getOrInsertFunction(kTierUpHookName,
+                            FunctionType::get(VoidTy, {Int8PtrTy, Int64Ty},
+                                              false /*isVarArg*/));
+  Constant* This = M.getOrInsertGlobal(kTieredCompilerName,
+                                       Type::getInt8Ty(Ctx));
+
+  std::lock_guard<std::mutex> Lock(m_Lock);
+  for (Function* F: Funcs) {
+    const uint64_t ID = m_NextID++;
+    std::shared_ptr<FunctionInfo>& PFI = m_Functions[ID];
+    PFI = std::make_shared<FunctionInfo>();
+    FunctionInfo& FI = *PFI;
+    FI.Name = F->getName();
+    FI.Handle = Handle;
+    FI.Bitcode = Bitcode;
+    FI.State = FunctionInfo::kCold;
+
+    // Move the body into F$tier0 ...
+    Function* Body = Function::Create(F->getFunctionType(),
+                                      GlobalValue::InternalLinkage,
+                                      FI.Name + "$tier0", &M);
+    Body->copyAttributesFrom(F);
+    Body->setLinkage(GlobalValue::InternalLinkage);
+    Body->setVisibility(GlobalValue::DefaultVisibility);
+    Body->setComdat(nullptr);
+    Body->getBasicBlockList().splice(Body->begin(), F->getBasicBlockList());
+    for (auto A = F->arg_begin(), NA = Body->arg_begin(), E = F->arg_end();
+         A != E; ++A, ++NA) {
+      A->replaceAllUsesWith(&*NA);
+      NA->takeName(&*A);
+    }
+    SmallVector<std::pair<unsigned, MDNode*>, 2> MDs;
+    F->getAllMetadata(MDs);
+    for (auto& MD: MDs)
+      Body->setMetadata(MD.first, MD.second);
+
+    // ... and turn F into a stub calling through its implementation pointer.
+    FI.ImplName = stubs::makeStub(*F, Body)->getName();
+
+    // Count calls and loop iterations; tier up once F is hot. A single call
+    // running a long loop makes F hot for its next calls.
+    GlobalVariable* Count
+      = new GlobalVariable(M, Int32Ty, false /*isConstant*/,
+                           GlobalValue::InternalLinkage,
+                           ConstantInt::get(Int32Ty, 0), FI.Name + "$count");
+    // The blocks ending in a back edge, i.e. branching to a block that
+    // dominates them.
+    SmallVector<BasicBlock*, 4> Latches;
+    {
+      DominatorTree DT(*Body);
+      for (BasicBlock& BB: *Body)
+        for (BasicBlock* Succ: successors(&BB))
+          if (DT.dominates(Succ, &BB)) {
+            Latches.push_back(&BB);
+            break;
+          }
+    }
+    for (BasicBlock* Latch: Latches)
+      countEvent(Latch->getTerminator(), Count, kThreshold, Hook, This, ID);
+
+    // Calls are counted after the static allocas.
+    BasicBlock::iterator IP = Body->getEntryBlock().begin();
+    while (isa<AllocaInst>(IP))
+      ++IP;
+    countEvent(&*IP, Count, kThreshold, Hook, This, ID);
+  }
+}
+
+void TieredCompiler::runJob(FunctionInfo& FI, TargetMachine& TM,
+                            int OptLevel) {
+  // LLVMContexts are not thread-safe: every job gets its own.
+  LLVMContext Ctx;
+  ObjectT Object;
+  Expected<std::unique_ptr<Module>> ModOrErr
+    = parseBitcodeFile(MemoryBufferRef(*FI.Bitcode, FI.Name), Ctx);
+  if (!ModOrErr)
+    consumeError(ModOrErr.takeError());
+  else if (extractForTierUp(**ModOrErr, FI.Name)) {
+    Module& M = **ModOrErr;
+    PassManagerBuilder PMBuilder;
+    PMBuilder.OptLevel = OptLevel;
+    PMBuilder.SLPVectorize = 1;
+    PMBuilder.LoopVectorize = 1;
+    PMBuilder.LibraryInfo = new TargetLibraryInfoImpl(TM.getTargetTriple());
+    PMBuilder.Inliner = createFunctionInliningPass(OptLevel, 0, false);
+    TM.adjustPassManager(PMBuilder);
+
+    legacy::PassManager MPM;
+    MPM.add(createTargetTransformInfoWrapperPass(TM.getTargetIRAnalysis()));
+    PMBuilder.populateModulePassManager(MPM);
+    MPM.run(M);
+
+    Object = orc::SimpleCompiler(TM)(M);
+  }
+
+  // Link right away, so that calls from now on, e.g. further iterations of
+  // the loop that made the function hot, run the optimized code. Unless
+  // the function was forgotten meanwhile.
+  std::lock_guard<std::recursive_mutex> JITLock(m_JIT.getModuleLock());
+  if (FI.State == FunctionInfo::kCompiling)
+    link(FI, std::move(Object));
+}
+
+void TieredCompiler::link(FunctionInfo& FI, ObjectT Object) {
+  FI.Bitcode.reset();
+  if (!Object.getBinary()) {
+    // Compilation failed; stay at O0.
+    FI.State = FunctionInfo::kDead;
+    return;
+  }
+
+  std::unique_ptr<ObjectT> Obj(new ObjectT(std::move(Object)));
+  const uint64_t Addr = m_JIT.addFunctionObject(std::move(Obj), FI.Handle,
+                                                FI.Name + "$tier1");
+  const uint64_t ImplAddr = m_JIT.getSymbolAddress(FI.ImplName,
+                                                   false /*AlsoInProcess*/);
+  if (!Addr || !ImplAddr) {
+    FI.State = FunctionInfo::kDead;
+    return;
+  }
+  // Calls already in flight finish in the O0 body; new ones enter the
+  // optimized code.
+  reinterpret_cast<std::atomic<uintptr_t>*>(ImplAddr)
+    ->store((uintptr_t)Addr, std::memory_order_release);
+  FI.State = FunctionInfo::kOptimized;
+}
+
+void TieredCompiler::tierUp(uint64_t ID) {
+  std::lock_guard<std::mutex> Lock(m_Lock);
+  auto IFunc = m_Functions.find(ID);
+  if (IFunc == m_Functions.end())
+    return;
+  std::shared_ptr<FunctionInfo> PFI = IFunc->second;
+  // Only the first of the threads getting here schedules the job.
+  int Cold = FunctionInfo::kCold;
+  if (!PFI->State.compare_exchange_strong(Cold, FunctionInfo::kCompiling))
+    return;
+
+  // Snapshot the TargetMachine configuration now: BackendPasses adjusts the
+  // opt level of m_TM for each module.
+  std::shared_ptr<TargetMachine> TM(createTargetMachine());
+  const int OptLevel = m_OptLevel;
+  m_Pool.async([this, PFI, TM, OptLevel]() {
+      runJob(*PFI, *TM, OptLevel);
+    });
+}
+
+void TieredCompiler::forget(size_t Handle) {
+  // Jobs still running keep their record alive and, seeing kDead under the
+  // JIT's lock we hold, drop their result.
+  std::lock_guard<std::mutex> Lock(m_Lock);
+  for (auto I = m_Functions.begin(), E = m_Functions.end(); I != E;) {
+    if (I->second->Handle == Handle) {
+      I->second->State = FunctionInfo::kDead;
+      I = m_Functions.erase(I);
+    } else
+      ++I;
+  }
+}
+
+void TieredCompiler::printStats(raw_ostream& Out, StringRef Filter) {
+  static const char* const States[] = {
+    "cold", "compiling", "optimized", "not optimizable"
+  };
+  std::lock_guard<std::mutex> Lock(m_Lock);
+  size_t Optimized = 0;
+  for (const auto& IDFunc: m_Functions)
+    if (IDFunc.second->State == FunctionInfo::kOptimized)
+      ++Optimized;
+  Out << "Tiered compilation: " << Optimized << " of " << m_Functions.size()
+      << " functions optimized\n";
+  if (Filter.empty())
+    return;
+  for (const auto& IDFunc: m_Functions) {
+    const FunctionInfo& FI = *IDFunc.second;
+    if (StringRef(FI.Name).find(Filter) != StringRef::npos)
+      Out << "  " << FI.Name << ": " << States[FI.State] << '\n';
+  }
+}
+
+} // end namespace cling
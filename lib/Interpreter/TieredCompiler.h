@@ -0,0 +1,123 @@
+//--------------------------------------------------------------------*- C++ -*-
+// CLING - the C++ LLVM-based InterpreterG :)
+//
+// This file is dual-licensed: you can choose to license it under the University
+// of Illinois Open Source License or the GNU Lesser General Public License. See
+// LICENSE.TXT for details.
+//------------------------------------------------------------------------------
+
+#ifndef CLING_TIERED_COMPILER_H
+#define CLING_TIERED_COMPILER_H
+
+#include "llvm/Object/Binary.h"
+#include "llvm/Object/ObjectFile.h"
+#include "llvm/Support/ThreadPool.h"
+
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace llvm {
+  class Function;
+  class Module;
+  class raw_ostream;
+  class StringRef;
+  class TargetMachine;
+}
+
+namespace cling {
+  class IncrementalJIT;
+
+  ///\brief Two-tier compilation for the IncrementalJIT.
+  ///
+  /// Modules are compiled at O0. Every function definition is moved behind an
+  /// indirect stub (see stubs::makeStub) and its body counts its calls and
+  /// loop iterations. Once a function becomes hot, its IR is recompiled at a
+  /// higher optimization level on a background thread, which then links the
+  /// new object under the JIT's lock and atomically redirects the stub's
+  /// implementation pointer to the optimized code. Calls made from then on
+  /// run the optimized code, also within the same input; calls already
+  /// running finish in the O0 code.
+  ///
+  class TieredCompiler {
+  public:
+    typedef llvm::object::OwningBinary<llvm::object::ObjectFile> ObjectT;
+
+  private:
+    ///\brief Per-function record.
+    struct FunctionInfo {
+      enum StateT { kCold, kCompiling, kOptimized, kDead };
+
+      ///\brief IR name of the stub.
+      std::string Name;
+      ///\brief IR name of the stub's implementation pointer.
+      std::string ImplName;
+      ///\brief Unload handle of the module set the function came from.
+      size_t Handle;
+      ///\brief Bitcode of the module before it was instrumented.
+      std::shared_ptr<const std::string> Bitcode;
+      ///\brief Only tierUp() leaves kCold; the background job leaves
+      /// kCompiling, unless forget() was first. Both of the latter hold the
+      /// JIT's lock.
+      std::atomic<int> State;
+    };
+
+    IncrementalJIT& m_JIT;
+
+    ///\brief The JIT's TargetMachine, replicated for background jobs.
+    llvm::TargetMachine& m_TM;
+
+    ///\brief Optimization level hot functions are recompiled at.
+    int m_OptLevel;
+
+    ///\brief Functions by the ID their O0 code passes back to us. Background
+    /// jobs share ownership of the records they work on.
+    std::map<uint64_t, std::shared_ptr<FunctionInfo>> m_Functions;
+
+    ///\brief The ID of the next instrumented function.
+    uint64_t m_NextID = 0;
+
+    ///\brief Protects m_Functions against the threads running JIT-compiled
+    /// code.
+    std::mutex m_Lock;
+
+    llvm::ThreadPool m_Pool;
+
+    std::unique_ptr<llvm::TargetMachine> createTargetMachine() const;
+    void runJob(FunctionInfo& FI, llvm::TargetMachine& TM, int OptLevel);
+    void link(FunctionInfo& FI, ObjectT Object);
+
+  public:
+    ///\brief Calls and loop iterations after which a function is
+    /// recompiled.
+    enum { kThreshold = 1024 * 4 };
+
+    TieredCompiler(IncrementalJIT& JIT, llvm::TargetMachine& TM,
+                   int OptLevel);
+    ~TieredCompiler();
+
+    ///\brief Put the definitions of M behind stubs and add call counters.
+    ///\param [in] M - the module, already lowered at O0.
+    ///\param [in] Handle - the unload handle M will be emitted under.
+    void instrument(llvm::Module& M, size_t Handle);
+
+    ///\brief Called by the O0 code of function ID once it is hot, on
+    /// whatever thread runs it.
+    void tierUp(uint64_t ID);
+
+    ///\brief Drop all functions of the module set Handle. Called by the JIT
+    /// with its module lock held; running jobs drop their result.
+    void forget(size_t Handle);
+
+    ///\brief Print how many of the instrumented functions were optimized
+    /// and the state of those whose name contains Filter, if not empty.
+    void printStats(llvm::raw_ostream& Out, llvm::StringRef Filter);
+  };
+
+} // end namespace cling
+
+#endif // CLING_TIERED_COMPILER_H
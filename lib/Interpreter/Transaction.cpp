@@ -47,6 +47,7 @@ namespace cling {
     m_Next = 0;
     //m_Sema = S;
     m_BufferFID = FileID(); // sets it to invalid.
+    m_ASTBytes = 0;
     m_Exe = 0;
   }
 
@@ -30,8 +30,17 @@
 #include "llvm/Support/Host.h"
 #include "llvm/Support/raw_os_ostream.h"
 
+#include <atomic>
+#include <cstddef>
+
 namespace {
 
+  ///\brief The number of AllocatedValues that were not released yet.
+  static std::atomic<size_t> sNumAllocatedValues(0);
+
+  ///\brief The bytes allocated for them.
+  static std::atomic<size_t> sAllocatedValueBytes(0);
+
   ///\brief The layout/usage of memory allocated by AllocatedValue::Create
   /// is dependent on the the type of object it is representing.  If the type
   /// has a non-trival destructor then the memory base will point to either
@@ -129,6 +138,13 @@ namespace {
       return RC.m_Count;
     }
 
+    ///\brief Starts the allocation, to account for its size when it is
+    /// released. As large as the alignment new char[] guarantees, so that the
+    /// client data is aligned as without it.
+    struct alignas(std::max_align_t) SizeHeader {
+      size_t Bytes;
+    };
+
     template <class T = AllocatedValue> static T* FromPtr(void* Ptr) {
       return reinterpret_cast<T*>(reinterpret_cast<char*>(Ptr) - sizeof(T));
     }
@@ -146,7 +162,7 @@ namespace {
     ///\brief Create an AllocatedValue.
     /// \returns The address of the writeable client data.
     static void* Create(size_t Size, size_t NElem, DtorFunc_t Dtor) {
-      size_t AllocSize = sizeof(AllocatedValue) + Size;
+      size_t AllocSize = sizeof(SizeHeader) + sizeof(AllocatedValue) + Size;
       size_t ExtraSize = 0;
       char Flags = 0;
       if (Dtor) {
@@ -162,6 +178,8 @@ namespace {
       }
 
       char* Alloc = new char[AllocSize];
+      new (Alloc) SizeHeader{AllocSize};
+      Alloc += sizeof(SizeHeader);
 
       if (Dtor) {
         // Move the Buffer ptr to where AllocatedValue begins
@@ -194,6 +212,9 @@ namespace {
       assert(&Alloc[sizeof(AllocatedValue) - 1] == &AV->m_Bytes[SizeBytes - 1]
              && "Padded AllocatedValue");
 
+      ++sNumAllocatedValues;
+      sAllocatedValueBytes += AllocSize;
+
       // Give back the first client writable byte.
       return AV->m_Bytes + SizeBytes;
     }
@@ -225,9 +246,12 @@ namespace {
           Allocated -= sizeof(Destructable);
         else if (AV->TestFlags(kHasDestructor))
           Allocated -= sizeof(DtorFunc_t);
+        Allocated -= sizeof(SizeHeader);
 
         AV->~AllocatedValue();
+        sAllocatedValueBytes -= reinterpret_cast<SizeHeader*>(Allocated)->Bytes;
         delete [] Allocated;
+        --sNumAllocatedValues;
       }
     }
   };
@@ -235,6 +259,14 @@ namespace {
 
 namespace cling {
 
+  size_t Value::getNumManagedAllocations() {
+    return sNumAllocatedValues;
+  }
+
+  size_t Value::getManagedAllocationBytes() {
+    return sAllocatedValueBytes;
+  }
+
   Value::Value(const Value& other):
     m_Storage(other.m_Storage), m_StorageType(other.m_StorageType),
     m_Type(other.m_Type), m_Interpreter(other.m_Interpreter) {
@@ -0,0 +1,475 @@
+//--------------------------------------------------------------------*- C++ -*-
+// CLING - the C++ LLVM-based InterpreterG :)
+//
+// This file is dual-licensed: you can choose to license it under the University
+// of Illinois Open Source License or the GNU Lesser General Public License. See
+// LICENSE.TXT for details.
+//------------------------------------------------------------------------------
+
+#include "WarmStartImage.h"
+#include "ClingUtils.h"
+
+#include "cling/Interpreter/InvocationOptions.h"
+#include "cling/Utils/Output.h"
+
+#include "clang/Basic/Diagnostic.h"
+#include "clang/Basic/TargetOptions.h"
+#include "clang/Basic/Version.h"
+#include "clang/Frontend/CompilerInstance.h"
+#include "clang/Frontend/FrontendActions.h"
+#include "clang/Frontend/Utils.h"
+#include "clang/Lex/HeaderSearchOptions.h"
+#include "clang/Lex/PreprocessorOptions.h"
+
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/StringSet.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MD5.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/raw_ostream.h"
+
+#ifndef LLVM_ON_WIN32
+#include <dlfcn.h>
+#endif
+
+using namespace clang;
+
+namespace {
+  ///\brief The headers every interpreter parses while initializing; see
+  /// IncrementalParser::Initialize(), Interpreter::Initialize() and
+  /// valuePrinterInternal::printValueInternal().
+  static const char kRuntimeHeaders[] =
+    "#include <new>\n"
+    "#include \"cling/Interpreter/RuntimeUniverse.h\"\n"
+    "#include \"cling/Interpreter/RuntimePrintValue.h\"\n";
+
+  ///\brief Collects all headers the PCH is built from, system ones included.
+  class HeaderCollector : public DependencyCollector {
+  public:
+    bool needSystemDependencies() override { return true; }
+  };
+
+  ///\brief Get the file (executable or shared library) cling runs from.
+  static std::string GetClingBinary() {
+    void* Addr = (void*)intptr_t(&GetClingBinary);
+#ifndef LLVM_ON_WIN32
+    Dl_info Info;
+    if (::dladdr(Addr, &Info) && Info.dli_fname
+        && llvm::sys::path::is_absolute(Info.dli_fname))
+      return Info.dli_fname;
+#endif
+    return llvm::sys::fs::getMainExecutable("cling", Addr);
+  }
+
+  ///\brief Describe the file or directory Path by its size and time of
+  /// modification.
+  ///\returns false if Path does not exist.
+  static bool DescribeFile(llvm::StringRef Path, llvm::raw_ostream& Out) {
+    llvm::sys::fs::file_status Status;
+    if (llvm::sys::fs::status(Path, Status))
+      return false;
+    Out << Path << '\t' << Status.getSize() << '\t'
+        << Status.getLastModificationTime().time_since_epoch().count()
+        << '\n';
+    return true;
+  }
+
+  ///\brief Write Content to File, through a unique temporary renamed into
+  /// place: other processes might be reading File right now.
+  static bool WriteFileAtomically(llvm::StringRef File,
+                                  llvm::StringRef Content) {
+    llvm::SmallString<256> Model(File);
+    Model += ".%%%%%%.tmp";
+    llvm::SmallString<256> TmpPath;
+    int FD;
+    if (llvm::sys::fs::createUniqueFile(Model, FD, TmpPath))
+      return false;
+    {
+      llvm::raw_fd_ostream Out(FD, true /*shouldClose*/);
+      Out << Content;
+      Out.close();
+      if (Out.has_error()) {
+        Out.clear_error();
+        llvm::sys::fs::remove(TmpPath);
+        return false;
+      }
+    }
+    if (llvm::sys::fs::rename(TmpPath, File)) {
+      llvm::sys::fs::remove(TmpPath);
+      return false;
+    }
+    return true;
+  }
+
+  ///\brief Describe everything a PCH built with the invocation of CI
+  /// depends on, but for the headers it includes.
+  ///\returns false if the cling binary or resource directory do not exist.
+  static bool DescribeInvocation(const CompilerInstance& CI,
+                                 const cling::InvocationOptions& Opts,
+                                 llvm::raw_ostream& Out) {
+    Out << "cling " ClingStringify(CLING_VERSION) "\n"
+        << getClangFullVersion() << '\n';
+
+    const HeaderSearchOptions& HSOpts = CI.getHeaderSearchOpts();
+    if (!DescribeFile(GetClingBinary(), Out)
+        || !DescribeFile(HSOpts.ResourceDir, Out))
+      return false;
+
+    for (const char* Arg: Opts.CompilerOpts.Remaining)
+      Out << Arg << '\n';
+
+    const TargetOptions& TOpts = CI.getTargetOpts();
+    Out << TOpts.Triple << '\n' << TOpts.CPU << '\n';
+    for (const std::string& Feature: TOpts.FeaturesAsWritten)
+      Out << Feature << '\n';
+
+    Out << HSOpts.Sysroot << '\n';
+    for (const HeaderSearchOptions::Entry& E: HSOpts.UserEntries)
+      Out << E.Group << ':' << E.Path << '\n';
+    for (const auto& Macro: CI.getPreprocessorOpts().Macros)
+      Out << (Macro.second ? "-U" : "-D") << Macro.first << '\n';
+    return true;
+  }
+
+  ///\brief Collect the #include directives File starts with, possibly
+  /// after a #! line, empty lines and // comments.
+  static std::string ReadPreamble(llvm::StringRef File) {
+    llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> Buf
+      = llvm::MemoryBuffer::getFile(File);
+    if (!Buf)
+      return std::string();
+    llvm::SmallString<256> Dir(File);
+    if (llvm::sys::fs::make_absolute(Dir))
+      return std::string();
+    llvm::sys::path::remove_filename(Dir);
+
+    std::string Includes;
+    llvm::SmallVector<llvm::StringRef, 64> Lines;
+    (*Buf)->getBuffer().split(Lines, '\n');
+    for (size_t I = 0, N = Lines.size(); I < N; ++I) {
+      const llvm::StringRef Line = Lines[I].trim();
+      if (Line.empty() || Line.startswith("//")
+          || (I == 0 && Line.startswith("#!")))
+        continue;
+      if (!Line.startswith("#"))
+        break;
+      llvm::StringRef Spelling = Line.drop_front().ltrim();
+      if (!Spelling.startswith("include"))
+        break;
+      Spelling = Spelling.drop_front(7).ltrim();
+      if (Spelling.empty() || (Spelling[0] != '<' && Spelling[0] != '"'))
+        break;
+
+      // The PCH is built elsewhere: name the headers found next to File
+      // by their absolute path.
+      if (Spelling[0] == '"') {
+        const llvm::StringRef Name = Spelling.drop_front().split('"').first;
+        llvm::SmallString<256> Path(Dir);
+        llvm::sys::path::append(Path, Name);
+        if (!llvm::sys::path::is_absolute(Name)
+            && llvm::sys::fs::exists(Path)) {
+          Includes += "#include \"" + Path.str().str() + "\"\n";
+          continue;
+        }
+      }
+      Includes += "#include " + Spelling.str() + "\n";
+    }
+    return Includes;
+  }
+
+  ///\brief Read the instantiations recorded in File, one type per line.
+  static void ReadInstantiations(llvm::StringRef File,
+                                 llvm::SmallVectorImpl<llvm::StringRef>& Types,
+                                 std::unique_ptr<llvm::MemoryBuffer>& Buf) {
+    llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> Content
+      = llvm::MemoryBuffer::getFile(File);
+    if (!Content)
+      return;
+    Buf = std::move(*Content);
+    Buf->getBuffer().split(Types, '\n', -1, false);
+  }
+
+  ///\brief Get a copy of CI's invocation, to build a PCH with.
+  static std::shared_ptr<CompilerInvocation>
+  CopyInvocation(const CompilerInstance& CI) {
+    return std::make_shared<CompilerInvocation>(CI.getInvocation());
+  }
+
+  ///\brief Precompile Includes into the image directory Dir, listing the
+  /// headers it was built from after Key. Thread-safe, as long as
+  /// Invocation is not shared.
+  static bool BuildPCH(std::shared_ptr<CompilerInvocation> Invocation,
+                       const std::string& Dir, const std::string& Key,
+                       const std::string& Includes,
+                       const std::string& Chain) {
+    if (llvm::sys::fs::create_directories(Dir))
+      return false;
+
+    // The instantiation image is rebuilt in place with more #includes: keep
+    // the stub as long as it is the same.
+    llvm::SmallString<256> Stub(Dir);
+    llvm::sys::path::append(Stub, "image.h");
+    llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> OldStub
+      = llvm::MemoryBuffer::getFile(Stub);
+    if ((!OldStub || (*OldStub)->getBuffer() != Includes)
+        && !WriteFileAtomically(Stub, Includes))
+      return false;
+
+    llvm::SmallString<256> PCH(Dir);
+    llvm::sys::path::append(PCH, "image.pch");
+    llvm::SmallString<256> TmpPCH;
+    if (llvm::sys::fs::getPotentiallyUniqueFileName(PCH + ".%%%%%%.tmp",
+                                                    TmpPCH))
+      return false;
+
+    // Precompile the headers exactly as the interpreter sees them.
+    FrontendOptions& FrontendOpts = Invocation->getFrontendOpts();
+    FrontendOpts.Inputs.clear();
+    FrontendOpts.Inputs.emplace_back(Stub, InputKind(InputKind::CXX));
+    FrontendOpts.OutputFile = TmpPCH.str();
+    FrontendOpts.ProgramAction = frontend::GeneratePCH;
+    FrontendOpts.DisableFree = false;
+    Invocation->getPreprocessorOpts().ImplicitPCHInclude = Chain;
+    Invocation->getDependencyOutputOpts() = DependencyOutputOptions();
+
+    CompilerInstance Generator;
+    Generator.setInvocation(std::move(Invocation));
+    Generator.createDiagnostics(new IgnoringDiagConsumer(),
+                                true /*ShouldOwnClient*/);
+    auto Headers = std::make_shared<HeaderCollector>();
+    Generator.addDependencyCollector(Headers);
+
+    GeneratePCHAction Action;
+    if (!Generator.ExecuteAction(Action)
+        || Generator.getDiagnostics().hasErrorOccurred()) {
+      llvm::sys::fs::remove(TmpPCH);
+      return false;
+    }
+
+    std::string Manifest = Key;
+    {
+      llvm::raw_string_ostream Out(Manifest);
+      for (const std::string& Header: Headers->getDependencies())
+        DescribeFile(Header, Out);
+    }
+
+    // The headers are only listed once the PCH is in place: an image
+    // without them is rebuilt.
+    if (llvm::sys::fs::rename(TmpPCH, PCH)) {
+      llvm::sys::fs::remove(TmpPCH);
+      return false;
+    }
+    llvm::SmallString<256> ManifestFile(Dir);
+    llvm::sys::path::append(ManifestFile, "headers");
+    return WriteFileAtomically(ManifestFile, Manifest);
+  }
+} // unnamed namespace
+
+namespace cling {
+
+WarmStartImage::WarmStartImage(std::string Dir, std::string Key,
+                               std::string Includes, std::string Chain):
+  m_Dir(std::move(Dir)), m_Key(std::move(Key)),
+  m_Includes(std::move(Includes)), m_Chain(std::move(Chain)),
+  m_Valid(false) {
+  m_Valid = isUpToDate();
+}
+
+WarmStartImage::~WarmStartImage() {}
+
+std::unique_ptr<WarmStartImage>
+WarmStartImage::create(const char* Kind, llvm::StringRef Name,
+                       std::string Key, std::string Includes,
+                       std::string Chain, const InvocationOptions& Opts) {
+  llvm::SmallString<256> Dir;
+  if (!llvm::sys::path::user_cache_directory(Dir, "cling", Kind))
+    return nullptr;
+  llvm::MD5 Hash;
+  Hash.update(Name);
+  llvm::MD5::MD5Result Result;
+  Hash.final(Result);
+  llvm::SmallString<32> Digest;
+  llvm::MD5::stringifyResult(Result, Digest);
+  llvm::sys::path::append(Dir, Digest.str());
+
+  std::unique_ptr<WarmStartImage>
+    Image(new WarmStartImage(Dir.str(), std::move(Key), std::move(Includes),
+                             std::move(Chain)));
+  if (Opts.Verbose()) {
+    cling::log() << (Image->isValid() ? "Using" : "Building") << ' ' << Kind
+                 << " image '" << Dir << "'\n";
+  }
+  return Image;
+}
+
+std::unique_ptr<WarmStartImage>
+WarmStartImage::createRuntime(const CompilerInstance& CI,
+                              const InvocationOptions& Opts) {
+  // The PCH replaces what IncrementalParser::Initialize() parses for C++
+  // with the runtime; an explicit -include-pch takes its place.
+  const LangOptions& LangOpts = CI.getLangOpts();
+  if (!LangOpts.CPlusPlus || LangOpts.ObjC1 || Opts.NoRuntime
+      || Opts.CompilerOpts.HasOutput
+      || !CI.getPreprocessorOpts().ImplicitPCHInclude.empty())
+    return nullptr;
+
+  std::string Key;
+  llvm::raw_string_ostream Out(Key);
+  if (!DescribeInvocation(CI, Opts, Out))
+    return nullptr;
+  Out.flush();
+  return create("warm-start", Key, Key, kRuntimeHeaders, std::string(), Opts);
+}
+
+std::unique_ptr<WarmStartImage>
+WarmStartImage::createPreamble(const CompilerInstance& CI,
+                               const InvocationOptions& Opts,
+                               llvm::StringRef File,
+                               const WarmStartImage* Runtime) {
+  const LangOptions& LangOpts = CI.getLangOpts();
+  if (!LangOpts.CPlusPlus || LangOpts.ObjC1 || Opts.CompilerOpts.HasOutput)
+    return nullptr;
+  // Chain to the runtime image only once it exists; never chain to a PCH
+  // given by the user.
+  if (Runtime ? !Runtime->isValid()
+      : !CI.getPreprocessorOpts().ImplicitPCHInclude.empty())
+    return nullptr;
+
+  std::string Includes = ReadPreamble(File);
+  if (Includes.empty())
+    return nullptr;
+
+  std::string Key;
+  llvm::raw_string_ostream Out(Key);
+  if (!DescribeInvocation(CI, Opts, Out))
+    return nullptr;
+  std::string Chain;
+  if (Runtime) {
+    Chain = Runtime->getPCH();
+    if (!DescribeFile(Chain, Out))
+      return nullptr;
+  }
+  Out << Includes;
+  Out.flush();
+  return create("preamble", Key, Key, std::move(Includes), std::move(Chain),
+                Opts);
+}
+
+std::unique_ptr<WarmStartImage>
+WarmStartImage::createInstantiations(const CompilerInstance& CI,
+                                     const InvocationOptions& Opts,
+                                     const WarmStartImage& Preamble) {
+  if (!Preamble.isValid())
+    return nullptr;
+
+  std::unique_ptr<llvm::MemoryBuffer> Buf;
+  llvm::SmallVector<llvm::StringRef, 64> Types;
+  ReadInstantiations(Preamble.getPath("instantiations"), Types, Buf);
+  if (Types.empty())
+    return nullptr;
+
+  // Requiring the size of a class instantiates its definition.
+  std::string Includes;
+  for (llvm::StringRef Type: Types)
+    Includes += "static_assert(sizeof(" + Type.str() + ") != 0, \"\");\n";
+
+  // One image per preamble image, named by the configuration only: as more
+  // instantiations get recorded it is rebuilt in place, instead of leaving
+  // an image behind for each list.
+  std::string Key;
+  llvm::raw_string_ostream Out(Key);
+  if (!DescribeInvocation(CI, Opts, Out))
+    return nullptr;
+  std::string Chain = Preamble.getPCH();
+  Out << Chain << '\n';
+  const std::string Name = Out.str();
+  if (!DescribeFile(Chain, Out))
+    return nullptr;
+  Out << Includes;
+  Out.flush();
+  return create("instantiations", Name, Key, std::move(Includes),
+                std::move(Chain), Opts);
+}
+
+std::string WarmStartImage::getPath(const char* Name) const {
+  llvm::SmallString<256> Path(m_Dir);
+  llvm::sys::path::append(Path, Name);
+  return Path.str();
+}
+
+bool WarmStartImage::isUpToDate() const {
+  if (!llvm::sys::fs::exists(getPCH()))
+    return false;
+
+  llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> Buf
+    = llvm::MemoryBuffer::getFile(getPath("headers"));
+  if (!Buf)
+    return false;
+  llvm::StringRef Content = (*Buf)->getBuffer();
+  if (!Content.startswith(m_Key))
+    return false;
+
+  // Each line describes a header: its path, size and modification time.
+  llvm::SmallVector<llvm::StringRef, 256> Headers;
+  Content.drop_front(m_Key.size()).split(Headers, '\n', -1, false);
+  if (Headers.empty())
+    return false;
+  std::string Current;
+  for (llvm::StringRef Header: Headers) {
+    Current.clear();
+    llvm::raw_string_ostream Out(Current);
+    const llvm::StringRef Path = Header.rsplit('\t').first.rsplit('\t').first;
+    if (!DescribeFile(Path, Out))
+      return false;
+    if (llvm::StringRef(Out.str()).drop_back() != Header)
+      return false;
+  }
+  return true;
+}
+
+bool WarmStartImage::load(CompilerInstance& CI) const {
+  if (!m_Valid)
+    return false;
+  CI.getPreprocessorOpts().ImplicitPCHInclude = getPCH();
+  return true;
+}
+
+bool WarmStartImage::build(const CompilerInstance& CI) {
+  m_Valid = BuildPCH(CopyInvocation(CI), m_Dir, m_Key, m_Includes, m_Chain);
+  return m_Valid;
+}
+
+void WarmStartImage::buildInBackground(const CompilerInstance& CI) {
+  m_Builder = std::async(std::launch::async, BuildPCH, CopyInvocation(CI),
+                         m_Dir, m_Key, m_Includes, m_Chain);
+}
+
+bool
+WarmStartImage::recordInstantiations(const std::vector<std::string>& Types)
+  const {
+  const std::string File = getPath("instantiations");
+  std::unique_ptr<llvm::MemoryBuffer> Buf;
+  llvm::SmallVector<llvm::StringRef, 64> Recorded;
+  ReadInstantiations(File, Recorded, Buf);
+
+  // Keep the recorded order: the instantiation image is checked against
+  // the list.
+  llvm::StringSet<> Known;
+  std::string Content;
+  for (llvm::StringRef Type: Recorded) {
+    if (Known.insert(Type).second)
+      Content += Type.str() + '\n';
+  }
+  const size_t RecordedSize = Content.size();
+  for (const std::string& Type: Types) {
+    if (Known.insert(Type).second)
+      Content += Type + '\n';
+  }
+  if (Content.size() == RecordedSize)
+    return true;
+  return WriteFileAtomically(File, Content);
+}
+
+} // end namespace cling
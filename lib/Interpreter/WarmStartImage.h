@@ -0,0 +1,138 @@
+//--------------------------------------------------------------------*- C++ -*-
+// CLING - the C++ LLVM-based InterpreterG :)
+//
+// This file is dual-licensed: you can choose to license it under the University
+// of Illinois Open Source License or the GNU Lesser General Public License. See
+// LICENSE.TXT for details.
+//------------------------------------------------------------------------------
+
+#ifndef CLING_WARM_START_IMAGE_H
+#define CLING_WARM_START_IMAGE_H
+
+#include "llvm/ADT/StringRef.h"
+
+#include <future>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace clang {
+  class CompilerInstance;
+}
+
+namespace cling {
+  class InvocationOptions;
+
+  ///\brief Headers parsed by an earlier session, saved for later ones.
+  ///
+  /// The image is a directory of the user's cache directory holding a PCH
+  /// of a set of headers. The directory is named by a hash of everything the
+  /// image depends on: the cling and clang versions, the cling binary, the
+  /// resource directory, the arguments, the target, the header search paths
+  /// and the #include directives. The headers the PCH was built from are
+  /// listed with their size and modification time; the image is rebuilt
+  /// once any of them changed. The instantiation image is named without
+  /// its #include directives and rebuilt in place when they change.
+  ///
+  /// There are two kinds of images:
+  /// - the runtime image, of the headers each interpreter parses while
+  ///   initializing (<new>, RuntimeUniverse.h and the value printer's
+  ///   RuntimePrintValue.h). It also caches the objects the JIT compiled
+  ///   during initialization.
+  /// - the preamble image, of the leading #includes of the file the session
+  ///   runs. Its PCH is chained to the runtime image's, if any.
+  /// - the instantiation image, of the class template instantiations
+  ///   sessions using a preamble image triggered. Its PCH is chained to the
+  ///   preamble image's.
+  ///
+  class WarmStartImage {
+    ///\brief The image directory.
+    std::string m_Dir;
+
+    ///\brief Describes everything the image depends on.
+    std::string m_Key;
+
+    ///\brief The #include directives to precompile.
+    std::string m_Includes;
+
+    ///\brief The PCH the image's PCH is chained to, if any.
+    std::string m_Chain;
+
+    ///\brief Whether the image exists and is up-to-date.
+    bool m_Valid;
+
+    ///\brief The build of the image in the background, if any; waited for
+    /// upon destruction.
+    std::future<bool> m_Builder;
+
+    WarmStartImage(std::string Dir, std::string Key, std::string Includes,
+                   std::string Chain);
+
+    ///\brief Get the image of Kind in the directory named by a hash of
+    /// Name, checked against Key.
+    static std::unique_ptr<WarmStartImage>
+    create(const char* Kind, llvm::StringRef Name, std::string Key,
+           std::string Includes, std::string Chain,
+           const InvocationOptions& Opts);
+
+    std::string getPath(const char* Name) const;
+    bool isUpToDate() const;
+
+  public:
+    ///\brief Find the runtime image for the interpreter using CI and Opts.
+    ///\returns nullptr if the interpreter cannot start from an image, e.g.
+    /// because it is not C++ or it loads a PCH of its own.
+    static std::unique_ptr<WarmStartImage>
+    createRuntime(const clang::CompilerInstance& CI,
+                  const InvocationOptions& Opts);
+
+    ///\brief Find the preamble image of the leading #includes of File.
+    ///\param [in] Runtime - the runtime image the preamble is chained to,
+    ///   if any.
+    ///\returns nullptr if File does not start with #includes, or if the
+    /// runtime image still needs to be built.
+    static std::unique_ptr<WarmStartImage>
+    createPreamble(const clang::CompilerInstance& CI,
+                   const InvocationOptions& Opts, llvm::StringRef File,
+                   const WarmStartImage* Runtime);
+
+    ///\brief Find the instantiation image of the instantiations recorded
+    /// for Preamble.
+    ///\returns nullptr if Preamble is not valid or none were recorded.
+    static std::unique_ptr<WarmStartImage>
+    createInstantiations(const clang::CompilerInstance& CI,
+                         const InvocationOptions& Opts,
+                         const WarmStartImage& Preamble);
+
+    ~WarmStartImage();
+
+    ///\brief Whether the image can be loaded, as opposed to being built.
+    bool isValid() const { return m_Valid; }
+
+    ///\brief The image's PCH.
+    std::string getPCH() const { return getPath("image.pch"); }
+
+    ///\brief The directory caching the objects compiled for the runtime.
+    std::string getObjectDirectory() const { return getPath("objects"); }
+
+    ///\brief Make CI load the image's PCH when it gets initialized.
+    ///\returns false if the image is not valid.
+    bool load(clang::CompilerInstance& CI) const;
+
+    ///\brief Build the image's PCH with the invocation of CI.
+    ///\returns true if the image is now valid.
+    bool build(const clang::CompilerInstance& CI);
+
+    ///\brief Build the image's PCH with the invocation of CI on a thread of
+    /// its own, for the next session to use.
+    void buildInBackground(const clang::CompilerInstance& CI);
+
+    ///\brief Add Types, fully qualified names of class template
+    /// instantiations, to those the instantiation image of this image
+    /// precompiles.
+    ///\returns false if the list could not be written.
+    bool recordInstantiations(const std::vector<std::string>& Types) const;
+  };
+} // end namespace cling
+
+#endif // CLING_WARM_START_IMAGE_H
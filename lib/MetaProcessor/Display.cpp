@@ -9,6 +9,7 @@
 
 #include "Display.h"
 
+#include "cling/Interpreter/DeclNameIndex.h"
 #include "cling/Interpreter/Interpreter.h"
 #include "cling/Interpreter/LookupHelper.h"
 
@@ -525,8 +526,23 @@ void ClassPrinter::DisplayAllClasses()const
   fOut.Print("List of classes");
   // Could trigger deserialization of decls.
   Interpreter::PushTransactionRAII RAII(const_cast<Interpreter*>(fInterpreter));
+  //Only the classes from AST files need a walk of the translation unit,
+  //the committed transactions' are indexed by name.
   for (decl_iterator decl = tuDecl->decls_begin(); decl != tuDecl->decls_end(); ++decl)
-    ProcessDecl(decl);
+    if (decl->isFromASTFile())
+      ProcessDecl(decl);
+
+  for (const auto& entry : fInterpreter->getDeclNameIndex()) {
+    for (const NamedDecl* const decl : entry.second) {
+      if (decl->isFromASTFile())
+        continue;
+      //The index holds no specializations and no local classes; these are
+      //reached through their template and function.
+      if (isa<CXXRecordDecl>(decl) || isa<ClassTemplateDecl>(decl)
+          || isa<FunctionDecl>(decl))
+        ProcessDecl(decl_iterator(const_cast<NamedDecl*>(decl)));
+    }
+  }
 }
 
 //______________________________________________________________________________
@@ -535,6 +551,17 @@ void ClassPrinter::DisplayClass(const std::string& className)const
   //Just in case asserts were deleted from ctor:
   assert(fInterpreter != 0 && "DisplayClass, fCompiler is null");
 
+  //Classes declared by the committed transactions are indexed by name;
+  //templates and classes from AST files need the LookupHelper.
+  for (const NamedDecl* const decl :
+         fInterpreter->getDeclNameIndex().find(className)) {
+    const CXXRecordDecl* const classDecl = dyn_cast<CXXRecordDecl>(decl);
+    if (classDecl && classDecl->hasDefinition()) {
+      DisplayClassDecl(classDecl);
+      return;
+    }
+  }
+
   const cling::LookupHelper &lookupHelper = fInterpreter->getLookupHelper();
   if (const Decl* const decl
       = lookupHelper.findScope(className, cling::LookupHelper::NoDiagnostics)) {
@@ -1177,6 +1204,31 @@ void GlobalsPrinter::DisplayGlobal(const std::string& name)const
     }
   }
 
+  //Globals declared by the committed transactions are indexed by name, the
+  //enumerators of scoped enums as "E::A". Whatever the index does not know,
+  //e.g. "A" for E::A or the globals from AST files, needs the walk through
+  //the translation unit.
+  bool foundDecl = false;
+  for (const NamedDecl* const decl :
+         fInterpreter->getDeclNameIndex().find(name)) {
+    if (const VarDecl* const varDecl = dyn_cast<VarDecl>(decl)) {
+      if (varDecl->getDeclContext()->getRedeclContext()->isTranslationUnit()) {
+        DisplayVarDecl(varDecl);
+        foundDecl = true;
+      }
+    } else if (const EnumConstantDecl* const enumerator
+               = dyn_cast<EnumConstantDecl>(decl)) {
+      const DeclContext* const enumScope
+        = cast<EnumDecl>(enumerator->getDeclContext())->getDeclContext();
+      if (enumScope->getRedeclContext()->isTranslationUnit()) {
+        DisplayEnumeratorDecl(enumerator);
+        foundDecl = true;
+      }
+    }
+  }
+  if (foundDecl)
+    return;
+
   for (decl_iterator decl = tuDecl->decls_begin(); decl != tuDecl->decls_end(); ++decl) {
     if (const VarDecl* const varDecl = dyn_cast<VarDecl>(*decl)) {
       if (varDecl->getNameAsString() == name) {
@@ -1388,7 +1440,7 @@ private:
   void ProcessNestedDeclarations(const DeclContext* decl)const;
   void ProcessDecl(decl_iterator decl) const;
 
-  void DisplayTypedefDecl(TypedefNameDecl* typedefDecl)const;
+  void DisplayTypedefDecl(const TypedefNameDecl* typedefDecl)const;
 
   FILEPrintHelper fOut;
   const cling::Interpreter* fInterpreter;
@@ -1416,7 +1468,21 @@ void TypedefPrinter::DisplayTypedefs()const
   assert(tuDecl != 0 && "DisplayTypedefs, translation unit is empty");
 
   fOut.Print("List of typedefs");
-  ProcessNestedDeclarations(tuDecl);
+  //Only the typedefs from AST files need a walk of the translation unit,
+  //the committed transactions' are indexed by name.
+  for (decl_iterator it = tuDecl->decls_begin(), eIt = tuDecl->decls_end(); it != eIt; ++it)
+    if (it->isFromASTFile())
+      ProcessDecl(it);
+
+  for (const auto& entry : fInterpreter->getDeclNameIndex()) {
+    for (const NamedDecl* const decl : entry.second) {
+      if (decl->isFromASTFile())
+        continue;
+      //Typedefs local to functions are not indexed.
+      if (isa<TypedefDecl>(decl) || isa<FunctionDecl>(decl))
+        ProcessDecl(decl_iterator(const_cast<NamedDecl*>(decl)));
+    }
+  }
 }
 
 //______________________________________________________________________________
@@ -1424,6 +1490,16 @@ void TypedefPrinter::DisplayTypedef(const std::string& typedefName)const
 {
   assert(fInterpreter != 0 && "DisplayTypedef, fInterpreter is null");
 
+  //Typedefs declared by the committed transactions are indexed by name.
+  for (const NamedDecl* const decl :
+         fInterpreter->getDeclNameIndex().find(typedefName)) {
+    if (const TypedefNameDecl* const typedefDecl
+        = dyn_cast<TypedefNameDecl>(decl)) {
+      DisplayTypedefDecl(typedefDecl);
+      return;
+    }
+  }
+
   const cling::LookupHelper &lookupHelper = fInterpreter->getLookupHelper();
   const QualType type
     = lookupHelper.findType(typedefName, cling::LookupHelper::NoDiagnostics);
@@ -1484,7 +1560,7 @@ void TypedefPrinter::ProcessDecl(decl_iterator decl)const
 }
 
 //______________________________________________________________________________
-void TypedefPrinter::DisplayTypedefDecl(TypedefNameDecl* typedefDecl)const
+void TypedefPrinter::DisplayTypedefDecl(const TypedefNameDecl* typedefDecl)const
 {
   assert(typedefDecl != 0
          && "DisplayTypedefDecl, parameter 'typedefDecl' is null");
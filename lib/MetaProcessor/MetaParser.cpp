@@ -131,6 +131,8 @@ namespace cling {
       || isTypedefCommand()
       || isShellCommand(actionResult, resultValue) || isstoreStateCommand()
       || iscompareStateCommand() || isstatsCommand() || isundoCommand()
+      || issaveInputsCommand(actionResult)
+      || isreplayInputsCommand(actionResult)
       || isRedirectCommand(actionResult) || istraceCommand();
   }
 
@@ -492,8 +494,44 @@ namespace cling {
       consumeToken();
       skipWhitespace();
       const Token& next = getCurTok();
-      m_Actions->actOnstatsCommand(what, next.is(tok::ident)
-                                         ? next.getIdent() : llvm::StringRef());
+      llvm::StringRef args;
+      if (next.is(tok::ident))
+        args = next.getIdent();
+      else if (next.is(tok::constant))
+        args = llvm::StringRef(next.getBufStart(), next.getLength());
+      m_Actions->actOnstatsCommand(what, args);
+      return true;
+    }
+    return false;
+  }
+
+  // saveInputs := 'saveInputs' FilePath
+  // FilePath := AnyString
+  bool MetaParser::issaveInputsCommand(MetaSema::ActionResult& actionResult) {
+    if (getCurTok().is(tok::ident) &&
+        getCurTok().getIdent().equals("saveInputs")) {
+      consumeAnyStringToken(tok::eof);
+      if (!getCurTok().is(tok::raw_ident))
+        return false; // FIXME: Issue proper diagnostics
+      actionResult
+        = m_Actions->actOnsaveInputsCommand(getCurTok().getIdent().trim());
+      consumeToken();
+      return true;
+    }
+    return false;
+  }
+
+  // replayInputs := 'replayInputs' FilePath
+  // FilePath := AnyString
+  bool MetaParser::isreplayInputsCommand(MetaSema::ActionResult& actionResult) {
+    if (getCurTok().is(tok::ident) &&
+        getCurTok().getIdent().equals("replayInputs")) {
+      consumeAnyStringToken(tok::eof);
+      if (!getCurTok().is(tok::raw_ident))
+        return false; // FIXME: Issue proper diagnostics
+      actionResult
+        = m_Actions->actOnreplayInputsCommand(getCurTok().getIdent().trim());
+      consumeToken();
       return true;
     }
     return false;
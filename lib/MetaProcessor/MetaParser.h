@@ -32,7 +32,8 @@ namespace cling {
   //                            PrintDebugCommand | DynamicExtensionsCommand |
   //                            HelpCommand | FileExCommand | FilesCommand |
   //                            ClassCommand | GCommand | StoreStateCommand |
-  //                            CompareStateCommand | StatsCommand | undoCommand
+  //                            CompareStateCommand | StatsCommand | undoCommand |
+  //                            SaveInputsCommand | ReplayInputsCommand
   //                 LCommand := 'L' FilePath
   //                 FCommand := 'F' FilePath[.h|.framework] // OS X only
   //                 TCommand := 'T' FilePath FilePath
@@ -47,7 +48,10 @@ namespace cling {
   //                 DebugCommand := 'debug' [Constant]
   //                 StoreStateCommand := 'storeState' "Ident"
   //                 CompareStateCommand := 'compareState' "Ident"
-  //                 StatsCommand := 'stats' ['ast']
+  //                 StatsCommand := 'stats' ['ast' | 'sloc' |
+  //                                          'memory' [Constant]]
+  //                 SaveInputsCommand := 'saveInputs' FilePath
+  //                 ReplayInputsCommand := 'replayInputs' FilePath
   //                 traceCommand := 'trace' ['ast'] ["Ident"]
   //                 undoCommand := 'undo' [Constant]
   //                 DynamicExtensionsCommand := 'dynamicExtensions' [Constant]
@@ -101,6 +105,8 @@ namespace cling {
     bool isstoreStateCommand();
     bool iscompareStateCommand();
     bool isstatsCommand();
+    bool issaveInputsCommand(MetaSema::ActionResult& actionResult);
+    bool isreplayInputsCommand(MetaSema::ActionResult& actionResult);
     bool istraceCommand();
     bool isundoCommand();
     bool isdynamicExtensionsCommand();
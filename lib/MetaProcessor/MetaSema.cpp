@@ -597,6 +597,20 @@ namespace cling {
     m_Interpreter.compareInterpreterState(name);
   }
 
+  MetaSema::ActionResult
+  MetaSema::actOnsaveInputsCommand(llvm::StringRef file) const {
+    if (m_Interpreter.saveInputs(file) == Interpreter::kSuccess)
+      return AR_Success;
+    return AR_Failure;
+  }
+
+  MetaSema::ActionResult
+  MetaSema::actOnreplayInputsCommand(llvm::StringRef file) const {
+    if (m_Interpreter.replayInputs(file) == Interpreter::kSuccess)
+      return AR_Success;
+    return AR_Failure;
+  }
+
   void MetaSema::actOnstatsCommand(llvm::StringRef name,
                                    llvm::StringRef args) const {
     m_Interpreter.dump(name, args);
@@ -670,11 +684,20 @@ namespace cling {
       "   " << metaString << "compareState <filename>\t- Compare the interpreter's state with the one"
                              "\n\t\t\t\t  saved in a given file\n"
       "\n"
+      "   " << metaString << "saveInputs <filename>\t- Save the inputs so far to a given file\n"
+      "\n"
+      "   " << metaString << "replayInputs <filename>\t- Run the inputs saved in a given file again,"
+                             "\n\t\t\t\t  repeating their side effects\n"
+      "\n"
       "   " << metaString << "stats [name]\t\t- Show stats for internal data structures\n"
                              "\t\t\t\t  'ast'  abstract syntax tree stats\n"
                              "\t\t\t\t  'asttree [filter]'  abstract syntax tree layout\n"
                              "\t\t\t\t  'decl' dump ast declarations\n"
                              "\t\t\t\t  'undo' show undo stack\n"
+                             "\t\t\t\t  'sloc' source location space in use\n"
+                             "\t\t\t\t  'memory [N]' memory by subsystem and top N users\n"
+                             "\t\t\t\t  'jit [name]' functions compiled lazily, tiered up\n"
+                             "\t\t\t\t  or inlined across transactions\n"
       "\n"
       "   " << metaString << "help\t\t\t- Shows this information\n"
       "\n"
@@ -184,6 +184,18 @@ namespace cling {
     ///
     void actOncompareStateCommand(llvm::StringRef name) const;
 
+    ///\brief Save the inputs so far, to be replayed.
+    ///
+    ///\param[in] file - The file to save the inputs to.
+    ///
+    ActionResult actOnsaveInputsCommand(llvm::StringRef file) const;
+
+    ///\brief Replay the saved inputs.
+    ///
+    ///\param[in] file - The file the inputs were saved to.
+    ///
+    ActionResult actOnreplayInputsCommand(llvm::StringRef file) const;
+
     ///\brief Show stats for various internal data structures.
     ///
     ///\param[in] name - Name of the structure.